@@ -0,0 +1,460 @@
+// Per-step latency of Gemini calls over HTTPS: GeminiClient's persistent pool
+// against an http_client built for every step, which is what
+// AgentLoopService did before the pool (a TCP + TLS handshake per call).
+//
+// Both talk to a local mock of generateContent that answers after a fixed
+// think time. A relay in front of the mock delays every chunk of data by half
+// the round-trip time, so TLS handshakes cost what they would over a real
+// link. The TCP handshake with the relay itself is not delayed, which only
+// flatters the per-step client. The mock's certificate is generated at
+// startup and trusted through gemini_ca_file. Each run is repeated with
+// several agent loops at once.
+//
+// Build with -DLILY_BUILD_BENCHMARKS=ON and run
+//   ./gemini_latency_bench [steps per loop] [rtt ms] [think ms] [concurrent loops]
+
+#include <lily/services/GeminiClient.hpp>
+
+#include <cpprest/http_client.h>
+#include <nlohmann/json.hpp>
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <openssl/ssl.h>
+#include <openssl/x509v3.h>
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using lily::services::GeminiClient;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Self-signed certificate for localhost / 127.0.0.1; the PEM goes to ca_path for the clients
+SSL_CTX* make_server_context(const std::string& ca_path) {
+    EVP_PKEY* key = nullptr;
+    EVP_PKEY_CTX* key_context = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
+    if (!key_context || EVP_PKEY_keygen_init(key_context) <= 0 ||
+        EVP_PKEY_CTX_set_ec_paramgen_curve_nid(key_context, NID_X9_62_prime256v1) <= 0 ||
+        EVP_PKEY_keygen(key_context, &key) <= 0) {
+        return nullptr;
+    }
+    EVP_PKEY_CTX_free(key_context);
+
+    X509* certificate = X509_new();
+    X509_set_version(certificate, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(certificate), 1);
+    X509_gmtime_adj(X509_getm_notBefore(certificate), -60);
+    X509_gmtime_adj(X509_getm_notAfter(certificate), 24 * 60 * 60);
+    X509_set_pubkey(certificate, key);
+    X509_NAME* name = X509_get_subject_name(certificate);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>("localhost"), -1, -1, 0);
+    X509_set_issuer_name(certificate, name);
+
+    X509V3_CTX extension_context;
+    X509V3_set_ctx_nodb(&extension_context);
+    X509V3_set_ctx(&extension_context, certificate, certificate, nullptr, nullptr, 0);
+    const std::pair<int, const char*> extensions[] = {
+        {NID_basic_constraints, "critical,CA:TRUE"},
+        {NID_subject_alt_name, "DNS:localhost,IP:127.0.0.1"},
+    };
+    for (const auto& entry : extensions) {
+        X509_EXTENSION* extension = X509V3_EXT_conf_nid(nullptr, &extension_context, entry.first, entry.second);
+        if (!extension) {
+            return nullptr;
+        }
+        X509_add_ext(certificate, extension, -1);
+        X509_EXTENSION_free(extension);
+    }
+    if (X509_sign(certificate, key, EVP_sha256()) <= 0) {
+        return nullptr;
+    }
+
+    FILE* pem = std::fopen(ca_path.c_str(), "w");
+    if (!pem) {
+        return nullptr;
+    }
+    PEM_write_X509(pem, certificate);
+    std::fclose(pem);
+
+    SSL_CTX* context = SSL_CTX_new(TLS_server_method());
+    if (!context || SSL_CTX_use_certificate(context, certificate) != 1 || SSL_CTX_use_PrivateKey(context, key) != 1) {
+        return nullptr;
+    }
+    X509_free(certificate);
+    EVP_PKEY_free(key);
+    return context;
+}
+
+bool write_all(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = ::send(fd, data, size, MSG_NOSIGNAL);
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+// Listening socket on 127.0.0.1 with an ephemeral port
+int listen_local(uint16_t& port) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    if (fd < 0 || ::bind(fd, reinterpret_cast<sockaddr*>(&address), length) != 0 || ::listen(fd, 128) != 0 ||
+        ::getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+        return -1;
+    }
+    port = ntohs(address.sin_port);
+    return fd;
+}
+
+void set_no_delay(int fd) {
+    int on = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+}
+
+// generateContent over HTTP/1.1 keep-alive, answering every request after a fixed think time.
+// Like the relay, it serves on detached threads for the rest of the run.
+class MockGemini {
+public:
+    MockGemini(SSL_CTX* context, std::chrono::milliseconds think) : _context(context), _think(think) {
+        nlohmann::json response;
+        response["candidates"][0]["content"]["role"] = "model";
+        response["candidates"][0]["content"]["parts"][0]["text"] = "Here is what I found.";
+        response["candidates"][0]["finishReason"] = "STOP";
+        std::string body = response.dump();
+        _response = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: " +
+                    std::to_string(body.size()) + "\r\n\r\n" + body;
+
+        _listen_fd = listen_local(_port);
+        if (_listen_fd >= 0) {
+            std::thread([this]() { accept_loop(); }).detach();
+        }
+    }
+
+    uint16_t port() const { return _listen_fd >= 0 ? _port : 0; }
+
+private:
+    void accept_loop() {
+        while (true) {
+            int fd = ::accept(_listen_fd, nullptr, nullptr);
+            if (fd < 0) {
+                return;
+            }
+            set_no_delay(fd);
+            std::thread([this, fd]() { serve(fd); }).detach();
+        }
+    }
+
+    void serve(int fd) {
+        SSL* ssl = SSL_new(_context);
+        SSL_set_fd(ssl, fd);
+        if (SSL_accept(ssl) == 1) {
+            std::string buffer;
+            while (read_request(ssl, buffer)) {
+                std::this_thread::sleep_for(_think);
+                if (SSL_write(ssl, _response.data(), static_cast<int>(_response.size())) <= 0) {
+                    break;
+                }
+            }
+        }
+        SSL_free(ssl);
+        ::close(fd);
+    }
+
+    // Consumes one request (headers plus Content-Length body) from buffer, reading more as needed
+    static bool read_request(SSL* ssl, std::string& buffer) {
+        size_t header_end;
+        while ((header_end = buffer.find("\r\n\r\n")) == std::string::npos) {
+            if (!read_more(ssl, buffer)) {
+                return false;
+            }
+        }
+        std::string headers = buffer.substr(0, header_end);
+        std::transform(headers.begin(), headers.end(), headers.begin(), ::tolower);
+        size_t content_length = 0;
+        size_t field = headers.find("content-length:");
+        if (field != std::string::npos) {
+            content_length = std::strtoul(headers.c_str() + field + 15, nullptr, 10);
+        }
+        size_t total = header_end + 4 + content_length;
+        while (buffer.size() < total) {
+            if (!read_more(ssl, buffer)) {
+                return false;
+            }
+        }
+        buffer.erase(0, total);
+        return true;
+    }
+
+    static bool read_more(SSL* ssl, std::string& buffer) {
+        char chunk[16384];
+        int read = SSL_read(ssl, chunk, sizeof(chunk));
+        if (read <= 0) {
+            return false;
+        }
+        buffer.append(chunk, static_cast<size_t>(read));
+        return true;
+    }
+
+    SSL_CTX* _context;
+    std::chrono::milliseconds _think;
+    std::string _response;
+    int _listen_fd = -1;
+    uint16_t _port = 0;
+};
+
+// TCP relay that delivers every chunk one_way later, in order, in both directions
+class LatencyRelay {
+public:
+    LatencyRelay(uint16_t upstream_port, std::chrono::milliseconds one_way)
+        : _upstream_port(upstream_port), _one_way(one_way) {
+        _listen_fd = listen_local(_port);
+        if (_listen_fd >= 0) {
+            std::thread([this]() { accept_loop(); }).detach();
+        }
+    }
+
+    uint16_t port() const { return _listen_fd >= 0 ? _port : 0; }
+
+private:
+    // Both sockets of one relayed connection; closed once neither direction uses them
+    struct Link {
+        int client;
+        int upstream;
+        ~Link() {
+            ::close(client);
+            ::close(upstream);
+        }
+    };
+
+    struct Packet {
+        Clock::time_point due;
+        std::string bytes;
+    };
+
+    void accept_loop() {
+        while (true) {
+            int client = ::accept(_listen_fd, nullptr, nullptr);
+            if (client < 0) {
+                return;
+            }
+            int upstream = ::socket(AF_INET, SOCK_STREAM, 0);
+            sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            address.sin_port = htons(_upstream_port);
+            if (upstream < 0 || ::connect(upstream, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+                ::close(client);
+                if (upstream >= 0) {
+                    ::close(upstream);
+                }
+                continue;
+            }
+            set_no_delay(client);
+            set_no_delay(upstream);
+            std::shared_ptr<Link> link(new Link{client, upstream});
+            std::thread([this, link]() { pump(link, true); }).detach();
+            std::thread([this, link]() { pump(link, false); }).detach();
+        }
+    }
+
+    // Reads from one socket on this thread and writes to the other on a second one, each chunk once it is due
+    void pump(std::shared_ptr<Link> link, bool to_upstream) {
+        int from = to_upstream ? link->client : link->upstream;
+        int to = to_upstream ? link->upstream : link->client;
+        std::mutex mutex;
+        std::condition_variable ready;
+        std::deque<Packet> queue;
+        bool closed = false;
+
+        std::thread writer([&]() {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true) {
+                ready.wait(lock, [&]() { return closed || !queue.empty(); });
+                if (queue.empty()) {
+                    break;
+                }
+                Packet packet = std::move(queue.front());
+                queue.pop_front();
+                lock.unlock();
+                std::this_thread::sleep_until(packet.due);
+                bool written = write_all(to, packet.bytes.data(), packet.bytes.size());
+                lock.lock();
+                if (!written) {
+                    break;
+                }
+            }
+            ::shutdown(to, SHUT_WR);
+        });
+
+        char chunk[16384];
+        while (true) {
+            ssize_t read = ::recv(from, chunk, sizeof(chunk), 0);
+            std::lock_guard<std::mutex> lock(mutex);
+            if (read <= 0) {
+                closed = true;
+                ready.notify_one();
+                break;
+            }
+            queue.push_back(Packet{Clock::now() + _one_way, std::string(chunk, static_cast<size_t>(read))});
+            ready.notify_one();
+        }
+        writer.join();
+    }
+
+    uint16_t _upstream_port;
+    std::chrono::milliseconds _one_way;
+    int _listen_fd = -1;
+    uint16_t _port = 0;
+};
+
+std::string request_body() {
+    nlohmann::json request;
+    request["contents"][0]["role"] = "user";
+    request["contents"][0]["parts"][0]["text"] = "What is on my calendar tomorrow?";
+    return request.dump();
+}
+
+struct Run {
+    std::vector<double> latencies_ms;
+    size_t failures = 0;
+};
+
+// loops agent loops at once, each making steps sequential calls; step() returns whether the call succeeded
+template<typename Step>
+Run run_loops(size_t loops, size_t steps, Step step) {
+    std::vector<Run> runs(loops);
+    std::vector<std::thread> threads;
+    for (size_t loop = 0; loop < loops; ++loop) {
+        threads.emplace_back([&runs, loop, steps, &step]() {
+            for (size_t i = 0; i < steps; ++i) {
+                auto start = Clock::now();
+                bool ok = step();
+                runs[loop].latencies_ms.push_back(std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+                runs[loop].failures += ok ? 0 : 1;
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    Run total;
+    for (auto& run : runs) {
+        total.latencies_ms.insert(total.latencies_ms.end(), run.latencies_ms.begin(), run.latencies_ms.end());
+        total.failures += run.failures;
+    }
+    return total;
+}
+
+double percentile(std::vector<double> values, double p) {
+    if (values.empty()) {
+        return 0;
+    }
+    size_t index = static_cast<size_t>(p * (values.size() - 1));
+    std::nth_element(values.begin(), values.begin() + static_cast<std::ptrdiff_t>(index), values.end());
+    return values[index];
+}
+
+void report(const char* name, size_t loops, const Run& run) {
+    std::printf("%-22s %5zu %10.1f %10.1f %10zu\n", name, loops,
+                percentile(run.latencies_ms, 0.5), percentile(run.latencies_ms, 0.99), run.failures);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    size_t steps = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100;
+    std::chrono::milliseconds rtt(argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 20);
+    std::chrono::milliseconds think(argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 50);
+    size_t concurrent = argc > 4 ? std::strtoul(argv[4], nullptr, 10) : 8;
+    std::signal(SIGPIPE, SIG_IGN);
+
+    std::string ca_path = "/tmp/gemini_latency_bench_ca.pem";
+    SSL_CTX* context = make_server_context(ca_path);
+    if (!context) {
+        ERR_print_errors_fp(stderr);
+        return 1;
+    }
+    MockGemini mock(context, think);
+    LatencyRelay relay(mock.port(), rtt / 2);
+    if (mock.port() == 0 || relay.port() == 0) {
+        std::fprintf(stderr, "cannot listen on 127.0.0.1\n");
+        return 1;
+    }
+    std::string base_url = "https://127.0.0.1:" + std::to_string(relay.port());
+    auto body = std::make_shared<const std::string>(request_body());
+
+    lily::config::AppConfig config;
+    config.withGeminiApiKeys({"bench-key"}).withGeminiBaseUrl(base_url).withGeminiCaFile(ca_path).withGeminiPoolSize(concurrent);
+
+    std::printf("steps=%zu per loop, rtt=%lldms, think=%lldms, mock at %s\n", steps,
+                static_cast<long long>(rtt.count()), static_cast<long long>(think.count()), base_url.c_str());
+    std::printf("%-22s %5s %10s %10s %10s\n", "client", "loops", "p50 (ms)", "p99 (ms)", "failures");
+
+    // GeminiClient logs every call; keep the table readable
+    std::streambuf* log = std::cout.rdbuf(nullptr);
+
+    // What AgentLoopService did before: a new client, so a new TCP + TLS handshake, per step
+    web::http::client::http_client_config per_step_config;
+    per_step_config.set_timeout(std::chrono::seconds(config.gemini_timeout_seconds));
+    per_step_config.set_ssl_context_callback([ca_path](boost::asio::ssl::context& ssl) {
+        ssl.load_verify_file(ca_path);
+    });
+    auto per_step = [&]() {
+        try {
+            web::http::client::http_client client(utility::conversions::to_string_t(base_url), per_step_config);
+            web::http::http_request request(web::http::methods::POST);
+            request.set_request_uri(web::uri(utility::conversions::to_string_t(
+                "/v1beta/models/" + config.getGeminiModel() + ":generateContent?key=bench-key")));
+            request.set_body(*body, "application/json");
+            auto response = client.request(request).get();
+            return response.status_code() == 200 &&
+                   nlohmann::json::parse(response.extract_utf8string(true).get()).contains("candidates");
+        } catch (const std::exception& e) {
+            std::cerr << "per-step request failed: " << e.what() << std::endl;
+            return false;
+        }
+    };
+
+    GeminiClient pooled(config);
+    auto pooled_step = [&]() {
+        return pooled.generate_content(body).get().contains("candidates");
+    };
+    pooled_step(); // the first call opens a connection, as a long-running server's would have long ago
+
+    Run result = run_loops(1, steps, per_step);
+    report("client per step", 1, result);
+    result = run_loops(1, steps, pooled_step);
+    report("GeminiClient pool", 1, result);
+    result = run_loops(concurrent, steps, per_step);
+    report("client per step", concurrent, result);
+    result = run_loops(concurrent, steps, pooled_step);
+    report("GeminiClient pool", concurrent, result);
+
+    std::cout.rdbuf(log);
+    return 0;
+}
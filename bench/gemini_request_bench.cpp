@@ -0,0 +1,127 @@
+// CPU cost of building one generateContent request (and parsing its response)
+// per agent step as the conversation grows, comparing the old path with
+// GeminiRequestBuilder.
+//
+// The old path dumped the whole nlohmann history, parsed it into a cpprest
+// value, re-converted every tool declaration and let cpprest serialize the
+// request again; the response was parsed by cpprest, serialized and parsed
+// once more by nlohmann. cpprest is not linked here, so its parse/serialize
+// steps are stood in for by an extra nlohmann parse/dump of the same bytes.
+//
+// Build with -DLILY_BUILD_BENCHMARKS=ON and run ./gemini_request_bench [steps] [tools]
+
+#include <lily/services/GeminiRequestBuilder.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using lily::services::GeminiRequestBuilder;
+
+namespace {
+
+std::vector<nlohmann::json> make_tools(size_t count) {
+    std::vector<nlohmann::json> tools;
+    for (size_t i = 0; i < count; ++i) {
+        nlohmann::json tool;
+        tool["name"] = "tool_" + std::to_string(i);
+        tool["description"] = "Looks something up for the agent; tool number " + std::to_string(i);
+        tool["inputSchema"]["type"] = "object";
+        tool["inputSchema"]["properties"]["query"] = {{"type", "string"}, {"description", "What to look up"}};
+        tool["inputSchema"]["properties"]["limit"] = {{"type", "integer"}, {"description", "Max results"}};
+        tool["inputSchema"]["required"] = {"query"};
+        tools.push_back(tool);
+    }
+    return tools;
+}
+
+nlohmann::json function_call_parts(size_t step) {
+    nlohmann::json part;
+    part["functionCall"]["name"] = "tool_" + std::to_string(step % 4);
+    part["functionCall"]["args"] = {{"query", "step " + std::to_string(step)}, {"limit", 5}};
+    return nlohmann::json::array({part});
+}
+
+nlohmann::json function_response_parts(size_t step) {
+    nlohmann::json result = nlohmann::json::array();
+    for (int i = 0; i < 20; ++i) {
+        result.push_back({{"title", "Result " + std::to_string(i)},
+                          {"snippet", std::string(160, 'a' + static_cast<char>((step + i) % 26))}});
+    }
+    nlohmann::json part;
+    part["functionResponse"]["name"] = "tool_" + std::to_string(step % 4);
+    part["functionResponse"]["response"] = {{"name", part["functionResponse"]["name"]}, {"content", result}};
+    return nlohmann::json::array({part});
+}
+
+std::string response_body(size_t step) {
+    nlohmann::json response;
+    response["candidates"] = nlohmann::json::array({{{"content", {{"role", "model"}, {"parts", function_call_parts(step)}}}}});
+    return response.dump();
+}
+
+using Clock = std::chrono::steady_clock;
+
+double micros_since(Clock::time_point start) {
+    return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    size_t steps = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 20;
+    size_t tool_count = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 30;
+    auto tools = make_tools(tool_count);
+    nlohmann::json first_parts = nlohmann::json::array({{{"text", std::string(2000, 'x')}}});
+
+    std::printf("tools=%zu\n", tool_count);
+    std::printf("%-6s %10s %16s %16s %8s\n", "step", "bytes", "legacy (us)", "builder (us)", "speedup");
+
+    nlohmann::json history = nlohmann::json::array();
+    history.push_back({{"role", "user"}, {"parts", first_parts}});
+
+    GeminiRequestBuilder builder;
+    builder.append_turn("user", first_parts);
+    builder.set_tools_fragment(std::make_shared<const std::string>(GeminiRequestBuilder::render_tools(tools)));
+
+    double legacy_total = 0, builder_total = 0;
+    for (size_t step = 1; step <= steps; ++step) {
+        std::string raw_response = response_body(step);
+        size_t bytes = 0;
+
+        auto start = Clock::now();
+        {
+            nlohmann::json request = nlohmann::json::object();
+            request["contents"] = nlohmann::json::parse(history.dump());
+            nlohmann::json tools_json = nlohmann::json::array();
+            for (const auto& tool : tools) tools_json.push_back(GeminiRequestBuilder::convert_mcp_tool(tool));
+            request["tools"] = tools_json;
+            std::string body = request.dump();
+            bytes = body.size();
+
+            nlohmann::json response = nlohmann::json::parse(nlohmann::json::parse(raw_response).dump());
+            history.push_back({{"role", "model"}, {"parts", response["candidates"][0]["content"]["parts"]}});
+            history.push_back({{"role", "function"}, {"parts", function_response_parts(step)}});
+        }
+        double legacy = micros_since(start);
+
+        start = Clock::now();
+        {
+            std::string body = builder.build_body();
+            if (body.size() != bytes) std::printf("  (body size mismatch: %zu vs %zu)\n", body.size(), bytes);
+
+            nlohmann::json response = nlohmann::json::parse(raw_response);
+            builder.append_turn("model", response["candidates"][0]["content"]["parts"]);
+            builder.append_turn("function", function_response_parts(step));
+        }
+        double built = micros_since(start);
+
+        legacy_total += legacy;
+        builder_total += built;
+        std::printf("%-6zu %10zu %16.1f %16.1f %7.2fx\n", step, bytes, legacy, built, legacy / built);
+    }
+    std::printf("%-6s %10s %16.1f %16.1f %7.2fx\n", "total", "", legacy_total, builder_total, legacy_total / builder_total);
+    return 0;
+}
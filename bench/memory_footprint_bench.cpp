@@ -0,0 +1,191 @@
+// Resident memory of stored conversations: MemoryService's arena-backed
+// storage against the previous layout (one Message with its own role and
+// content strings per turn). Each variant fills the same conversations in a
+// forked child, so freed memory from one cannot flatter the other.
+// User turns are short and assistant turns longer, with the odd long answer.
+//
+// Build with -DLILY_BUILD_BENCHMARKS=ON and run ./memory_footprint_bench [users] [messages per user]
+
+#include <lily/services/MemoryService.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+using lily::services::Role;
+
+namespace {
+
+// The store as it was: every message owns a role string and a content string
+class LegacyStore {
+public:
+    void add_message(const std::string& user_id, Role role, const std::string& content) {
+        LegacyMessage message;
+        message.role = lily::services::role_name(role);
+        message.content = content;
+        message.timestamp = std::chrono::system_clock::now();
+        message.tokens = lily::services::MemoryService::estimate_tokens(content);
+        LegacyConversation& conversation = _conversations[user_id];
+        conversation.tokens += message.tokens;
+        conversation.messages.push_back(message);
+    }
+
+private:
+    struct LegacyMessage {
+        std::string role;
+        std::string content;
+        std::chrono::system_clock::time_point timestamp;
+        size_t tokens = 0;
+    };
+
+    // Same bookkeeping as MemoryService's conversations, minus the arena
+    struct LegacyConversation {
+        uint64_t id = 0;
+        std::deque<LegacyMessage> messages;
+        size_t tokens = 0;
+        uint64_t first_sequence = 0;
+        std::string summary;
+        size_t summary_tokens = 0;
+        bool summary_pending = false;
+        size_t summary_retry_tokens = 0;
+    };
+
+    std::unordered_map<std::string, LegacyConversation> _conversations;
+};
+
+size_t resident_bytes() {
+    long pages = 0;
+    long resident = 0;
+    FILE* statm = std::fopen("/proc/self/statm", "r");
+    if (statm) {
+        if (std::fscanf(statm, "%ld %ld", &pages, &resident) != 2) {
+            resident = 0;
+        }
+        std::fclose(statm);
+    }
+    return static_cast<size_t>(resident) * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+size_t heap_bytes() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    return mallinfo2().uordblks;
+#else
+    return 0;
+#endif
+}
+
+struct Usage {
+    size_t resident;
+    size_t heap;
+};
+
+// Taken by the fill function while its store is still alive
+Usage usage() {
+    return Usage{resident_bytes(), heap_bytes()};
+}
+
+std::vector<std::string> make_turns(size_t count) {
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<size_t> user_length(20, 160);
+    std::uniform_int_distribution<size_t> answer_length(120, 900);
+    std::vector<std::string> turns;
+    turns.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        size_t length = i % 2 ? answer_length(rng) : user_length(rng);
+        if (i % 50 == 49) {
+            length = 6000; // a long answer now and then
+        }
+        std::string text;
+        text.reserve(length);
+        while (text.size() < length) {
+            text.push_back(static_cast<char>('a' + rng() % 26));
+        }
+        turns.push_back(std::move(text));
+    }
+    return turns;
+}
+
+// Fills a store in a child process and reports the memory it grew by
+template<typename Fill>
+void measure(const char* name, size_t messages, size_t payload, Fill fill) {
+    int pipe_fds[2];
+    if (pipe(pipe_fds) != 0) {
+        return;
+    }
+    pid_t child = fork();
+    if (child == 0) {
+        close(pipe_fds[0]);
+        Usage before = usage();
+        Usage after = fill();
+        size_t result[2] = {after.resident - before.resident, after.heap - before.heap};
+        ssize_t written = write(pipe_fds[1], result, sizeof(result));
+        _exit(written == static_cast<ssize_t>(sizeof(result)) ? 0 : 1);
+    }
+    close(pipe_fds[1]);
+    size_t result[2] = {0, 0};
+    ssize_t got = read(pipe_fds[0], result, sizeof(result));
+    close(pipe_fds[0]);
+    waitpid(child, nullptr, 0);
+    if (got != static_cast<ssize_t>(sizeof(result))) {
+        std::printf("%-8s failed\n", name);
+        return;
+    }
+
+    double per_1k = 1000.0 / static_cast<double>(messages);
+    std::printf("%-8s %16.0f %16.0f %16.0f\n", name,
+                result[0] * per_1k, result[1] * per_1k, (result[1] - static_cast<double>(payload)) * per_1k);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    size_t user_count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 2000;
+    size_t per_user = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 200;
+
+    std::vector<std::string> users;
+    for (size_t i = 0; i < user_count; ++i) {
+        users.push_back("user-" + std::to_string(i));
+    }
+    std::vector<std::string> turns = make_turns(per_user);
+    size_t payload = 0;
+    for (const auto& turn : turns) {
+        payload += turn.size();
+    }
+    payload *= user_count;
+    size_t messages = user_count * per_user;
+
+    std::printf("users=%zu messages=%zu content=%.0f bytes per 1k messages\n",
+                user_count, messages, payload * 1000.0 / static_cast<double>(messages));
+    std::printf("%-8s %16s %16s %16s\n", "layout", "rss/1k msgs", "heap/1k msgs", "overhead/1k msgs");
+
+    // Turns arrive interleaved across users, as they would in production
+    measure("legacy", messages, payload, [&]() {
+        LegacyStore store;
+        for (size_t i = 0; i < per_user; ++i) {
+            for (const auto& user : users) {
+                store.add_message(user, i % 2 ? Role::assistant : Role::user, turns[i]);
+            }
+        }
+        return usage();
+    });
+    measure("arena", messages, payload, [&]() {
+        lily::services::MemoryService store;
+        for (size_t i = 0; i < per_user; ++i) {
+            for (const auto& user : users) {
+                store.add_message(user, i % 2 ? Role::assistant : Role::user, std::string(turns[i]));
+            }
+        }
+        return usage();
+    });
+    return 0;
+}
@@ -0,0 +1,111 @@
+// Restart recovery of a journaled MemoryService, and what the journal costs
+// the request path. Fills users x messages through add_message with the
+// journal on (snapshots taken as the log grows), drops the service, then
+// times a fresh service restoring everything from the snapshot and the log
+// tail. add_message latency is sampled with and without the journal.
+//
+// Build with -DLILY_BUILD_BENCHMARKS=ON and run
+//   ./memory_recovery_bench [users] [messages per user] [directory]
+
+#include <lily/services/MemoryService.hpp>
+#include <lily/services/MemoryJournal.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using lily::services::MemoryJournal;
+using lily::services::MemoryService;
+using lily::services::Role;
+
+namespace {
+
+const std::chrono::milliseconds kFlushInterval(20);
+const size_t kSnapshotWalBytes = 64u << 20;
+
+std::vector<std::string> make_turns(size_t count) {
+    std::mt19937 rng(11);
+    std::uniform_int_distribution<size_t> user_length(20, 160);
+    std::uniform_int_distribution<size_t> answer_length(120, 600);
+    std::vector<std::string> turns;
+    for (size_t i = 0; i < count; ++i) {
+        std::string text(i % 2 ? answer_length(rng) : user_length(rng), 'x');
+        for (auto& c : text) {
+            c = static_cast<char>('a' + rng() % 26);
+        }
+        turns.push_back(std::move(text));
+    }
+    return turns;
+}
+
+// Fills the store turn by turn across all users; returns per-call latencies in microseconds
+std::vector<double> fill(MemoryService& store, const std::vector<std::string>& users, const std::vector<std::string>& turns) {
+    std::vector<double> latencies;
+    latencies.reserve(users.size() * turns.size());
+    for (size_t i = 0; i < turns.size(); ++i) {
+        for (const auto& user : users) {
+            auto start = std::chrono::steady_clock::now();
+            store.add_message(user, i % 2 ? Role::assistant : Role::user, turns[i]);
+            latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+        }
+    }
+    return latencies;
+}
+
+double percentile(std::vector<double>& values, double p) {
+    size_t index = static_cast<size_t>(p * (values.size() - 1));
+    std::nth_element(values.begin(), values.begin() + static_cast<std::ptrdiff_t>(index), values.end());
+    return values[index];
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    size_t user_count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10000;
+    size_t per_user = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 100;
+    std::string directory = argc > 3 ? argv[3] : "/tmp/lily_memory_recovery_bench";
+    if (std::system(("rm -rf '" + directory + "'").c_str()) != 0) {
+        return 1;
+    }
+
+    std::vector<std::string> users;
+    for (size_t i = 0; i < user_count; ++i) {
+        users.push_back("user-" + std::to_string(i));
+    }
+    std::vector<std::string> turns = make_turns(per_user);
+    size_t messages = user_count * per_user;
+    std::printf("users=%zu messages=%zu directory=%s\n", user_count, messages, directory.c_str());
+
+    std::vector<double> plain;
+    {
+        MemoryService store;
+        plain = fill(store, users, turns);
+    }
+
+    std::vector<double> journaled;
+    {
+        MemoryService store;
+        store.set_journal(std::make_shared<MemoryJournal>(directory, kFlushInterval, kSnapshotWalBytes));
+        journaled = fill(store, users, turns);
+        auto metrics = store.get_metrics();
+        std::printf("journal: %s\n", metrics["journal"].dump().c_str());
+    }
+
+    std::printf("%-10s %12s %12s %12s\n", "add_message", "p50 (us)", "p99 (us)", "p99.9 (us)");
+    std::printf("%-10s %12.2f %12.2f %12.2f\n", "memory", percentile(plain, 0.5), percentile(plain, 0.99), percentile(plain, 0.999));
+    std::printf("%-10s %12.2f %12.2f %12.2f\n", "journaled", percentile(journaled, 0.5), percentile(journaled, 0.99), percentile(journaled, 0.999));
+
+    auto start = std::chrono::steady_clock::now();
+    MemoryService recovered;
+    recovered.set_journal(std::make_shared<MemoryJournal>(directory, kFlushInterval, kSnapshotWalBytes));
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    auto metrics = recovered.get_metrics();
+    size_t restored = metrics["messages"].get<size_t>();
+    std::printf("recovered %zu of %zu messages in %.3fs (%.0f messages/s)\n", restored, messages, seconds, restored / seconds);
+    return restored == messages ? 0 : 1;
+}
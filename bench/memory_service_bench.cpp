@@ -0,0 +1,109 @@
+// Throughput of the sharded MemoryService against the same store behind a
+// single global mutex, with thousands of users and 1-64 concurrent writers.
+// Each operation appends a message (3 in 4) or snapshots a conversation
+// (1 in 4) for a random user.
+//
+// Build with -DLILY_BUILD_BENCHMARKS=ON and run ./memory_service_bench [users] [ops]
+
+#include <lily/services/MemoryService.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using lily::services::Message;
+using lily::services::Role;
+
+namespace {
+
+// The store as it was, made thread-safe the simple way: one map, one mutex
+class GlobalMutexStore {
+public:
+    std::vector<Message> get_conversation(const std::string& user_id) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _conversations.find(user_id);
+        return it == _conversations.end() ? std::vector<Message>() : it->second;
+    }
+
+    void add_message(const std::string& user_id, Role role, const std::string& content) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        Message message;
+        message.role = role;
+        message.content = content;
+        message.timestamp = std::chrono::system_clock::now();
+        _conversations[user_id].push_back(message);
+    }
+
+private:
+    std::mutex _mutex;
+    std::map<std::string, std::vector<Message>> _conversations;
+};
+
+template<typename Store>
+double run(Store& store, const std::vector<std::string>& users, size_t threads, size_t total_ops) {
+    const size_t per_thread = total_ops / threads;
+    std::atomic<bool> go{false};
+    std::atomic<size_t> sink{0};
+    const std::string content = "The quick brown fox jumps over the lazy dog, again and again.";
+
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            std::mt19937 rng(static_cast<uint32_t>(t + 1));
+            std::uniform_int_distribution<size_t> pick(0, users.size() - 1);
+            while (!go.load(std::memory_order_acquire)) std::this_thread::yield();
+            size_t seen = 0;
+            for (size_t i = 0; i < per_thread; ++i) {
+                const std::string& user = users[pick(rng)];
+                if (i % 4 == 3) {
+                    seen += store.get_conversation(user).size();
+                } else {
+                    store.add_message(user, i % 2 ? Role::assistant : Role::user, content);
+                }
+            }
+            sink.fetch_add(seen, std::memory_order_relaxed);
+        });
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    for (auto& worker : workers) worker.join();
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return static_cast<double>(per_thread * threads) / elapsed;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    size_t user_count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 5000;
+    size_t total_ops = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 400000;
+
+    std::vector<std::string> users;
+    for (size_t i = 0; i < user_count; ++i) {
+        users.push_back("user-" + std::to_string(i));
+    }
+
+    std::printf("users=%zu ops=%zu (75%% append, 25%% snapshot)\n", user_count, total_ops);
+    std::printf("%-8s %18s %18s %8s\n", "threads", "global (ops/s)", "sharded (ops/s)", "speedup");
+
+    for (size_t threads : {1, 4, 16, 64}) {
+        double global, sharded;
+        {
+            GlobalMutexStore store;
+            global = run(store, users, threads, total_ops);
+        }
+        {
+            lily::services::MemoryService store;
+            sharded = run(store, users, threads, total_ops);
+        }
+        std::printf("%-8zu %18.0f %18.0f %7.2fx\n", threads, global, sharded, sharded / global);
+    }
+    return 0;
+}
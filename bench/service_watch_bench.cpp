@@ -0,0 +1,323 @@
+// Service discovery against a local Consul stand-in: how fast catalog and
+// health changes reach Service, how many requests the watch makes while
+// nothing changes, and whether it copes with index resets and failing
+// health queries.
+//
+// The stand-in is an http_listener that answers /v1/catalog/services and
+// /v1/health/service/<name> the way Consul does: X-Consul-Index on every
+// answer, and a request whose index is current blocks until something changes
+// or its wait runs out. Each scenario prints what it measured and whether
+// the watch behaved; the exit code is non-zero if any check failed.
+//
+// Build with -DLILY_BUILD_BENCHMARKS=ON and run ./service_watch_bench [port] [wait seconds]
+
+#include <lily/services/Service.hpp>
+
+#include <cpprest/http_listener.h>
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using lily::services::Service;
+using web::http::experimental::listener::http_listener;
+using web::http::http_request;
+using web::http::http_response;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+class ConsulStandIn {
+public:
+    explicit ConsulStandIn(const std::string& address) : _listener(utility::conversions::to_string_t(address)) {
+        _listener.support(web::http::methods::GET, [this](http_request request) {
+            // Blocking queries may wait for a long time; keep them off the listener's threads
+            std::thread([this, request]() { handle(request); }).detach();
+        });
+        _listener.open().wait();
+    }
+
+    ~ConsulStandIn() {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _closing = true;
+        }
+        _changed.notify_all();
+        _listener.close().wait();
+    }
+
+    // Registers or updates a service with one node tagged hostname=<name>.test
+    void put(const std::string& name, bool passing = true, const std::string& extra_tag = "") {
+        std::lock_guard<std::mutex> lock(_mutex);
+        Entry& entry = _services[name];
+        bool added = entry.index == 0;
+        entry.passing = passing;
+        entry.tags = {"hostname=" + name + ".test"};
+        if (!extra_tag.empty()) {
+            entry.tags.push_back(extra_tag);
+        }
+        entry.index = ++_raft_index;
+        if (added) {
+            _catalog_index = entry.index;
+        }
+        _changed.notify_all();
+    }
+
+    void remove(const std::string& name) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _services.erase(name);
+        _catalog_index = ++_raft_index;
+        _changed.notify_all();
+    }
+
+    // Moves the indexes backwards, as a Consul restored from a snapshot would
+    void reset_indexes() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _raft_index = 1;
+        _catalog_index = 1;
+        for (auto& entry : _services) {
+            entry.second.index = 1;
+        }
+        _changed.notify_all();
+    }
+
+    // The next count health queries for name answer 500
+    void fail_health(const std::string& name, int count) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _failures[name] = count;
+    }
+
+    // Health answers per service, and how many of them carried a new index
+    struct Counts {
+        uint64_t catalog = 0;
+        std::map<std::string, uint64_t> health;
+        std::map<std::string, uint64_t> health_changed;
+    };
+
+    Counts counts() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _counts;
+    }
+
+private:
+    struct Entry {
+        std::vector<std::string> tags;
+        bool passing = true;
+        uint64_t index = 0;
+    };
+
+    void handle(http_request request) {
+        std::string path = utility::conversions::to_utf8string(request.relative_uri().path());
+        auto query = web::uri::split_query(request.relative_uri().query());
+        uint64_t index = 0;
+        std::chrono::seconds wait(300);
+        if (query.count(U("index"))) {
+            index = std::stoull(utility::conversions::to_utf8string(query[U("index")]));
+        }
+        if (query.count(U("wait"))) {
+            wait = std::chrono::seconds(std::stoul(utility::conversions::to_utf8string(query[U("wait")])));
+        }
+
+        const std::string health_prefix = "/v1/health/service/";
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (path == "/v1/catalog/services") {
+            block(lock, wait, [this, index]() { return index == 0 || _catalog_index != index; });
+            _counts.catalog++;
+            nlohmann::json body = nlohmann::json::object();
+            body["consul"] = nlohmann::json::array();
+            for (const auto& entry : _services) {
+                body[entry.first] = entry.second.tags;
+            }
+            reply(request, _catalog_index, body.dump(), lock);
+            return;
+        }
+        if (path.compare(0, health_prefix.size(), health_prefix) == 0) {
+            std::string name = path.substr(health_prefix.size());
+            int& failures = _failures[name];
+            if (failures > 0) {
+                failures--;
+                lock.unlock();
+                request.reply(web::http::status_codes::InternalServerError, U("injected failure"));
+                return;
+            }
+            auto current = [this, name]() {
+                auto it = _services.find(name);
+                return it == _services.end() ? _catalog_index : it->second.index;
+            };
+            block(lock, wait, [&current, index]() { return index == 0 || current() != index; });
+            uint64_t answer_index = current();
+            _counts.health[name]++;
+            if (answer_index != index) {
+                _counts.health_changed[name]++;
+            }
+            nlohmann::json body = nlohmann::json::array();
+            auto it = _services.find(name);
+            if (it != _services.end() && it->second.passing) {
+                nlohmann::json node;
+                node["Service"]["Service"] = name;
+                node["Service"]["Tags"] = it->second.tags;
+                body.push_back(node);
+            }
+            reply(request, answer_index, body.dump(), lock);
+            return;
+        }
+        lock.unlock();
+        request.reply(web::http::status_codes::NotFound);
+    }
+
+    template<typename Ready>
+    void block(std::unique_lock<std::mutex>& lock, std::chrono::seconds wait, Ready ready) {
+        _changed.wait_for(lock, wait, [this, &ready]() { return _closing || ready(); });
+    }
+
+    static void reply(http_request& request, uint64_t index, const std::string& body, std::unique_lock<std::mutex>& lock) {
+        lock.unlock();
+        http_response response(web::http::status_codes::OK);
+        response.headers().add(U("X-Consul-Index"), utility::conversions::to_string_t(std::to_string(index)));
+        response.set_body(body, "application/json");
+        request.reply(response);
+    }
+
+    http_listener _listener;
+    mutable std::mutex _mutex;
+    std::condition_variable _changed;
+    bool _closing = false;
+    uint64_t _raft_index = 10;
+    uint64_t _catalog_index = 10;
+    std::map<std::string, Entry> _services;
+    std::map<std::string, int> _failures;
+    Counts _counts;
+};
+
+bool has_service(Service& service, const std::string& name) {
+    for (const auto& info : service.get_services_info()) {
+        if (info.name == name) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Seconds until condition holds, or -1 after timeout
+double wait_for(const std::function<bool()>& condition, std::chrono::seconds timeout) {
+    auto start = Clock::now();
+    while (Clock::now() - start < timeout) {
+        if (condition()) {
+            return std::chrono::duration<double>(Clock::now() - start).count();
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return -1;
+}
+
+int failed_checks = 0;
+
+void check(const char* scenario, bool ok, const std::string& detail) {
+    std::printf("%-34s %-4s %s\n", scenario, ok ? "ok" : "FAIL", detail.c_str());
+    failed_checks += ok ? 0 : 1;
+}
+
+std::string seconds(double value) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.3fs", value);
+    return text;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::string port = argc > 1 ? argv[1] : "18500";
+    std::chrono::seconds wait(argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 10);
+    std::string address = "127.0.0.1:" + port;
+    setenv("CONSUL_HTTP_ADDR", address.c_str(), 1);
+
+    ConsulStandIn consul("http://" + address);
+    for (const char* name : {"alpha", "beta", "gamma"}) {
+        consul.put(name);
+    }
+
+    // Service logs every change; keep the report readable
+    std::streambuf* log = std::cout.rdbuf(nullptr);
+    Service service;
+    service.set_watch_intervals(wait, std::chrono::seconds(3600));
+    service.start_periodic_discovery();
+    std::printf("Consul stand-in at %s, blocking query wait %llds\n", address.c_str(), static_cast<long long>(wait.count()));
+
+    double took = wait_for([&]() { return has_service(service, "alpha") && has_service(service, "beta") && has_service(service, "gamma"); },
+                           std::chrono::seconds(5));
+    check("initial discovery", took >= 0, seconds(took));
+
+    // Idle: every watch is parked in a blocking query
+    auto before = consul.counts();
+    std::this_thread::sleep_for(wait + std::chrono::seconds(1));
+    auto after = consul.counts();
+    uint64_t idle_requests = after.catalog - before.catalog;
+    for (const auto& entry : after.health) {
+        idle_requests += entry.second - before.health[entry.first];
+    }
+    // One catalog and three health queries per wait, give or take one round at the edges
+    check("idle traffic", idle_requests <= 8, std::to_string(idle_requests) + " requests in " + std::to_string(wait.count() + 1) + "s");
+
+    consul.put("delta");
+    took = wait_for([&]() { return has_service(service, "delta"); }, std::chrono::seconds(5));
+    check("new service appears", took >= 0, seconds(took));
+
+    // Only the changed service is fetched again
+    before = consul.counts();
+    consul.put("beta", true, "moved");
+    took = wait_for([&]() {
+        auto counts = consul.counts();
+        return counts.health_changed["beta"] > before.health_changed["beta"];
+    }, std::chrono::seconds(5));
+    after = consul.counts();
+    bool only_beta = after.health_changed["alpha"] == before.health_changed["alpha"] &&
+                     after.health_changed["gamma"] == before.health_changed["gamma"] &&
+                     after.health_changed["delta"] == before.health_changed["delta"];
+    check("health change re-fetches one", took >= 0 && only_beta, seconds(took));
+
+    consul.put("gamma", false);
+    took = wait_for([&]() { return !has_service(service, "gamma"); }, std::chrono::seconds(5));
+    check("failing health removes service", took >= 0, seconds(took));
+
+    consul.remove("delta");
+    took = wait_for([&]() { return !has_service(service, "delta"); }, std::chrono::seconds(5));
+    check("deregistered service removed", took >= 0, seconds(took));
+
+    // Indexes going backwards: the watch starts over instead of waiting on a stale index
+    consul.reset_indexes();
+    consul.put("gamma", true);
+    took = wait_for([&]() { return has_service(service, "gamma"); }, std::chrono::seconds(5));
+    before = consul.counts();
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    after = consul.counts();
+    uint64_t settle = after.catalog - before.catalog;
+    for (const auto& entry : after.health) {
+        settle += entry.second - before.health[entry.first];
+    }
+    check("index reset", took >= 0 && settle <= 4, seconds(took) + ", " + std::to_string(settle) + " requests in the next second");
+
+    // A failing health watch is retried on its own backoff (1s, then 2s), not after the catalog's wait.
+    // The first change answers the query already parked; the two after it fail.
+    consul.fail_health("alpha", 2);
+    consul.put("alpha", true, "moved");
+    wait_for([&]() { return consul.counts().health_changed["alpha"] > after.health_changed["alpha"]; }, std::chrono::seconds(5));
+    before = consul.counts();
+    consul.put("alpha", true);
+    took = wait_for([&]() { return consul.counts().health_changed["alpha"] > before.health_changed["alpha"]; }, wait * 2);
+    check("failed watch re-armed", took >= 2 && took < static_cast<double>(wait.count()), seconds(took) + " after 2 failures");
+
+    service.stop_periodic_discovery();
+    std::cout.rdbuf(log);
+    return failed_checks == 0 ? 0 : 1;
+}
@@ -0,0 +1,121 @@
+// Submit/complete throughput of utils::ThreadPool against the previous
+// single-queue pool, at 1, 4, 16 and 64 producer threads.
+//
+// Build with -DLILY_BUILD_BENCHMARKS=ON and run ./thread_pool_bench [tasks]
+
+#include <lily/utils/ThreadPool.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// The pool as it was before the work-stealing scheduler: one std::queue,
+// one mutex, one condition variable.
+class LegacyThreadPool {
+public:
+    explicit LegacyThreadPool(size_t threads) : stop(false) {
+        for (size_t i = 0; i < threads; ++i)
+            workers.emplace_back([this] {
+                for (;;) {
+                    std::function<void()> task;
+                    {
+                        std::unique_lock<std::mutex> lock(queue_mutex);
+                        condition.wait(lock, [this] { return stop || !tasks.empty(); });
+                        if (stop && tasks.empty()) return;
+                        task = std::move(tasks.front());
+                        tasks.pop();
+                    }
+                    task();
+                }
+            });
+    }
+
+    template<class F>
+    std::future<void> enqueue(F&& f) {
+        auto task = std::make_shared<std::packaged_task<void()>>(std::forward<F>(f));
+        std::future<void> res = task->get_future();
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            tasks.emplace([task]() { (*task)(); });
+        }
+        condition.notify_one();
+        return res;
+    }
+
+    ~LegacyThreadPool() {
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            stop = true;
+        }
+        condition.notify_all();
+        for (auto& worker : workers) worker.join();
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex queue_mutex;
+    std::condition_variable condition;
+    bool stop;
+};
+
+template<typename Pool>
+double run(Pool& pool, size_t producers, size_t total_tasks) {
+    const size_t per_producer = total_tasks / producers;
+    const size_t expected = per_producer * producers;
+    std::atomic<size_t> completed{0};
+    std::atomic<bool> go{false};
+
+    std::vector<std::thread> threads;
+    for (size_t p = 0; p < producers; ++p) {
+        threads.emplace_back([&] {
+            while (!go.load(std::memory_order_acquire)) std::this_thread::yield();
+            for (size_t i = 0; i < per_producer; ++i) {
+                pool.enqueue([&completed] { completed.fetch_add(1, std::memory_order_relaxed); });
+            }
+        });
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    for (auto& t : threads) t.join();
+    while (completed.load(std::memory_order_relaxed) < expected) std::this_thread::yield();
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    return static_cast<double>(expected) / elapsed;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    size_t total_tasks = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+    size_t workers = std::thread::hardware_concurrency();
+    if (workers == 0) workers = 4;
+
+    std::printf("workers=%zu tasks=%zu\n", workers, total_tasks);
+    std::printf("%-10s %18s %18s %8s\n", "producers", "legacy (tasks/s)", "stealing (tasks/s)", "speedup");
+
+    for (size_t producers : {1, 4, 16, 64}) {
+        double legacy, stealing;
+        {
+            LegacyThreadPool pool(workers);
+            legacy = run(pool, producers, total_tasks);
+        }
+        {
+            lily::utils::ThreadPool pool(workers);
+            stealing = run(pool, producers, total_tasks);
+        }
+        std::printf("%-10zu %18.0f %18.0f %7.2fx\n", producers, legacy, stealing, stealing / legacy);
+    }
+    return 0;
+}
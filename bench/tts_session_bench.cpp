@@ -0,0 +1,189 @@
+// Utterances per second through TTSService against a local mock TTS provider.
+//
+// The mock answers every request the way the provider does: a "success"
+// metadata frame followed by binary audio chunks. It then either sends an
+// end-of-utterance frame and keeps the socket open ("persistent"), or closes
+// the socket like older providers do ("close-per-utterance"). The baseline
+// reconnects (readiness probe + handshake) for every utterance, which is what
+// TTSService did before the session; it leaves out the fixed sleeps the old
+// code added on top of that.
+//
+// The pool runs submit every utterance at once, to show how throughput scales
+// with the number of pooled connections.
+//
+// Build with -DLILY_BUILD_BENCHMARKS=ON and run ./tts_session_bench [utterances] [port]
+
+#include <lily/services/TTSService.hpp>
+
+#include <websocketpp/config/asio_no_tls.hpp>
+#include <websocketpp/server.hpp>
+#include <nlohmann/json.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+using lily::services::TTSParameters;
+using lily::services::TTSService;
+
+namespace {
+
+using MockServer = websocketpp::server<websocketpp::config::asio>;
+
+constexpr size_t kChunks = 4;
+constexpr size_t kChunkBytes = 4096;
+
+class MockProvider {
+public:
+    explicit MockProvider(uint16_t port) {
+        _server.clear_access_channels(websocketpp::log::alevel::all);
+        _server.clear_error_channels(websocketpp::log::elevel::all);
+        _server.init_asio();
+        _server.set_reuse_addr(true);
+
+        _server.set_http_handler([this](websocketpp::connection_hdl hdl) {
+            auto con = _server.get_con_from_hdl(hdl);
+            con->set_status(websocketpp::http::status_code::ok);
+            con->set_body("ready");
+        });
+
+        _server.set_message_handler([this](websocketpp::connection_hdl hdl, MockServer::message_ptr msg) {
+            auto request = nlohmann::json::parse(msg->get_payload());
+            nlohmann::json metadata = {{"status", "success"}};
+            if (request.contains("request_id")) {
+                metadata["request_id"] = request["request_id"];
+            }
+            _server.send(hdl, metadata.dump(), websocketpp::frame::opcode::text);
+
+            std::vector<uint8_t> chunk(kChunkBytes, 0x7f);
+            for (size_t i = 0; i < kChunks; ++i) {
+                _server.send(hdl, chunk.data(), chunk.size(), websocketpp::frame::opcode::binary);
+            }
+
+            if (_close_per_utterance) {
+                _server.close(hdl, websocketpp::close::status::normal, "done");
+            } else {
+                nlohmann::json end = {{"type", "end"}};
+                if (request.contains("request_id")) {
+                    end["request_id"] = request["request_id"];
+                }
+                _server.send(hdl, end.dump(), websocketpp::frame::opcode::text);
+            }
+        });
+
+        _server.listen(port);
+        _server.start_accept();
+        _thread = std::thread([this]() { _server.run(); });
+    }
+
+    ~MockProvider() {
+        _server.stop_listening();
+        _server.stop();
+        if (_thread.joinable()) {
+            _thread.join();
+        }
+    }
+
+    void set_close_per_utterance(bool close) { _close_per_utterance = close; }
+
+private:
+    MockServer _server;
+    std::thread _thread;
+    std::atomic<bool> _close_per_utterance{false};
+};
+
+bool expected_audio(const std::vector<uint8_t>& audio) {
+    return audio.size() == kChunks * kChunkBytes;
+}
+
+void report(const char* name, size_t ok, size_t total, std::chrono::steady_clock::duration elapsed) {
+    double seconds = std::chrono::duration<double>(elapsed).count();
+    std::printf("%-34s %6zu/%-6zu ok  %8.1f utterances/s  %7.2f ms/utterance\n",
+                name, ok, total, total / seconds, seconds * 1000.0 / total);
+}
+
+// Sequential utterances on one long-lived session
+void run_session(const char* name, const std::string& provider_url, const std::string& ws_url, size_t utterances,
+                 bool close_ends_utterance) {
+    TTSService tts;
+    tts.set_pool_limits(1, utterances, std::chrono::seconds(30));
+    tts.set_close_ends_utterance(close_ends_utterance);
+    if (!tts.connect(provider_url, ws_url)) {
+        std::printf("%-34s connect failed\n", name);
+        return;
+    }
+    size_t ok = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < utterances; ++i) {
+        ok += expected_audio(tts.synthesize_speech("Sentence number " + std::to_string(i) + ".")) ? 1 : 0;
+    }
+    report(name, ok, utterances, std::chrono::steady_clock::now() - start);
+    tts.close();
+}
+
+// Connect, synthesize, close for every utterance
+void run_reconnect_per_utterance(const std::string& provider_url, const std::string& ws_url, size_t utterances) {
+    size_t ok = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < utterances; ++i) {
+        TTSService tts;
+        tts.set_pool_limits(1, 1, std::chrono::seconds(30));
+        tts.set_close_ends_utterance(true);
+        if (tts.connect(provider_url, ws_url)) {
+            ok += expected_audio(tts.synthesize_speech("Sentence number " + std::to_string(i) + ".")) ? 1 : 0;
+        }
+        tts.close();
+    }
+    report("connect per utterance (baseline)", ok, utterances, std::chrono::steady_clock::now() - start);
+}
+
+// All utterances submitted at once to a pool of sessions
+void run_concurrent(const std::string& provider_url, const std::string& ws_url, size_t utterances, size_t pool_size) {
+    TTSService tts;
+    tts.set_pool_limits(pool_size, utterances, std::chrono::seconds(30));
+    if (!tts.connect(provider_url, ws_url)) {
+        std::printf("pool connect failed\n");
+        return;
+    }
+    auto start = std::chrono::steady_clock::now();
+    std::vector<pplx::task<std::vector<uint8_t>>> tasks;
+    for (size_t i = 0; i < utterances; ++i) {
+        tasks.push_back(tts.synthesize_speech_async("Sentence number " + std::to_string(i) + "."));
+    }
+    size_t ok = 0;
+    for (auto& task : tasks) {
+        ok += expected_audio(task.get()) ? 1 : 0;
+    }
+    std::string name = "pool of " + std::to_string(pool_size) + ", all concurrent";
+    report(name.c_str(), ok, utterances, std::chrono::steady_clock::now() - start);
+    tts.close();
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    size_t utterances = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 200;
+    uint16_t port = static_cast<uint16_t>(argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 19090);
+
+    std::string provider_url = "http://127.0.0.1:" + std::to_string(port);
+    std::string ws_url = "ws://127.0.0.1:" + std::to_string(port) + "/";
+
+    MockProvider provider(port);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100)); // let the listener come up
+
+    std::printf("%zu utterances, %zu x %zu-byte audio chunks each\n", utterances, kChunks, kChunkBytes);
+
+    provider.set_close_per_utterance(true);
+    run_reconnect_per_utterance(provider_url, ws_url, utterances);
+    run_session("session, close-per-utterance", provider_url, ws_url, utterances, true);
+
+    provider.set_close_per_utterance(false);
+    run_session("session, persistent", provider_url, ws_url, utterances, false);
+    run_concurrent(provider_url, ws_url, utterances, 1);
+    run_concurrent(provider_url, ws_url, utterances, 4);
+    return 0;
+}
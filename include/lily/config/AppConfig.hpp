@@ -50,6 +50,35 @@ public:
     std::string gemini_model = "gemini-2.5-flash";
     std::string gemini_system_prompt = "You are Lily, a helpful AI assistant.";
     
+    // Gemini HTTP client pool (persistent keep-alive connections)
+    std::string gemini_base_url = "https://generativelanguage.googleapis.com";
+    size_t gemini_pool_size = 4;
+    uint32_t gemini_timeout_seconds = 30;
+    std::string gemini_ca_file;          // extra PEM bundle to trust (egress proxy, local mock); empty = system roots only
+    
+    // Stream Gemini answers (streamGenerateContent) and forward text deltas to WebSocket clients
+    bool gemini_streaming = true;
+    
+    // Conversation memory: prompt window and retained history, in estimated tokens
+    size_t max_context_tokens = 4000;
+    size_t max_history_tokens = 32000; // per user; oldest turns are evicted beyond it (0 = unbounded)
+    size_t summary_threshold_tokens = 3000; // compact older turns into a summary beyond this (0 = off)
+    size_t summary_keep_recent_tokens = 1000; // newest turns kept verbatim when compacting
+    size_t summary_max_tokens = 800; // longest rolling summary; longer ones are compacted again, then cut
+    std::string memory_data_dir = "/app/data/memory"; // write-ahead log and snapshot; empty keeps memory in-process only
+    uint32_t memory_wal_flush_ms = 50;                   // group commit window (at most this much is lost in a crash)
+    size_t memory_snapshot_wal_bytes = 64 * 1024 * 1024; // log size that triggers a compacted snapshot
+    
+    // Service/tool discovery fan-out
+    size_t discovery_concurrency = 8;
+    uint32_t discovery_timeout_seconds = 5;
+    uint32_t consul_watch_wait_seconds = 55;
+    uint32_t tools_refresh_seconds = 300;
+    
+    // Pooled MCP server clients
+    size_t mcp_max_in_flight = 8;
+    uint32_t mcp_idle_timeout_seconds = 300;
+    
     // Round-robin index for API keys
     size_t _current_key_index = 0;
     
@@ -67,10 +96,20 @@ public:
     // Echo service configuration
     std::string echo_websocket_url;
     bool auto_connect_echo = true;
+    uint32_t echo_packet_ms = 40;                   // microphone audio coalesced per packet to Echo
+    uint32_t echo_jitter_buffer_ms = 400;           // per-user backlog before the oldest frames are dropped
+    size_t echo_audio_bytes_per_second = 32000;     // client audio format (16 kHz mono 16-bit PCM)
     
     // TTS service configuration
     std::string tts_provider_url;
     bool auto_connect_tts = true;
+    size_t tts_pool_size = 2;              // persistent provider connections
+    size_t tts_max_queue = 64;             // requests waiting beyond the ones streaming
+    uint32_t tts_request_timeout_seconds = 30;
+    bool tts_close_ends_utterance = false;                // provider closes the socket instead of sending an end frame
+    size_t tts_cache_max_bytes = 32 * 1024 * 1024;       // in-memory audio cache; 0 disables caching
+    std::string tts_cache_dir;                           // disk tier, e.g. /app/data/tts_cache; empty disables it
+    size_t tts_cache_disk_max_bytes = 256 * 1024 * 1024;
     
     // Builder pattern for easier configuration
     static AppConfig builder() {
@@ -126,13 +165,21 @@ public:
     }
     
     std::string getCurrentGeminiApiKey() {
+        size_t key_index;
+        return getCurrentGeminiApiKey(key_index);
+    }
+    
+    // Same, also telling which entry of the key list it is
+    std::string getCurrentGeminiApiKey(size_t& key_index) {
         std::lock_guard<std::mutex> lock(config_mutex.m);
+        key_index = 0;
         if (gemini_api_keys.empty()) {
             return "";
         }
         // Get current key and advance round-robin index
         size_t index = _current_key_index % gemini_api_keys.size();
         _current_key_index = (index + 1) % gemini_api_keys.size();
+        key_index = index;
         return gemini_api_keys[index];
     }
     
@@ -224,16 +271,156 @@ public:
         return *this;
     }
     
+    AppConfig& withGeminiBaseUrl(const std::string& url) {
+        gemini_base_url = url;
+        return *this;
+    }
+    
+    AppConfig& withGeminiCaFile(const std::string& path) {
+        gemini_ca_file = path;
+        return *this;
+    }
+    
+    AppConfig& withGeminiPoolSize(size_t size) {
+        gemini_pool_size = size;
+        return *this;
+    }
+    
+    AppConfig& withGeminiStreaming(bool enabled) {
+        gemini_streaming = enabled;
+        return *this;
+    }
+    
+    AppConfig& withMaxContextTokens(size_t tokens) {
+        max_context_tokens = tokens;
+        return *this;
+    }
+    
+    AppConfig& withMaxHistoryTokens(size_t tokens) {
+        max_history_tokens = tokens;
+        return *this;
+    }
+    
+    AppConfig& withSummaryThresholdTokens(size_t tokens) {
+        summary_threshold_tokens = tokens;
+        return *this;
+    }
+    
+    AppConfig& withSummaryKeepRecentTokens(size_t tokens) {
+        summary_keep_recent_tokens = tokens;
+        return *this;
+    }
+    
+    AppConfig& withSummaryMaxTokens(size_t tokens) {
+        summary_max_tokens = tokens;
+        return *this;
+    }
+    
+    AppConfig& withMemoryDataDir(const std::string& dir) {
+        memory_data_dir = dir;
+        return *this;
+    }
+    
+    AppConfig& withMemoryWalFlushMs(uint32_t ms) {
+        memory_wal_flush_ms = ms;
+        return *this;
+    }
+    
+    AppConfig& withMemorySnapshotWalBytes(size_t bytes) {
+        memory_snapshot_wal_bytes = bytes;
+        return *this;
+    }
+    
+    AppConfig& withDiscoveryConcurrency(size_t concurrency) {
+        discovery_concurrency = concurrency;
+        return *this;
+    }
+    
+    AppConfig& withDiscoveryTimeoutSeconds(uint32_t seconds) {
+        discovery_timeout_seconds = seconds;
+        return *this;
+    }
+    
+    AppConfig& withConsulWatchWaitSeconds(uint32_t seconds) {
+        consul_watch_wait_seconds = seconds;
+        return *this;
+    }
+    
+    AppConfig& withToolsRefreshSeconds(uint32_t seconds) {
+        tools_refresh_seconds = seconds;
+        return *this;
+    }
+    
+    AppConfig& withMcpMaxInFlight(size_t max_in_flight) {
+        mcp_max_in_flight = max_in_flight;
+        return *this;
+    }
+    
+    AppConfig& withMcpIdleTimeoutSeconds(uint32_t seconds) {
+        mcp_idle_timeout_seconds = seconds;
+        return *this;
+    }
+    
     AppConfig& withEchoWebSocketUrl(const std::string& url) {
         echo_websocket_url = url;
         return *this;
     }
     
+    AppConfig& withEchoPacketMs(uint32_t ms) {
+        echo_packet_ms = ms;
+        return *this;
+    }
+    
+    AppConfig& withEchoJitterBufferMs(uint32_t ms) {
+        echo_jitter_buffer_ms = ms;
+        return *this;
+    }
+    
+    AppConfig& withEchoAudioBytesPerSecond(size_t bytes) {
+        echo_audio_bytes_per_second = bytes;
+        return *this;
+    }
+    
     AppConfig& withTtsProviderUrl(const std::string& url) {
         tts_provider_url = url;
         return *this;
     }
     
+    AppConfig& withTtsPoolSize(size_t size) {
+        tts_pool_size = size;
+        return *this;
+    }
+    
+    AppConfig& withTtsMaxQueue(size_t max_queue) {
+        tts_max_queue = max_queue;
+        return *this;
+    }
+    
+    AppConfig& withTtsRequestTimeoutSeconds(uint32_t seconds) {
+        tts_request_timeout_seconds = seconds;
+        return *this;
+    }
+    
+    AppConfig& withTtsCloseEndsUtterance(bool enabled) {
+        tts_close_ends_utterance = enabled;
+        return *this;
+    }
+    
+    AppConfig& withTtsCacheMaxBytes(size_t bytes) {
+        tts_cache_max_bytes = bytes;
+        return *this;
+    }
+    
+    AppConfig& withTtsCacheDir(const std::string& dir) {
+        tts_cache_dir = dir;
+        return *this;
+    }
+    
+    AppConfig& withTtsCacheDiskMaxBytes(size_t bytes) {
+        tts_cache_disk_max_bytes = bytes;
+        return *this;
+    }
+    
     /**
      * @brief Load configuration from environment variables
      * 
@@ -283,13 +470,131 @@ public:
             gemini_enabled = !gemini_api_keys.empty();
         }
         
+        if ((env_value = getenv("GEMINI_BASE_URL")) != nullptr) {
+            gemini_base_url = env_value;
+        }
+        
+        if ((env_value = getenv("GEMINI_CA_FILE")) != nullptr) {
+            gemini_ca_file = env_value;
+        }
+        
+        if ((env_value = getenv("GEMINI_POOL_SIZE")) != nullptr) {
+            gemini_pool_size = static_cast<size_t>(std::stoul(env_value));
+        }
+        
+        if ((env_value = getenv("MAX_CONTEXT_TOKENS")) != nullptr) {
+            max_context_tokens = static_cast<size_t>(std::stoul(env_value));
+        }
+        
+        if ((env_value = getenv("MAX_HISTORY_TOKENS")) != nullptr) {
+            max_history_tokens = static_cast<size_t>(std::stoul(env_value));
+        }
+        
+        if ((env_value = getenv("SUMMARY_THRESHOLD_TOKENS")) != nullptr) {
+            summary_threshold_tokens = static_cast<size_t>(std::stoul(env_value));
+        }
+        
+        if ((env_value = getenv("SUMMARY_KEEP_RECENT_TOKENS")) != nullptr) {
+            summary_keep_recent_tokens = static_cast<size_t>(std::stoul(env_value));
+        }
+        
+        if ((env_value = getenv("SUMMARY_MAX_TOKENS")) != nullptr) {
+            summary_max_tokens = static_cast<size_t>(std::stoul(env_value));
+        }
+        
+        if ((env_value = getenv("MEMORY_DATA_DIR")) != nullptr) {
+            memory_data_dir = env_value;
+        }
+        
+        if ((env_value = getenv("MEMORY_WAL_FLUSH_MS")) != nullptr) {
+            memory_wal_flush_ms = static_cast<uint32_t>(std::stoul(env_value));
+        }
+        
+        if ((env_value = getenv("MEMORY_SNAPSHOT_WAL_BYTES")) != nullptr) {
+            memory_snapshot_wal_bytes = static_cast<size_t>(std::stoull(env_value));
+        }
+        
+        if ((env_value = getenv("GEMINI_TIMEOUT_SECONDS")) != nullptr) {
+            gemini_timeout_seconds = static_cast<uint32_t>(std::stoul(env_value));
+        }
+        
+        if ((env_value = getenv("GEMINI_STREAMING")) != nullptr) {
+            std::string value = env_value;
+            gemini_streaming = !(value == "0" || value == "false" || value == "off");
+        }
+        
+        if ((env_value = getenv("DISCOVERY_CONCURRENCY")) != nullptr) {
+            discovery_concurrency = static_cast<size_t>(std::stoul(env_value));
+        }
+        
+        if ((env_value = getenv("DISCOVERY_TIMEOUT_SECONDS")) != nullptr) {
+            discovery_timeout_seconds = static_cast<uint32_t>(std::stoul(env_value));
+        }
+        
+        if ((env_value = getenv("CONSUL_WATCH_WAIT_SECONDS")) != nullptr) {
+            consul_watch_wait_seconds = static_cast<uint32_t>(std::stoul(env_value));
+        }
+        
+        if ((env_value = getenv("TOOLS_REFRESH_SECONDS")) != nullptr) {
+            tools_refresh_seconds = static_cast<uint32_t>(std::stoul(env_value));
+        }
+        
+        if ((env_value = getenv("MCP_MAX_IN_FLIGHT")) != nullptr) {
+            mcp_max_in_flight = static_cast<size_t>(std::stoul(env_value));
+        }
+        
+        if ((env_value = getenv("MCP_IDLE_TIMEOUT_SECONDS")) != nullptr) {
+            mcp_idle_timeout_seconds = static_cast<uint32_t>(std::stoul(env_value));
+        }
+        
         if ((env_value = getenv("ECHO_WS_URL")) != nullptr) {
             echo_websocket_url = env_value;
         }
         
+        if ((env_value = getenv("ECHO_PACKET_MS")) != nullptr) {
+            echo_packet_ms = static_cast<uint32_t>(std::stoul(env_value));
+        }
+        
+        if ((env_value = getenv("ECHO_JITTER_BUFFER_MS")) != nullptr) {
+            echo_jitter_buffer_ms = static_cast<uint32_t>(std::stoul(env_value));
+        }
+        
+        if ((env_value = getenv("ECHO_AUDIO_BYTES_PER_SECOND")) != nullptr) {
+            echo_audio_bytes_per_second = static_cast<size_t>(std::stoul(env_value));
+        }
+        
         if ((env_value = getenv("TTS_PROVIDER_URL")) != nullptr) {
             tts_provider_url = env_value;
         }
+        
+        if ((env_value = getenv("TTS_POOL_SIZE")) != nullptr) {
+            tts_pool_size = static_cast<size_t>(std::stoul(env_value));
+        }
+        
+        if ((env_value = getenv("TTS_MAX_QUEUE")) != nullptr) {
+            tts_max_queue = static_cast<size_t>(std::stoul(env_value));
+        }
+        
+        if ((env_value = getenv("TTS_REQUEST_TIMEOUT_SECONDS")) != nullptr) {
+            tts_request_timeout_seconds = static_cast<uint32_t>(std::stoul(env_value));
+        }
+        
+        if ((env_value = getenv("TTS_CLOSE_ENDS_UTTERANCE")) != nullptr) {
+            std::string value = env_value;
+            tts_close_ends_utterance = value == "1" || value == "true" || value == "on";
+        }
+        
+        if ((env_value = getenv("TTS_CACHE_MAX_BYTES")) != nullptr) {
+            tts_cache_max_bytes = static_cast<size_t>(std::stoull(env_value));
+        }
+        
+        if ((env_value = getenv("TTS_CACHE_DIR")) != nullptr) {
+            tts_cache_dir = env_value;
+        }
+        
+        if ((env_value = getenv("TTS_CACHE_DISK_MAX_BYTES")) != nullptr) {
+            tts_cache_disk_max_bytes = static_cast<size_t>(std::stoull(env_value));
+        }
     }
 
     void loadFromFile() {
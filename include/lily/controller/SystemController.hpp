@@ -12,6 +12,10 @@ namespace lily {
     namespace services {
         class Service;
         class AgentLoopService;
+        class GeminiClient;
+        class TTSService;
+        class EchoService;
+        class MemoryService;
     }
 }
 
@@ -22,6 +26,10 @@ namespace controller {
     public:
         SystemController(config::AppConfig& config, services::Service& toolService);
         void setAgentLoopService(services::AgentLoopService* agentLoopService);
+        void setGeminiClient(services::GeminiClient* geminiClient);
+        void setTTSService(services::TTSService* ttsService);
+        void setEchoService(services::EchoService* echoService);
+        void setMemoryService(services::MemoryService* memoryService);
 
         nlohmann::json getHealth();
         nlohmann::json getConfig();
@@ -38,6 +46,10 @@ namespace controller {
         config::AppConfig* _config;
         services::Service* _toolService;
         services::AgentLoopService* _agentLoopService;
+        services::GeminiClient* _geminiClient;
+        services::TTSService* _ttsService;
+        services::EchoService* _echoService;
+        services::MemoryService* _memoryService;
     };
 
 }
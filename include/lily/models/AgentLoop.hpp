@@ -35,6 +35,7 @@ namespace lily {
             std::chrono::system_clock::time_point end_time;
             bool completed;
             double duration_seconds;
+            double time_to_first_token_seconds; // -1 when nothing was streamed
         };
 
     }
@@ -3,19 +3,38 @@
 
 #include <lily/services/MemoryService.hpp>
 #include <lily/services/Service.hpp>
+#include <lily/services/GeminiClient.hpp>
+#include <lily/services/GeminiRequestBuilder.hpp>
 #include <lily/models/AgentLoop.hpp>
 #include <lily/config/AppConfig.hpp>
+#include <pplx/pplxtasks.h>
 #include <string>
 #include <vector>
 #include <map>
 #include <memory>
+#include <functional>
 
 namespace lily {
     namespace services {
         class AgentLoopService {
         public:
-            AgentLoopService(MemoryService& memoryService, Service& toolService, config::AppConfig& config);
+            AgentLoopService(MemoryService& memoryService, Service& toolService, GeminiClient& geminiClient, config::AppConfig& config);
+
+            // Blocking wrapper around run_loop_async()
             std::string run_loop(const std::string& user_message, const std::string& user_id);
+
+            // Text delta of the answer being streamed, with the step it belongs to
+            using DeltaCallback = std::function<void(const std::string& text, int step)>;
+
+            // Non-blocking: every step is chained as a continuation, so no thread is held
+            // while waiting on Gemini or on a tool server. With on_delta (and streaming
+            // enabled) Gemini's text is forwarded as it is generated.
+            pplx::task<std::string> run_loop_async(const std::string& user_message, const std::string& user_id, DeltaCallback on_delta = nullptr);
+
+            // Folds turns into previous_summary with a tool-less Gemini call and returns the new
+            // summary, asked to stay within max_tokens (empty on failure). With no turns it only
+            // shortens previous_summary. Blocking; meant for MemoryService's summarizer thread.
+            std::string summarize_turns(const std::string& previous_summary, const std::vector<Message>& turns, size_t max_tokens);
             
             // Per-user agent loop tracking
             std::vector<std::string> get_user_ids() const;
@@ -32,19 +51,22 @@ namespace lily {
         private:
             MemoryService& _memoryService;
             Service& _toolService;
+            GeminiClient& _geminiClient;
             config::AppConfig& _config;
             
             // Per-user agent loop tracking
             std::map<std::string, std::vector<lily::models::AgentLoop>> _agentLoopsPerUser;
             mutable std::mutex _agentLoopsMutex;
             
+            // State of one in-flight loop, carried from continuation to continuation
+            struct LoopState;
+
             // Helper methods for the step-based loop
-            std::string process_with_tools(const std::string& user_message, const std::string& user_id, lily::models::AgentLoop& current_loop);
-            std::string execute_agent_step(const std::vector<nlohmann::json>& available_tools, 
-                                         nlohmann::json& conversation_history,
-                                         lily::models::AgentLoop& current_loop,
-                                         int step_number);
-            nlohmann::json call_gemini_with_tools(const nlohmann::json& contents, const std::vector<nlohmann::json>& tools);
+            std::shared_ptr<LoopState> begin_loop(const std::string& user_message, const std::string& user_id, DeltaCallback on_delta);
+            void finish_loop(LoopState& state, const std::string& response);
+            pplx::task<std::string> run_steps_async(std::shared_ptr<LoopState> state);
+            pplx::task<std::string> execute_agent_step_async(std::shared_ptr<LoopState> state);
+            pplx::task<nlohmann::json> call_gemini_with_tools_async(std::shared_ptr<LoopState> state);
         };
     }
 }
@@ -8,6 +8,7 @@
 #include <lily/services/EchoService.hpp>
 #include <lily/services/GatewayService.hpp>
 #include <lily/services/SessionService.hpp>
+#include <lily/services/SpeechPipeline.hpp>
 #include <lily/utils/ThreadPool.hpp>
 #include <string>
 #include <vector>
@@ -19,6 +20,8 @@ namespace lily {
         struct ChatParameters {
             bool enable_tts = false;
             TTSParameters tts_params;
+            // Forward text deltas to the user's WebSocket connection as {"type":"delta"} frames
+            bool stream_deltas = true;
         };
         
         struct ChatResponse {
@@ -49,9 +52,17 @@ namespace lily {
             using AudioCompletionCallback = std::function<void(ChatResponse)>;
             void handle_chat_message_with_audio_async(const std::string& message, const std::string& user_id, const ChatParameters& params, AudioCompletionCallback callback);
 
-            void handle_audio_stream(const std::vector<uint8_t>& audio_data, const std::string& user_id);
+            void handle_audio_stream(const utils::SharedBytes& frame, const std::string& user_id);
+
+            // Echo transcript for one user: shown to that user only; a final one runs their agent loop
+            void handle_transcription(const nlohmann::json& message, const std::string& client_id);
 
         private:
+            void begin_chat(const std::string& message, const std::string& user_id);
+            ChatResponse complete_chat(const std::string& agent_response, const std::string& user_id);
+            std::shared_ptr<SpeechPipeline> start_speech(const std::string& user_id, const ChatParameters& params);
+            AgentLoopService::DeltaCallback delta_handler(const std::string& user_id, const ChatParameters& params, std::shared_ptr<SpeechPipeline> speech);
+
             AgentLoopService& _agentLoopService;
             MemoryService& _memoryService;
             Service& _toolService;
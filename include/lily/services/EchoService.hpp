@@ -8,25 +8,72 @@
 #include <functional>
 #include <thread>
 #include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <chrono>
 #include <cpprest/ws_client.h>
+#include <nlohmann/json.hpp>
+#include <lily/utils/SharedBuffer.hpp>
 
 namespace lily {
     namespace services {
         
-        using TranscriptionHandler = std::function<void(const std::string&)>;
+        // Transcript message ({"type": "interim"|"final", "text": ...}) and the user it belongs to
+        using TranscriptionHandler = std::function<void(const nlohmann::json& message, const std::string& client_id)>;
 
+        /**
+         * @brief Client for the Echo transcription service.
+         *
+         * Microphone frames go through a per-user uplink: small frames are
+         * coalesced into packets of packet_ms of audio and each user has at most
+         * one packet in flight, so send_audio() never waits on the network. A
+         * partial packet is flushed once its oldest frame is packet_ms old. Each
+         * user's queue holds at most buffer_ms of audio; when Echo falls behind,
+         * the oldest frames are dropped to keep latency bounded.
+         *
+         * All users share one socket to Echo. Before a packet from a different
+         * user than the previous one, a {"type": "stream", "client_id": ...}
+         * text frame selects that user's stream. Transcripts are attributed by
+         * their client_id, or to the selected stream when Echo omits it.
+         */
         class EchoService {
         public:
             EchoService();
             ~EchoService();
 
+            // Applies to frames queued from now on. bytes_per_second describes the client audio
+            // format (32000 for 16 kHz mono 16-bit PCM).
+            void set_uplink_limits(std::chrono::milliseconds packet, std::chrono::milliseconds buffer, size_t bytes_per_second);
+
             bool connect(const std::string& provider_url);
-            void send_audio(const std::vector<uint8_t>& audio_data);
+            // Queues the frame on the user's uplink and returns
+            void send_audio(const std::string& user_id, const utils::SharedBytes& frame);
             void set_transcription_handler(const TranscriptionHandler& handler);
             void close();
             bool is_connected() const { return _is_connected; }
 
+            nlohmann::json get_metrics() const;
+
         private:
+            struct Frame {
+                utils::SharedBytes bytes;
+                std::chrono::steady_clock::time_point arrived;
+            };
+            struct Uplink {
+                std::deque<Frame> frames;
+                size_t queued_bytes = 0;
+                bool in_flight = false;
+                std::chrono::steady_clock::time_point last_activity;
+            };
+
+            void pump(const std::string& user_id, bool flush_partial);
+            void on_packet_sent(const std::string& user_id, bool ok);
+            void send_packet(const std::string& user_id, const utils::SharedBytes& payload,
+                             std::shared_ptr<std::vector<uint8_t>> packet);
+            void flush_loop();
+
             std::atomic<bool> _is_connected;
             std::string _provider_url;
             std::unique_ptr<web::websockets::client::websocket_client> _websocket_client;
@@ -35,6 +82,26 @@ namespace lily {
             
             void on_message(web::websockets::client::websocket_incoming_message msg);
             void receive_loop();
+
+            mutable std::mutex _uplink_mutex;
+            std::condition_variable _uplink_wake;
+            std::map<std::string, Uplink> _uplinks;
+            std::vector<std::shared_ptr<std::vector<uint8_t>>> _spare_packets; // reused packet buffers
+            std::chrono::milliseconds _packet_duration;
+            std::chrono::milliseconds _buffer_duration;
+            size_t _bytes_per_second;
+            std::thread _flush_thread;
+            bool _flushing = false;
+
+            std::mutex _socket_mutex;        // keeps a stream selection and its packet adjacent on the socket
+            std::string _stream_client_id;   // user whose stream is selected on the socket
+
+            std::atomic<uint64_t> _frames_received{0};
+            std::atomic<uint64_t> _packets_sent{0};
+            std::atomic<uint64_t> _bytes_sent{0};
+            std::atomic<uint64_t> _frames_dropped{0};
+            std::atomic<uint64_t> _bytes_dropped{0};
+            std::atomic<uint64_t> _send_errors{0};
         };
     }
 }
@@ -14,6 +14,7 @@
 #include <atomic>
 #include <mutex>
 #include <nlohmann/json.hpp>
+#include <lily/utils/SharedBuffer.hpp>
 
 #include "lily/controller/ChatController.hpp"
 #include "lily/controller/SystemController.hpp"
@@ -40,7 +41,8 @@ namespace lily {
         using Server = websocketpp::server<websocketpp::config::asio>;
         using ConnectionHandle = websocketpp::connection_hdl;
         using MessageHandler = std::function<void(const std::string&)>;
-        using BinaryMessageHandler = std::function<void(const std::vector<uint8_t>&, const std::string&)>;
+        // The frame shares the received message's payload; keep a copy of the view to hold on to it
+        using BinaryMessageHandler = std::function<void(const utils::SharedBytes&, const std::string&)>;
 
         // Echo service WebSocket client
         using EchoClient = websocketpp::client<websocketpp::config::asio>;
@@ -61,6 +63,8 @@ namespace lily {
             void broadcast_binary(const std::vector<uint8_t>& data);
             void send_binary_to_client(const ConnectionHandle& conn, const std::vector<uint8_t>& data);
             void send_binary_to_client_by_id(const std::string& client_id, const std::vector<uint8_t>& data);
+            // Sends the shared bytes in place; the caller may keep or hand out the same buffer
+            void send_binary_to_client_by_id(const std::string& client_id, const utils::SharedBuffer& data);
             void send_text_to_client_by_id(const std::string& client_id, const std::string& message);
             bool is_connection_registered(const std::string& client_id);
             bool wait_for_connection_registration(const std::string& client_id, int timeout_seconds = 5);
@@ -0,0 +1,91 @@
+#ifndef LILY_SERVICES_GEMINI_CLIENT_HPP
+#define LILY_SERVICES_GEMINI_CLIENT_HPP
+
+#include <lily/config/AppConfig.hpp>
+#include <cpprest/http_client.h>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <functional>
+
+namespace lily {
+    namespace services {
+
+        /**
+         * @brief Shared client for the Gemini generateContent API.
+         *
+         * Owns a fixed pool of long-lived http_client instances (each keeps its own
+         * keep-alive connections) that every agent loop reuses, instead of paying a
+         * TCP + TLS handshake per LLM call. Requests rotate through the configured
+         * API keys on 429s and errors, and per-key request/latency metrics are kept
+         * for /api/monitoring.
+         */
+        class GeminiClient {
+        public:
+            explicit GeminiClient(config::AppConfig& config);
+
+            // POST /v1beta/models/<model>:generateContent with an already serialized JSON body,
+            // retrying on the next key on failure. Resolves to an empty object when every key failed.
+            pplx::task<nlohmann::json> generate_content(std::shared_ptr<const std::string> body);
+
+            // Text of each partial candidate, as it arrives
+            using DeltaCallback = std::function<void(const std::string&)>;
+
+            // POST .../<model>:streamGenerateContent?alt=sse. on_delta is called for every text delta
+            // while the response streams in; the result is the whole response folded into the
+            // generateContent shape. A key is only retried while nothing has been streamed yet; a stream
+            // that breaks off after that fails the task rather than passing for a complete answer.
+            pplx::task<nlohmann::json> stream_generate_content(std::shared_ptr<const std::string> body, DeltaCallback on_delta);
+
+            nlohmann::json get_metrics() const;
+            size_t pool_size() const { return _clients.size(); }
+
+        private:
+            struct KeyMetrics {
+                std::string label; // masked key, for display only
+                uint64_t requests = 0;
+                uint64_t successes = 0;
+                uint64_t rate_limited = 0;
+                uint64_t errors = 0;
+                uint64_t in_flight = 0;
+                std::vector<double> recent_latency_ms; // ring of the last kLatencyWindow samples
+                size_t latency_cursor = 0;
+                std::vector<double> recent_ttft_ms; // time to first streamed token, same ring size
+                size_t ttft_cursor = 0;
+            };
+
+            static constexpr size_t kLatencyWindow = 256;
+
+            config::AppConfig& _config;
+            std::string _base_url;
+            std::vector<std::shared_ptr<web::http::client::http_client>> _clients;
+            std::atomic<size_t> _next_client;
+
+            mutable std::mutex _metrics_mutex;
+            std::map<size_t, KeyMetrics> _key_metrics; // keyed by position in the configured key list
+
+            std::shared_ptr<web::http::client::http_client> next_client();
+            pplx::task<nlohmann::json> attempt(std::shared_ptr<const std::string> body,
+                                               std::string model,
+                                               size_t retry,
+                                               size_t max_retries,
+                                               DeltaCallback on_delta);
+
+            // Reads one SSE response body to the end
+            struct StreamState;
+            pplx::task<void> read_stream(std::shared_ptr<StreamState> state);
+
+            static std::string mask_key(const std::string& api_key);
+            void record_start(size_t key_index, const std::string& key_label);
+            void record_finish(size_t key_index, int status, std::chrono::steady_clock::time_point start);
+            void record_first_token(size_t key_index, std::chrono::steady_clock::time_point start);
+        };
+    }
+}
+
+#endif // LILY_SERVICES_GEMINI_CLIENT_HPP
@@ -0,0 +1,43 @@
+#ifndef LILY_SERVICES_GEMINI_REQUEST_BUILDER_HPP
+#define LILY_SERVICES_GEMINI_REQUEST_BUILDER_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <nlohmann/json.hpp>
+
+namespace lily {
+    namespace services {
+
+        /**
+         * @brief Incrementally built generateContent request body.
+         *
+         * Each turn is serialized exactly once when it is appended, so a loop whose
+         * history grows step by step never re-serializes (or re-parses) earlier
+         * turns. The tool declarations are kept as an already rendered JSON
+         * fragment and spliced in as bytes.
+         */
+        class GeminiRequestBuilder {
+        public:
+            void append_turn(const nlohmann::json& turn);
+            void append_turn(const std::string& role, const nlohmann::json& parts);
+
+            // Rendered JSON array for the "tools" field (shared, never copied), or null/empty for none
+            void set_tools_fragment(std::shared_ptr<const std::string> tools_fragment);
+
+            std::string build_body() const;
+            size_t turn_count() const { return _turn_count; }
+
+            // Gemini functionDeclarations for a list of MCP tool descriptors, rendered as a JSON array
+            static std::string render_tools(const std::vector<nlohmann::json>& mcp_tools);
+            static nlohmann::json convert_mcp_tool(const nlohmann::json& mcp_tool);
+
+        private:
+            std::string _contents; // serialized turns, comma separated
+            size_t _turn_count = 0;
+            std::shared_ptr<const std::string> _tools_fragment;
+        };
+    }
+}
+
+#endif // LILY_SERVICES_GEMINI_REQUEST_BUILDER_HPP
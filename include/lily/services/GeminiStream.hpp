@@ -0,0 +1,54 @@
+#ifndef LILY_SERVICES_GEMINI_STREAM_HPP
+#define LILY_SERVICES_GEMINI_STREAM_HPP
+
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+namespace lily {
+    namespace services {
+
+        /**
+         * @brief Incremental parser for a text/event-stream body.
+         *
+         * Bytes can be fed in arbitrary chunks; every complete event's data
+         * (its "data:" lines joined with newlines) is returned once the blank
+         * line ending it has arrived.
+         */
+        class SseParser {
+        public:
+            std::vector<std::string> feed(const char* data, size_t size);
+            std::vector<std::string> feed(const std::string& chunk) { return feed(chunk.data(), chunk.size()); }
+
+        private:
+            std::string _line;       // partial line carried over between chunks
+            std::string _event_data; // data lines of the event being read
+            bool _has_data = false;
+        };
+
+        /**
+         * @brief Folds streamGenerateContent chunks into one generateContent-shaped response.
+         *
+         * Consecutive text parts are concatenated, function calls are kept whole,
+         * and the last finishReason/usageMetadata win, so the agent loop can treat
+         * the result exactly like a non-streaming response.
+         */
+        class GeminiStreamAccumulator {
+        public:
+            // Returns the text delta carried by this chunk (empty when there is none)
+            std::string add_chunk(const nlohmann::json& chunk);
+
+            nlohmann::json result() const;
+            bool empty() const { return _chunks == 0; }
+
+        private:
+            nlohmann::json _parts = nlohmann::json::array();
+            std::string _role = "model";
+            nlohmann::json _finish_reason;
+            nlohmann::json _usage;
+            size_t _chunks = 0;
+        };
+    }
+}
+
+#endif // LILY_SERVICES_GEMINI_STREAM_HPP
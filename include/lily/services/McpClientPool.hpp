@@ -0,0 +1,75 @@
+#ifndef LILY_SERVICES_MCP_CLIENT_POOL_HPP
+#define LILY_SERVICES_MCP_CLIENT_POOL_HPP
+
+#include <lily/utils/AsyncSemaphore.hpp>
+#include <cpprest/http_client.h>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <chrono>
+
+namespace lily {
+    namespace services {
+
+        /**
+         * @brief Long-lived http_client per MCP server.
+         *
+         * tools/list and tools/call reuse the same keep-alive connections instead
+         * of building a client (and paying connection setup) per request. Each
+         * server has a bounded number of requests in flight; callers beyond that
+         * queue as continuations. Servers unused for the idle timeout are dropped.
+         */
+        class McpClientPool {
+        public:
+            McpClientPool(size_t max_in_flight_per_server = 8, std::chrono::seconds idle_timeout = std::chrono::seconds(300));
+
+            // Applies to servers first contacted after the call
+            void set_limits(size_t max_in_flight_per_server, std::chrono::seconds idle_timeout);
+
+            // POST a JSON-RPC body to the server on its pooled client. Clients are kept per
+            // (server, timeout), so discovery and tool calls can use different deadlines.
+            pplx::task<web::http::http_response> post(const std::string& server_url,
+                                                      const web::json::value& body,
+                                                      std::chrono::seconds timeout);
+
+            void evict(const std::string& server_url);
+            size_t evict_idle();
+
+            // Per-server requests, errors, in-flight count and latency histogram
+            nlohmann::json get_server_metrics(const std::string& server_url) const;
+            nlohmann::json get_metrics() const;
+
+        private:
+            // Upper bounds (ms) of the latency histogram buckets; one overflow bucket follows
+            static const std::vector<double>& latency_buckets_ms();
+
+            struct Server {
+                std::mutex mutex;
+                std::map<long, std::shared_ptr<web::http::client::http_client>> clients; // by timeout in seconds
+                std::shared_ptr<utils::AsyncSemaphore> slots;
+                size_t max_in_flight = 0;
+                std::atomic<size_t> in_flight{0};
+                std::atomic<uint64_t> requests{0};
+                std::atomic<uint64_t> errors{0};
+                std::chrono::steady_clock::time_point last_used;
+                std::vector<uint64_t> latency_counts; // one per bucket + overflow
+                double latency_sum_ms = 0;
+            };
+
+            std::shared_ptr<Server> server_for(const std::string& server_url);
+            static void record(Server& server, double latency_ms, bool ok);
+            static nlohmann::json server_metrics(Server& server);
+
+            mutable std::mutex _mutex;
+            std::map<std::string, std::shared_ptr<Server>> _servers;
+            size_t _max_in_flight;
+            std::chrono::seconds _idle_timeout;
+        };
+    }
+}
+
+#endif // LILY_SERVICES_MCP_CLIENT_POOL_HPP
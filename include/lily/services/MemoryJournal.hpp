@@ -0,0 +1,203 @@
+#ifndef LILY_SERVICES_MEMORY_JOURNAL_HPP
+#define LILY_SERVICES_MEMORY_JOURNAL_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <nlohmann/json.hpp>
+
+namespace lily {
+    namespace services {
+        /**
+         * @brief Files behind MemoryService's durability: an append-only
+         * write-ahead log and a compacted snapshot, in one directory such as
+         * /app/data/memory.
+         *
+         * append() only copies the record into a pending buffer (fixed-size
+         * chunks, so a backlog never reallocates), so the request path never
+         * touches the disk. A flush thread checksums everything pending and
+         * writes it with one fdatasync() per flush interval (group commit); a
+         * crash loses at most that interval. The log is split into numbered
+         * generations (wal-<n>.log). The snapshot a commit replaces is kept as
+         * snapshot.prev.bin together with the generations since it, so a damaged
+         * snapshot can still be recovered from; older generations are deleted.
+         *
+         * Records are framed as [length][crc32][payload]; replay stops at the
+         * first torn or corrupt frame. The journal does not interpret payloads.
+         */
+        class MemoryJournal {
+        public:
+            // Read-only mapping of a whole file
+            class Mapping {
+            public:
+                Mapping(const char* data, size_t size) : _data(data), _size(size) {}
+                ~Mapping();
+                Mapping(const Mapping&) = delete;
+                Mapping& operator=(const Mapping&) = delete;
+
+                const char* data() const { return _data; }
+                size_t size() const { return _size; }
+
+            private:
+                const char* _data;
+                size_t _size;
+            };
+
+            // Runs on the flush thread once the log has grown past snapshot_wal_bytes; returns whether
+            // a snapshot was committed. Failed attempts are retried with a growing delay.
+            using CompactionHandler = std::function<bool()>;
+
+            MemoryJournal(const std::string& directory, std::chrono::milliseconds flush_interval, size_t snapshot_wal_bytes);
+            ~MemoryJournal();
+
+            MemoryJournal(const MemoryJournal&) = delete;
+            MemoryJournal& operator=(const MemoryJournal&) = delete;
+
+            // False when the directory could not be created; nothing is persisted then
+            bool enabled() const { return _enabled; }
+
+            // Recovery, before start(): the snapshot and the one it replaced (null if none), and the log
+            // generations on disk, oldest first
+            std::unique_ptr<Mapping> map_snapshot() const;
+            std::unique_ptr<Mapping> map_previous_snapshot() const;
+            // Renames a damaged snapshot to snapshot.damaged.bin once recovery has used the previous one
+            void set_aside_snapshot();
+            std::vector<uint64_t> generations() const;
+            // Calls visit for every intact record of a generation; returns the number of records
+            size_t replay(uint64_t generation, const std::function<void(const char* payload, size_t size)>& visit) const;
+
+            // Appends go to a fresh generation after the newest one on disk. snapshot_generation is the
+            // generation of the snapshot recovery loaded (0 if none); the next commit keeps that snapshot
+            // and the log since it as the previous one.
+            void start(CompactionHandler on_compact, uint64_t snapshot_generation);
+            // Writes out whatever is pending and joins the flush thread
+            void stop();
+
+            // Cheap: copies the record into memory; the flush thread makes it durable
+            void append(const std::string& payload);
+
+            // Compaction, on the flush thread: begin_snapshot() opens the snapshot file, rotate() starts a
+            // new generation and returns its number (0 on failure); a snapshot committed with that number
+            // replaces every older generation
+            bool begin_snapshot();
+            uint64_t rotate();
+            bool write_snapshot(const std::string& bytes);
+            bool commit_snapshot(const std::string& header, uint64_t generation);
+            void abort_snapshot();
+
+            nlohmann::json get_metrics() const;
+
+        private:
+            std::string wal_path(uint64_t generation) const;
+            std::string snapshot_path() const;
+            std::string previous_snapshot_path() const;
+            bool open_generation(uint64_t generation);
+            void flush_loop();
+            void write_batch(std::vector<std::string>& chunks, size_t records);
+            void recycle(std::vector<std::string>& chunks);
+
+            std::string _directory;
+            std::chrono::milliseconds _flush_interval;
+            size_t _snapshot_wal_bytes;
+            bool _enabled = false;
+
+            // Request path
+            std::mutex _mutex;
+            std::condition_variable _wake;
+            std::vector<std::string> _pending; // framed records, in chunks of up to kChunkBytes
+            std::vector<std::string> _spare;   // emptied chunks, capacity kept
+            size_t _pending_bytes = 0;
+            size_t _pending_records = 0;
+            bool _running = false;
+
+            // Flush thread only
+            std::thread _flush_thread;
+            CompactionHandler _on_compact;
+            int _wal_fd = -1;
+            uint64_t _wal_size = 0;   // bytes of the open generation known to be durable
+            bool _wal_torn = false;   // a failed batch could not be cut off the open generation
+            std::atomic<uint64_t> _generation{0};
+            int _snapshot_fd = -1;
+            uint64_t _snapshot_generation = 0; // generation of the current snapshot; the log from it on is kept
+            std::atomic<size_t> _wal_bytes_since_snapshot{0};
+
+            std::atomic<uint64_t> _records{0};
+            std::atomic<uint64_t> _bytes{0};
+            std::atomic<uint64_t> _flushes{0};
+            std::atomic<uint64_t> _flush_errors{0};
+            std::atomic<uint64_t> _fsync_micros{0};
+            std::atomic<uint64_t> _max_batch_records{0};
+            std::atomic<uint64_t> _snapshots{0};
+            std::atomic<uint64_t> _snapshot_errors{0};
+            std::atomic<uint64_t> _last_snapshot_bytes{0};
+        };
+
+        // Little helpers for the journal's binary records (host byte order)
+        namespace journal {
+            template<typename T>
+            inline void put(std::string& out, T value) {
+                out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+            }
+
+            inline void put_bytes(std::string& out, const std::string& bytes) {
+                put<uint32_t>(out, static_cast<uint32_t>(bytes.size()));
+                out.append(bytes);
+            }
+
+            // Bounds-checked cursor; ok() turns false on the first read past the end
+            class Reader {
+            public:
+                Reader(const char* data, size_t size) : _data(data), _end(data + size) {}
+
+                template<typename T>
+                T get() {
+                    T value{};
+                    if (static_cast<size_t>(_end - _data) < sizeof(value)) {
+                        _ok = false;
+                        _data = _end;
+                        return value;
+                    }
+                    std::memcpy(&value, _data, sizeof(value));
+                    _data += sizeof(value);
+                    return value;
+                }
+
+                // Pointer to the next size bytes (null past the end)
+                const char* take(size_t size) {
+                    if (static_cast<size_t>(_end - _data) < size) {
+                        _ok = false;
+                        _data = _end;
+                        return nullptr;
+                    }
+                    const char* bytes = _data;
+                    _data += size;
+                    return bytes;
+                }
+
+                std::string get_bytes() {
+                    uint32_t size = get<uint32_t>();
+                    const char* bytes = take(size);
+                    return bytes ? std::string(bytes, size) : std::string();
+                }
+
+                bool ok() const { return _ok; }
+                size_t remaining() const { return static_cast<size_t>(_end - _data); }
+
+            private:
+                const char* _data;
+                const char* _end;
+                bool _ok = true;
+            };
+        }
+    }
+}
+
+#endif // LILY_SERVICES_MEMORY_JOURNAL_HPP
@@ -1,33 +1,191 @@
 #ifndef MEMORY_SERVICE_HPP
 #define MEMORY_SERVICE_HPP
 
+#include <lily/services/MemoryJournal.hpp>
 #include <string>
 #include <vector>
-#include <map>
+#include <deque>
+#include <unordered_map>
+#include <array>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+#include <atomic>
 #include <chrono>
+#include <cstdint>
+#include <memory>
+#include <nlohmann/json.hpp>
 
 namespace lily {
     namespace services {
+        enum class Role : uint8_t {
+            user,
+            assistant,
+            system
+        };
+
+        // "user", "assistant" or "system"
+        const std::string& role_name(Role role);
+
+        // A message as handed to readers; the store itself keeps bodies in per-conversation arenas
         struct Message {
-            std::string role;
+            Role role = Role::user;
             std::string content;
             std::chrono::system_clock::time_point timestamp;
+            size_t tokens = 0; // estimated prompt tokens, computed once when stored
         };
 
+        /**
+         * @brief Thread-safe conversation store, sharded by user id. Readers get
+         * copies; nothing hands out references into the store.
+         */
         class MemoryService {
         public:
+            // Folds turns into the previous summary and returns the new one, in at most about max_tokens
+            // (empty on failure). With no turns it only shortens the summary. Called on the summarizer
+            // thread; may block.
+            using Summarizer = std::function<std::string(const std::string& previous_summary, const std::vector<Message>& turns, size_t max_tokens)>;
+
+            // What a prompt should carry: the summary of older turns and the recent ones, oldest first
+            struct ContextWindow {
+                std::string summary;
+                std::vector<Message> messages;
+            };
+
             MemoryService();
             ~MemoryService();
 
-            const std::vector<Message>& get_conversation(const std::string& user_id);
-            void add_message(const std::string& user_id, const std::string& role, const std::string& content);
+            // Compacts a conversation once its unsummarized turns exceed threshold_tokens, keeping
+            // about keep_recent_tokens of the newest turns verbatim. A summary longer than
+            // max_summary_tokens is compacted again, then cut. A null summarizer turns it off
+            // (waiting for a summary in progress).
+            void set_summarizer(Summarizer summarizer, size_t threshold_tokens, size_t keep_recent_tokens, size_t max_summary_tokens);
+
+            // Oldest turns are dropped once a conversation holds more than max_history_tokens
+            void set_history_limit(size_t max_history_tokens);
+
+            // Restores conversations from the journal's snapshot and log, then logs every change to it.
+            // Call once at startup, after set_history_limit() and before serving requests.
+            void set_journal(std::shared_ptr<MemoryJournal> journal);
+
+            // Snapshot of the conversation (empty for unknown users)
+            std::vector<Message> get_conversation(const std::string& user_id) const;
+
+            // The summary (when it fits) and the most recent messages within max_tokens. O(window).
+            ContextWindow get_context_window(const std::string& user_id, size_t max_tokens) const;
+            void add_message(const std::string& user_id, Role role, const std::string& content);
+            void add_message(const std::string& user_id, Role role, std::string&& content);
             void clear_conversation(const std::string& user_id);
+            // Current summary of the user's older turns (empty until one has been made)
             std::string summarize_conversation(const std::string& user_id);
 
+            // Rough prompt tokens for text: ~4 ASCII characters per token, one per non-ASCII character
+            static size_t estimate_tokens(const std::string& text);
+            // Longest prefix of text within max_tokens, ending at a sentence where one is close enough
+            static std::string truncate_to_tokens(const std::string& text, size_t max_tokens);
+
+            nlohmann::json get_metrics() const;
+
         private:
-            std::map<std::string, std::vector<Message>> conversations;
+            static constexpr size_t kShards = 64;
+
+            static constexpr size_t kMinBlockBytes = 128;
+            static constexpr size_t kMaxBlockBytes = 4096; // larger bodies get a block of their own
+
+            // Where one message lives in its conversation's arena
+            struct Record {
+                std::chrono::system_clock::time_point timestamp;
+                uint32_t block;  // block number, counted from the conversation's first block ever
+                uint32_t offset;
+                uint32_t length;
+                uint32_t tokens;
+                Role role;
+            };
+
+            struct Block {
+                std::string bytes;
+                uint32_t live = 0; // records still pointing into it
+            };
+
+            // Append-only storage for message bodies; a block is freed once no record points into it
+            struct Arena {
+                std::vector<Block> blocks; // a handful per conversation
+                uint32_t first_block = 0; // number of blocks.front()
+                uint32_t open_block = 0;  // block small bodies are appended to
+                bool has_open = false;
+
+                Record append(const char* data, size_t size, std::string* owned);
+                void release(const Record& record);
+                const char* data(const Record& record) const;
+            };
+
+            struct Conversation {
+                uint64_t id = 0;             // tells a recreated conversation from a cleared one
+                std::deque<Record> messages;
+                Arena arena;
+                size_t tokens = 0;           // sum of messages[i].tokens
+                uint64_t first_sequence = 0; // sequence number of messages.front()
+                std::string summary;
+                size_t summary_tokens = 0;
+                bool summary_pending = false;
+                size_t summary_retry_tokens = 0; // after a failed summary, wait until tokens exceed this
+            };
+
+            struct Shard {
+                mutable std::mutex mutex;
+                std::unordered_map<std::string, Conversation> conversations;
+            };
+
+            // Stable across builds and restarts: snapshots record a sequence number per shard
+            static size_t shard_index(const std::string& user_id);
+            Shard& shard_for(const std::string& user_id);
+            const Shard& shard_for(const std::string& user_id) const;
+            Conversation& conversation_locked(Shard& shard, const std::string& user_id);
+
+            // owned, when set, is content itself and may be moved from
+            void append(const std::string& user_id, Role role, const std::string& content, std::string* owned);
+            void append_locked(Conversation& conversation, Role role, std::chrono::system_clock::time_point timestamp,
+                               size_t tokens, const char* data, size_t size, std::string* owned);
+            static void apply_summary_locked(Conversation& conversation, uint64_t cut_sequence, std::string summary);
+            static Message to_message(const Conversation& conversation, const Record& record);
+            static void pop_front(Conversation& conversation);
+
+            // Journal; log_locked() is called with the conversation's shard lock held, so the log orders a
+            // conversation's changes as they were applied. Snapshots record a sequence number per shard.
+            bool journaling() const { return _journal && _journal->enabled(); }
+            void log_locked(std::string& record);
+            uint64_t recover(); // returns the generation of the snapshot it loaded (0 if none)
+            bool load_snapshot(const MemoryJournal::Mapping& snapshot, std::array<uint64_t, kShards>& shard_lsn, uint64_t& generation);
+            void replay(const char* payload, size_t size, const std::array<uint64_t, kShards>& shard_lsn, uint64_t& max_lsn);
+            bool write_snapshot();
+
+            void summarize_loop();
+            void summarize(const std::string& user_id);
+
+            std::array<Shard, kShards> _shards; // by hash of the user id, each with its own lock
+            std::atomic<size_t> _max_history_tokens{0}; // 0 = unbounded
+            std::atomic<uint64_t> _next_conversation_id{0};
+
+            std::shared_ptr<MemoryJournal> _journal;
+            std::atomic<uint64_t> _next_lsn{1};
+            uint64_t _recovered_messages = 0;
+            double _recovery_seconds = 0;
+            std::atomic<uint64_t> _snapshot_micros{0}; // duration of the last snapshot
+
+            // Background summarizer
+            std::mutex _summary_mutex;
+            std::condition_variable _summary_wake;
+            std::deque<std::string> _summary_queue; // users due for compaction
+            std::thread _summary_thread;
+            bool _summary_running = false;
+            std::mutex _summarizer_mutex;           // held while the summarizer runs
+            Summarizer _summarizer;
+            std::atomic<size_t> _summary_threshold_tokens{0}; // 0 = off
+            std::atomic<size_t> _summary_keep_tokens{0};
+            std::atomic<size_t> _summary_max_tokens{0};
         };
     }
 }
 
-#endif // MEMORY_SERVICE_HPP
\ No newline at end of file
+#endif // MEMORY_SERVICE_HPP
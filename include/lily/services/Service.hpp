@@ -1,6 +1,8 @@
 #ifndef LILY_SERVICES_SERVICE_HPP
 #define LILY_SERVICES_SERVICE_HPP
 
+#include <lily/services/McpClientPool.hpp>
+#include <lily/utils/AsyncSemaphore.hpp>
 #include <string>
 #include <vector>
 #include <nlohmann/json.hpp>
@@ -8,8 +10,12 @@
 #include <future>
 #include <chrono>
 #include <map>
+#include <unordered_map>
 #include <atomic>
 #include <thread>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
 
 namespace lily {
     namespace services {
@@ -23,23 +29,65 @@ namespace lily {
             bool mcp;
         };
 
+        /**
+         * @brief Immutable result of one tool discovery pass.
+         *
+         * Published as a shared_ptr and swapped atomically, so readers hold a
+         * consistent generation for as long as they need it without copying or
+         * locking, while discovery builds the next one off to the side.
+         */
+        struct ToolCatalog {
+            uint64_t generation = 0;
+            std::vector<nlohmann::json> tools; // one entry per distinct tool name
+            std::vector<std::string> servers;
+            std::map<std::string, std::vector<nlohmann::json>> tools_per_server;
+            // Tool name -> every server advertising it, in discovery order (first is primary, rest are replicas)
+            std::unordered_map<std::string, std::vector<std::string>> tool_servers;
+            // Gemini "tools" array for this generation, rendered once so request bodies
+            // can splice the bytes in as-is (empty when there are no tools)
+            std::shared_ptr<const std::string> gemini_tools;
+        };
+
         class Service {
         public:
             Service();
             ~Service();
 
+            // Full refresh of every MCP server's tool list
             void discover_tools();
+            // Starts the Consul watch (blocking queries) on a background thread; see ServiceWatch.cpp
             void start_periodic_discovery();
             void stop_periodic_discovery();
             nlohmann::json execute_tool(const std::string& tool_name, const nlohmann::json& parameters);
+            pplx::task<nlohmann::json> execute_tool_async(const std::string& tool_name, const nlohmann::json& parameters);
+
+            // Current catalog snapshot; cheap to take and safe to use while discovery runs
+            std::shared_ptr<const ToolCatalog> get_tool_catalog() const;
+
             std::vector<nlohmann::json> get_available_tools() const;
             std::vector<std::string> get_discovered_servers() const;
             size_t get_tool_count() const;
-            const std::vector<ServiceInfo>& get_services_info() const { return _services; }
+            std::vector<ServiceInfo> get_services_info() const;
+
+            // Discovery fan-out: at most max_concurrency MCP tools/list requests in flight,
+            // each bounded by server_timeout. Call before start_periodic_discovery().
+            void set_discovery_limits(size_t max_concurrency, std::chrono::seconds server_timeout);
+
+            // Consul blocking-query wait, and how often every server's tools are re-listed even
+            // when its health did not change. Call before start_periodic_discovery().
+            void set_watch_intervals(std::chrono::seconds wait, std::chrono::seconds tools_refresh);
+
+            // Pooled MCP clients: requests in flight per server, and how long an unused client is kept
+            void set_mcp_pool_limits(size_t max_in_flight_per_server, std::chrono::seconds idle_timeout);
+            // Per MCP server url: request counts and latency histogram of the pooled client
+            nlohmann::json get_mcp_pool_metrics() const { return _mcp_pool.get_metrics(); }
 
             // Getter for tools per server
             std::map<std::string, std::vector<nlohmann::json>> get_tools_per_server() const;
 
+            // Tool routing index lookups (hits, misses) since startup
+            nlohmann::json get_routing_stats() const;
+
             // Get URL for a service
             std::string getServiceUrl(const std::string& service_name, const std::string& protocol) const;
 
@@ -49,19 +97,51 @@ namespace lily {
             void deregister_service(const std::string& service_id);
 
         private:
-            std::vector<nlohmann::json> _tools;
+            std::shared_ptr<const ToolCatalog> _catalog; // only accessed through std::atomic_load/atomic_store
             std::vector<ServiceInfo> _services;
-            std::vector<std::string> _discovered_servers;
+            mutable std::mutex _services_mutex;
+            std::map<std::string, std::vector<nlohmann::json>> _server_tools; // latest tools/list per MCP url
+            std::mutex _tools_mutex; // guards _server_tools and catalog publication; taken before _services_mutex
+            std::shared_ptr<utils::AsyncSemaphore> _discovery_slots;
+            McpClientPool _mcp_pool;
+            std::chrono::seconds _discovery_timeout;
+
+            // Consul watch state (ServiceWatch.cpp)
+            struct ServiceWatch;
+            std::map<std::string, std::shared_ptr<ServiceWatch>> _service_watches; // only touched by the watch thread
+            std::shared_ptr<web::http::client::http_client> _consul_client;
+            pplx::cancellation_token_source _watch_cancellation;
+            std::chrono::seconds _watch_wait;
+            std::chrono::seconds _tools_refresh_interval;
+            // Health queries and retry timers in flight; their callbacks use this, so teardown waits for zero
+            int _active_watches;
+            std::mutex _active_watches_mutex;
+            std::condition_variable _active_watches_done;
             std::future<void> _discovery_future;
             std::atomic<bool> _discovery_running;
+            std::atomic<uint64_t> _routing_hits;
+            std::atomic<uint64_t> _routing_misses;
             std::vector<std::string> _registered_service_ids;
 
-            void discover_services_from_consul();
-            std::vector<nlohmann::json> discover_tools_from_server(const std::string& server_url);
-            nlohmann::json execute_tool_on_server(const std::string& server_url, const std::string& tool_name, const nlohmann::json& parameters);
+            static std::string consul_address();
+            pplx::task<std::vector<nlohmann::json>> discover_tools_from_server_async(const std::string& server_url);
+            std::shared_ptr<const ToolCatalog> publish_catalog();
+            void set_server_tools(const std::string& server_url, std::vector<nlohmann::json> tools);
+            void remove_server_tools(const std::string& server_url);
 
-            // Store tools per server for detailed monitoring
-            std::map<std::string, std::vector<nlohmann::json>> _tools_per_server;
+            void run_discovery_watch();
+            void reconcile_service_watches(const std::vector<std::string>& service_names);
+            void arm_service_watch(std::shared_ptr<ServiceWatch> watch);
+            void retry_service_watch(std::shared_ptr<ServiceWatch> watch);
+            void watch_started();
+            void watch_finished();
+            pplx::task<void> apply_service_health(std::shared_ptr<ServiceWatch> watch, const web::json::value& nodes);
+            bool upsert_watched_service(const ServiceInfo& info, const ServiceWatch& watch, ServiceInfo& previous, bool& existed);
+            bool remove_service(const std::string& service_name, ServiceInfo& removed);
+            // Servers tried so far for one execute_tool_async() call
+            struct ToolAttempt;
+            pplx::task<nlohmann::json> try_next_server_async(std::shared_ptr<ToolAttempt> attempt);
+            pplx::task<nlohmann::json> execute_tool_on_server_async(const std::string& server_url, const std::string& tool_name, const nlohmann::json& parameters);
         };
     }
 }
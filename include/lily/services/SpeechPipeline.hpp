@@ -0,0 +1,114 @@
+#ifndef LILY_SERVICES_SPEECH_PIPELINE_HPP
+#define LILY_SERVICES_SPEECH_PIPELINE_HPP
+
+#include <lily/services/TTSService.hpp>
+#include <lily/services/GatewayService.hpp>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <functional>
+
+namespace lily {
+    namespace services {
+
+        /**
+         * @brief Incremental sentence boundary detection for text that arrives in pieces.
+         *
+         * A sentence ends at . ! ? (plus any closing quotes/brackets) followed by
+         * whitespace, at a CJK full stop, or at a newline. Common abbreviations,
+         * single-letter initials and list numbers ("1.") do not end a sentence.
+         */
+        class SentenceSplitter {
+        public:
+            // Returns the sentences completed by this piece of text
+            std::vector<std::string> feed(const std::string& text);
+
+            // Whatever is left once no more text will come (empty when nothing is left)
+            std::string flush();
+
+        private:
+            bool is_abbreviation(size_t start, size_t dot) const;
+
+            std::string _pending; // text after the last emitted sentence
+            size_t _scan = 0;     // position in _pending up to which boundaries were checked
+        };
+
+        /**
+         * @brief Speaks an answer sentence by sentence while it is still being generated.
+         *
+         * Text (streamed deltas or a whole answer) is split into sentences; each
+         * complete sentence is submitted to the TTS pool right away, up to a small
+         * lookahead. Audio frames of the sentence being spoken go to the user's
+         * connection the moment the provider sends them; frames of later sentences
+         * are held (by reference, never copied) until every earlier sentence is
+         * done, so audio arrives in order.
+         */
+        class SpeechPipeline : public std::enable_shared_from_this<SpeechPipeline> {
+        public:
+            using DoneCallback = std::function<void()>;
+
+            SpeechPipeline(TTSService& ttsService,
+                           GatewayService& webSocketManager,
+                           const std::string& user_id,
+                           const TTSParameters& params);
+
+            // Streamed text delta
+            void add_text(const std::string& text);
+
+            // No more deltas will come. Speaks the remainder when full_text is what was streamed last,
+            // otherwise the whole of full_text (nothing streamed, or a reply that never came as deltas),
+            // and calls on_done once the last chunk has been sent.
+            void finish(const std::string& full_text, DoneCallback on_done);
+
+            // No reply will come: drops text not yet submitted; sentences already submitted still play
+            void abort();
+
+        private:
+            // Sentences of one answer being synthesized at the same time
+            static constexpr size_t kLookahead = 2;
+
+            // A submitted sentence whose audio has not all been sent yet
+            struct Slot {
+                std::vector<utils::SharedBuffer> held; // frames waiting for earlier sentences
+                bool done = false;
+            };
+            enum class Connection { waiting, ready, unavailable };
+
+            void submit_ready_locked();
+            void on_chunk(uint64_t sequence, const utils::SharedBuffer& chunk);
+            void on_sentence_done(uint64_t sequence, const TTSResult& result);
+            void on_connection(bool registered);
+            void send_locked(const utils::SharedBuffer& chunk);
+            void flush_locked();
+            DoneCallback take_done_locked();
+
+            TTSService& _ttsService;
+            GatewayService& _webSocketManager;
+            std::string _user_id;
+            TTSParameters _params;
+
+            std::mutex _mutex;
+            SentenceSplitter _splitter;
+            std::deque<std::string> _queue; // complete sentences not yet submitted
+            size_t _outstanding = 0;        // submitted, synthesis not yet finished
+            std::string _streamed_text;     // everything add_text() saw
+            bool _finished = false;
+            DoneCallback _on_done;
+            bool _started = false;
+            Connection _connection = Connection::waiting;
+
+            std::map<uint64_t, Slot> _slots; // by sentence number
+            uint64_t _next_sequence = 0;
+            uint64_t _head = 0;              // sentence whose frames are being sent
+
+            size_t _sentences_spoken = 0;
+            size_t _chunks_sent = 0;
+            std::chrono::steady_clock::time_point _start;
+        };
+    }
+}
+
+#endif // LILY_SERVICES_SPEECH_PIPELINE_HPP
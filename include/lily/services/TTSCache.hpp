@@ -0,0 +1,86 @@
+#ifndef LILY_SERVICES_TTS_CACHE_HPP
+#define LILY_SERVICES_TTS_CACHE_HPP
+
+#include <lily/services/TTSSession.hpp>
+#include <lily/utils/SharedBuffer.hpp>
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <nlohmann/json.hpp>
+
+namespace lily {
+    namespace services {
+        /**
+         * @brief Content-addressed cache of synthesized audio.
+         *
+         * Keys combine every TTSParameters field with the normalized text, so
+         * the same sentence in another voice, model, language or sample rate is
+         * a different entry. The memory tier is an LRU bounded by audio bytes and
+         * hands out the cached frames themselves (no copy per hit). The optional
+         * disk tier keeps one file per entry in a directory such as
+         * /app/data/tts_cache. A hit there is read into memory and promoted; the
+         * oldest files are deleted once the directory exceeds its byte budget.
+         */
+        class TTSCache {
+        public:
+            // An empty disk_directory disables the disk tier
+            TTSCache(size_t max_bytes, const std::string& disk_directory = "", size_t disk_max_bytes = 0);
+
+            TTSCache(const TTSCache&) = delete;
+            TTSCache& operator=(const TTSCache&) = delete;
+
+            // Parameters plus the text with surrounding whitespace trimmed and inner runs collapsed
+            static std::string make_key(const std::string& text, const TTSParameters& params);
+
+            // Fills chunks and returns true on a hit in either tier
+            bool lookup(const std::string& key, std::vector<utils::SharedBuffer>& chunks);
+
+            // Entries larger than a quarter of the memory budget are not cached
+            void store(const std::string& key, const std::vector<utils::SharedBuffer>& chunks, size_t bytes);
+
+            nlohmann::json get_metrics() const;
+
+        private:
+            struct Entry {
+                std::string key;
+                std::vector<utils::SharedBuffer> chunks;
+                size_t bytes = 0;
+            };
+
+            void insert_locked(const std::string& key, const std::vector<utils::SharedBuffer>& chunks, size_t bytes);
+
+            std::string disk_path(const std::string& key) const;
+            void scan_disk();
+            bool read_disk(const std::string& key, utils::SharedBuffer& audio);
+            void write_disk(const std::string& key, const std::vector<utils::SharedBuffer>& chunks, size_t bytes);
+            void trim_disk_locked();
+
+            size_t _max_bytes;
+            std::string _disk_directory;
+            size_t _disk_max_bytes;
+
+            mutable std::mutex _mutex;
+            std::list<Entry> _lru; // most recently used first
+            std::unordered_map<std::string, std::list<Entry>::iterator> _index;
+            size_t _bytes = 0;
+
+            mutable std::mutex _disk_mutex;
+            bool _disk_enabled = false;
+            size_t _disk_bytes = 0;
+            size_t _disk_entries = 0;
+
+            std::atomic<uint64_t> _memory_hits{0};
+            std::atomic<uint64_t> _disk_hits{0};
+            std::atomic<uint64_t> _misses{0};
+            std::atomic<uint64_t> _bytes_saved{0}; // audio served without synthesizing it
+            std::atomic<uint64_t> _evictions{0};
+            std::atomic<uint64_t> _disk_evictions{0};
+        };
+    }
+}
+
+#endif // LILY_SERVICES_TTS_CACHE_HPP
@@ -1,41 +1,94 @@
 #ifndef LILY_SERVICES_TTSSERVICE_HPP
 #define LILY_SERVICES_TTSSERVICE_HPP
 
+#include <lily/services/TTSSession.hpp>
+#include <lily/services/TTSCache.hpp>
 #include <string>
 #include <vector>
 #include <cstdint>
 #include <memory>
-#include <cpprest/ws_client.h>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <nlohmann/json.hpp>
 #include <cpprest/http_client.h>
 
 namespace lily {
     namespace services {
-        struct TTSParameters {
-            int speaker = 0;
-            int sample_rate = 24000;
-            std::string model = "edge";
-            std::string lang = "en-US";
-        };
-
+        /**
+         * @brief Thread-safe TTS client over a pool of persistent provider sessions.
+         *
+         * Each request goes to the least busy connection, so concurrent voice chats
+         * are synthesized in parallel. At most max_queue requests wait beyond the
+         * one streaming on each connection; past that, requests are rejected at
+         * once instead of piling up. Every request has a deadline after which it
+         * fails with deadline_exceeded, whether it is still queued or streaming.
+         */
         class TTSService {
         public:
             TTSService();
             ~TTSService();
 
+            // Applies from the next connect()
+            void set_pool_limits(size_t pool_size, size_t max_queue, std::chrono::seconds request_timeout);
+
+            // For providers that close the socket after every utterance instead of sending an
+            // end frame. Applies from the next connect().
+            void set_close_ends_utterance(bool close_ends_utterance);
+
+            // Repeated utterances are answered from the cache instead of the provider
+            void set_cache(std::shared_ptr<TTSCache> cache);
+
+            // Checks the provider's /ready endpoint and opens the pooled sessions
             bool connect(const std::string& provider_url, const std::string& websocket_url = "");
+
+            // Blocking wrapper around synthesize_speech_async()
             std::vector<uint8_t> synthesize_speech(const std::string& text, const TTSParameters& params = TTSParameters());
+
+            // Resolves to an empty vector on any failure. Joins the audio frames into one
+            // buffer, which costs a copy; streaming callers should use submit() with on_chunk.
+            pplx::task<std::vector<uint8_t>> synthesize_speech_async(const std::string& text, const TTSParameters& params = TTSParameters());
+
+            // Full result, with rejected/deadline_exceeded reported separately. A zero timeout
+            // uses the configured request timeout. With on_chunk, each audio frame is handed
+            // over (not copied) as soon as it arrives.
+            pplx::task<TTSResult> submit(const std::string& text,
+                                         const TTSParameters& params,
+                                         std::chrono::milliseconds timeout = std::chrono::milliseconds(0),
+                                         AudioChunkCallback on_chunk = nullptr);
+
+            // Backpressure: true once the queue is at least three quarters full
+            bool is_saturated() const;
+
             void close();
+            bool is_connected() const;
+            nlohmann::json get_metrics() const;
 
         private:
-            bool _is_connected;
             std::string _provider_url;
             std::string _websocket_url;
-            std::unique_ptr<web::websockets::client::websocket_client> _websocket_client;
-            
-            bool initialize_websocket();
+            size_t _pool_size;
+            size_t _max_queue;
+            std::chrono::seconds _request_timeout;
+            bool _close_ends_utterance = false;
+
+            mutable std::mutex _mutex;
+            std::vector<std::shared_ptr<TTSSession>> _sessions;
+            std::shared_ptr<TTSCache> _cache;
+
+            std::atomic<size_t> _pending{0}; // accepted and not finished, across all sessions
+            std::atomic<uint64_t> _rejected{0};
+            std::atomic<uint64_t> _utterances{0};     // completed with audio
+            std::atomic<uint64_t> _bytes_received{0};
+            std::atomic<uint64_t> _bytes_copied{0};   // audio bytes copied after receipt (joining frames)
+
+            std::vector<std::shared_ptr<TTSSession>> sessions() const;
+            std::shared_ptr<TTSCache> cache() const;
+            size_t capacity() const;
+            std::string resolve_websocket_url() const;
             bool is_ready();
         };
     }
 }
 
-#endif // LILY_SERVICES_TTSSERVICE_HPP
\ No newline at end of file
+#endif // LILY_SERVICES_TTSSERVICE_HPP
@@ -0,0 +1,134 @@
+#ifndef LILY_SERVICES_TTS_SESSION_HPP
+#define LILY_SERVICES_TTS_SESSION_HPP
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <cpprest/ws_client.h>
+#include <nlohmann/json.hpp>
+#include <lily/utils/SharedBuffer.hpp>
+
+namespace lily {
+    namespace services {
+        struct TTSParameters {
+            int speaker = 0;
+            int sample_rate = 24000;
+            std::string model = "edge";
+            std::string lang = "en-US";
+        };
+
+        enum class TTSStatus {
+            ok,
+            failed,            // provider error, no audio, or connection lost before any audio
+            partial,           // connection lost mid-utterance: the audio is incomplete
+            deadline_exceeded, // still queued or streaming when its deadline passed
+            rejected           // not accepted: every connection's queue is full (backpressure)
+        };
+
+        // Receives each audio frame of an utterance as it arrives, on the session's handler thread
+        using AudioChunkCallback = std::function<void(const utils::SharedBuffer& chunk)>;
+
+        struct TTSResult {
+            TTSStatus status = TTSStatus::failed;
+            // Frames as received, not concatenated; empty when they went to an AudioChunkCallback
+            std::vector<utils::SharedBuffer> chunks;
+            size_t bytes = 0; // audio bytes received, including streamed chunks
+            bool ended = false; // closed by the provider's end-of-utterance frame, not by a socket close
+        };
+
+        /**
+         * @brief One long-lived WebSocket session to the TTS provider.
+         *
+         * Requests carry a request_id and are queued on the session; the next one
+         * is sent the moment the previous utterance ends, so a request never pays
+         * a handshake or a readiness probe. When the provider closes the socket
+         * or a request misses its deadline, a background thread reconnects right
+         * away, backing off only while the provider is unreachable.
+         *
+         * An utterance is complete only once the provider sends its end frame.
+         * Older providers close the socket after every utterance instead; with
+         * close_ends_utterance that close counts as the end.
+         */
+        class TTSSession : public std::enable_shared_from_this<TTSSession> {
+        public:
+            explicit TTSSession(const std::string& websocket_url, bool close_ends_utterance = false);
+            ~TTSSession();
+
+            // Connects and starts the background reconnect thread. Blocking; returns whether
+            // the first attempt connected (the thread keeps retrying either way).
+            bool open();
+            // Blocks until the client sockets are closed, so call it from outside the session's own callbacks
+            // before letting go of the session (the destructor calls it too)
+            void close();
+            bool is_open() const;
+            bool is_connected() const;
+
+            // Queued behind the session's other requests; fails with deadline_exceeded when it
+            // is not finished by the deadline. With on_chunk, frames are handed over as they
+            // arrive instead of being collected in the result.
+            pplx::task<TTSResult> synthesize(const std::string& text,
+                                             const TTSParameters& params,
+                                             std::chrono::steady_clock::time_point deadline,
+                                             AudioChunkCallback on_chunk = nullptr);
+
+            // Requests waiting for or holding this session
+            size_t pending() const;
+            nlohmann::json get_metrics() const;
+
+        private:
+            struct Request {
+                uint64_t id = 0;
+                std::string payload;
+                pplx::task_completion_event<TTSResult> done;
+                AudioChunkCallback on_chunk;
+                std::vector<utils::SharedBuffer> chunks;
+                size_t bytes = 0;
+                bool ended = false;
+                int attempts = 0;
+                std::chrono::steady_clock::time_point deadline;
+            };
+            using Client = web::websockets::client::websocket_callback_client;
+
+            std::shared_ptr<Client> connect_socket(uint64_t generation);
+            void dispatch_locked();
+            void on_message(uint64_t generation, const web::websockets::client::websocket_incoming_message& msg);
+            void on_closed(uint64_t generation);
+            void drop_connection_locked();
+            void maintenance_loop();
+            std::vector<std::shared_ptr<Request>> expire_locked(std::chrono::steady_clock::time_point now);
+            void finish(std::shared_ptr<Request> request, TTSStatus status);
+
+            std::string _websocket_url;
+            bool _close_ends_utterance;
+
+            mutable std::mutex _mutex;
+            std::condition_variable _wake;
+            std::shared_ptr<Client> _client;
+            std::vector<std::shared_ptr<Client>> _retired; // closed by the maintenance thread
+            uint64_t _generation = 0; // bumped per connection so stale callbacks are ignored
+            bool _connected = false;
+            bool _running = false;
+            std::deque<std::shared_ptr<Request>> _queue;
+            std::shared_ptr<Request> _current; // the utterance being streamed
+            std::thread _maintenance;
+
+            std::atomic<uint64_t> _next_id{0};
+            std::atomic<uint64_t> _requests{0};
+            std::atomic<uint64_t> _completed{0};
+            std::atomic<uint64_t> _failed{0};
+            std::atomic<uint64_t> _partial{0};
+            std::atomic<uint64_t> _deadline_exceeded{0};
+            std::atomic<uint64_t> _reconnects{0};
+        };
+    }
+}
+
+#endif // LILY_SERVICES_TTS_SESSION_HPP
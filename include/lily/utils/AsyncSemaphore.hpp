@@ -0,0 +1,60 @@
+#ifndef LILY_UTILS_ASYNC_SEMAPHORE_HPP
+#define LILY_UTILS_ASYNC_SEMAPHORE_HPP
+
+#include <pplx/pplxtasks.h>
+#include <deque>
+#include <mutex>
+
+namespace lily {
+namespace utils {
+
+/**
+ * @brief Counting semaphore for pplx task chains.
+ *
+ * acquire() returns a task that completes once a slot is free, so callers
+ * queue as continuations instead of blocking a thread. Every successful
+ * acquire must be paired with exactly one release().
+ */
+class AsyncSemaphore {
+public:
+    explicit AsyncSemaphore(size_t slots) : _available(slots == 0 ? 1 : slots) {}
+
+    AsyncSemaphore(const AsyncSemaphore&) = delete;
+    AsyncSemaphore& operator=(const AsyncSemaphore&) = delete;
+
+    pplx::task<void> acquire() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_available > 0) {
+            _available--;
+            return pplx::task_from_result();
+        }
+        pplx::task_completion_event<void> waiter;
+        _waiters.push_back(waiter);
+        return pplx::create_task(waiter);
+    }
+
+    void release() {
+        pplx::task_completion_event<void> waiter;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_waiters.empty()) {
+                _available++;
+                return;
+            }
+            // Hand the slot straight to the oldest waiter
+            waiter = _waiters.front();
+            _waiters.pop_front();
+        }
+        waiter.set();
+    }
+
+private:
+    std::mutex _mutex;
+    size_t _available;
+    std::deque<pplx::task_completion_event<void>> _waiters;
+};
+
+} // namespace utils
+} // namespace lily
+
+#endif // LILY_UTILS_ASYNC_SEMAPHORE_HPP
@@ -0,0 +1,62 @@
+#ifndef LILY_UTILS_SHARED_BUFFER_HPP
+#define LILY_UTILS_SHARED_BUFFER_HPP
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace lily {
+namespace utils {
+
+/**
+ * @brief Immutable, reference-counted byte buffer.
+ *
+ * Audio moves through several hands (provider socket, pipeline, client
+ * sockets); passing a SharedBuffer lets each of them hold on to the bytes
+ * without copying them. Nobody may modify the bytes once shared.
+ */
+using SharedBuffer = std::shared_ptr<const std::vector<uint8_t>>;
+
+// Takes ownership of bytes without copying them
+inline SharedBuffer make_shared_buffer(std::vector<uint8_t>&& bytes) {
+    return std::make_shared<const std::vector<uint8_t>>(std::move(bytes));
+}
+
+inline size_t buffer_size(const SharedBuffer& buffer) {
+    return buffer ? buffer->size() : 0;
+}
+
+/**
+ * @brief Read-only view of bytes owned by someone else, kept alive by a
+ * shared owner.
+ *
+ * Lets a received frame (e.g. a websocketpp message) travel onwards without
+ * copying its payload out: the view holds a reference to the message itself.
+ * Copying a view only bumps a reference count.
+ */
+class SharedBytes {
+public:
+    SharedBytes() = default;
+
+    SharedBytes(std::shared_ptr<const void> owner, const uint8_t* data, size_t size)
+        : _owner(std::move(owner)), _data(data), _size(size) {}
+
+    explicit SharedBytes(const SharedBuffer& buffer)
+        : _owner(buffer), _data(buffer ? buffer->data() : nullptr), _size(buffer_size(buffer)) {}
+
+    const uint8_t* data() const { return _data; }
+    size_t size() const { return _size; }
+    bool empty() const { return _size == 0; }
+    const uint8_t* begin() const { return _data; }
+    const uint8_t* end() const { return _data + _size; }
+
+private:
+    std::shared_ptr<const void> _owner;
+    const uint8_t* _data = nullptr;
+    size_t _size = 0;
+};
+
+} // namespace utils
+} // namespace lily
+
+#endif // LILY_UTILS_SHARED_BUFFER_HPP
@@ -2,7 +2,7 @@
 #define LILY_UTILS_THREAD_POOL_HPP
 
 #include <vector>
-#include <queue>
+#include <deque>
 #include <memory>
 #include <thread>
 #include <mutex>
@@ -11,82 +11,259 @@
 #include <functional>
 #include <stdexcept>
 #include <iostream>
+#include <atomic>
+#include <cstdint>
 
 namespace lily {
 namespace utils {
 
+/**
+ * @brief Bounded lock-free multi-producer/multi-consumer ring (Vyukov).
+ *
+ * Used as the injection queue of the ThreadPool so that submitting a task
+ * from a non-worker thread never takes a lock. try_push() fails when the ring
+ * is full; the pool then falls back to a worker deque.
+ */
+template<typename T>
+class MpmcRing {
+public:
+    explicit MpmcRing(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) size <<= 1;
+        _mask = size - 1;
+        _cells = std::unique_ptr<Cell[]>(new Cell[size]);
+        for (size_t i = 0; i < size; ++i) {
+            _cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        _enqueue_pos.store(0, std::memory_order_relaxed);
+        _dequeue_pos.store(0, std::memory_order_relaxed);
+    }
+
+    MpmcRing(const MpmcRing&) = delete;
+    MpmcRing& operator=(const MpmcRing&) = delete;
+
+    bool try_push(T&& value) {
+        size_t pos = _enqueue_pos.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = _cells[pos & _mask];
+            size_t seq = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.value = std::move(value);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // full
+            } else {
+                pos = _enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool try_pop(T& out) {
+        size_t pos = _dequeue_pos.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = _cells[pos & _mask];
+            size_t seq = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    out = std::move(cell.value);
+                    cell.sequence.store(pos + _mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // empty
+            } else {
+                pos = _dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> _cells;
+    size_t _mask = 0;
+    alignas(64) std::atomic<size_t> _enqueue_pos;
+    alignas(64) std::atomic<size_t> _dequeue_pos;
+};
+
+/**
+ * @brief Work-stealing thread pool.
+ *
+ * Each worker owns a deque: tasks enqueued from a worker thread go to the
+ * back of that worker's deque and are popped LIFO by the owner, while idle
+ * workers steal FIFO from the front. Tasks enqueued from outside the pool go
+ * through a lock-free injection ring. Workers only park on the condition
+ * variable when there is no work anywhere, and submitters only touch the
+ * parking mutex when somebody is actually parked.
+ */
 class ThreadPool {
 public:
-    ThreadPool(size_t threads = std::thread::hardware_concurrency()) 
-        : stop(false) {
+    ThreadPool(size_t threads = std::thread::hardware_concurrency())
+        : _injector(4096), _stop(false), _pending(0), _sleepers(0), _next_victim(0) {
         if (threads == 0) threads = 4; // Default to 4 if detection fails or returns 0
-        
-        for(size_t i = 0; i < threads; ++i)
-            workers.emplace_back(
-                [this] {
-                    for(;;) {
-                        std::function<void()> task;
-
-                        {
-                            std::unique_lock<std::mutex> lock(this->queue_mutex);
-                            this->condition.wait(lock,
-                                [this]{ return this->stop || !this->tasks.empty(); });
-                            
-                            if(this->stop && this->tasks.empty())
-                                return;
-                            
-                            task = std::move(this->tasks.front());
-                            this->tasks.pop();
-                        }
-
-                        task();
-                    }
-                }
-            );
-        std::cout << "[ThreadPool] Started with " << threads << " workers" << std::endl;
+
+        for (size_t i = 0; i < threads; ++i)
+            _queues.emplace_back(new WorkerQueue());
+
+        for (size_t i = 0; i < threads; ++i)
+            _workers.emplace_back([this, i] { worker_loop(i); });
+
+        std::cout << "[ThreadPool] Started with " << threads << " workers (work-stealing)" << std::endl;
     }
 
     template<class F, class... Args>
-    auto enqueue(F&& f, Args&&... args) 
+    auto enqueue(F&& f, Args&&... args)
         -> std::future<typename std::result_of<F(Args...)>::type> {
         using return_type = typename std::result_of<F(Args...)>::type;
 
         auto task = std::make_shared<std::packaged_task<return_type()>>(
             std::bind(std::forward<F>(f), std::forward<Args>(args)...)
         );
-        
+
         std::future<return_type> res = task->get_future();
-        {
-            std::unique_lock<std::mutex> lock(queue_mutex);
 
-            // don't allow enqueueing after stopping the pool
-            if(stop)
-                throw std::runtime_error("enqueue on stopped ThreadPool");
+        // don't allow enqueueing after stopping the pool
+        if (_stop.load(std::memory_order_acquire))
+            throw std::runtime_error("enqueue on stopped ThreadPool");
 
-            tasks.emplace([task](){ (*task)(); });
-        }
-        condition.notify_one();
+        submit([task]() { (*task)(); });
         return res;
     }
 
+    size_t size() const { return _workers.size(); }
+
     ~ThreadPool() {
         {
-            std::unique_lock<std::mutex> lock(queue_mutex);
-            stop = true;
+            std::unique_lock<std::mutex> lock(_sleep_mutex);
+            _stop.store(true, std::memory_order_release);
         }
-        condition.notify_all();
-        for(std::thread &worker: workers)
+        _wake.notify_all();
+        for (std::thread& worker : _workers)
             worker.join();
         std::cout << "[ThreadPool] Stopped" << std::endl;
     }
 
 private:
-    std::vector<std::thread> workers;
-    std::queue<std::function<void()>> tasks;
-    
-    std::mutex queue_mutex;
-    std::condition_variable condition;
-    bool stop;
+    using Task = std::function<void()>;
+
+    struct alignas(64) WorkerQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    // Index of the worker running on this thread, or -1 outside the pool.
+    // Paired with the owning pool so nested pools do not mix up queues.
+    static const ThreadPool*& current_pool() {
+        thread_local const ThreadPool* pool = nullptr;
+        return pool;
+    }
+
+    static long& current_index() {
+        thread_local long index = -1;
+        return index;
+    }
+
+    void submit(Task&& task) {
+        if (current_pool() == this) {
+            WorkerQueue& own = *_queues[static_cast<size_t>(current_index())];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            own.tasks.push_back(std::move(task));
+        } else if (!_injector.try_push(std::move(task))) {
+            // Injection ring is full; spill onto a worker deque where it can be stolen.
+            size_t victim = _next_victim.fetch_add(1, std::memory_order_relaxed) % _queues.size();
+            WorkerQueue& queue = *_queues[victim];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.tasks.push_back(std::move(task));
+        }
+
+        _pending.fetch_add(1, std::memory_order_seq_cst);
+        if (_sleepers.load(std::memory_order_seq_cst) > 0) {
+            // Taking the lock orders us against a worker that is about to park.
+            { std::lock_guard<std::mutex> lock(_sleep_mutex); }
+            _wake.notify_one();
+        }
+    }
+
+    bool pop_local(size_t index, Task& out) {
+        WorkerQueue& own = *_queues[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (own.tasks.empty()) return false;
+        out = std::move(own.tasks.back());
+        own.tasks.pop_back();
+        return true;
+    }
+
+    bool steal(size_t thief, Task& out) {
+        const size_t count = _queues.size();
+        for (size_t offset = 1; offset < count; ++offset) {
+            WorkerQueue& victim = *_queues[(thief + offset) % count];
+            std::unique_lock<std::mutex> lock(victim.mutex, std::try_to_lock);
+            if (!lock.owns_lock() || victim.tasks.empty()) continue;
+            out = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+        return false;
+    }
+
+    bool find_task(size_t index, Task& out) {
+        if (pop_local(index, out) || _injector.try_pop(out) || steal(index, out)) {
+            _pending.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+
+    void worker_loop(size_t index) {
+        current_pool() = this;
+        current_index() = static_cast<long>(index);
+
+        for (;;) {
+            Task task;
+            if (find_task(index, task)) {
+                task();
+                continue;
+            }
+
+            // A try_lock in steal() can miss work, so spin once more before parking.
+            std::this_thread::yield();
+            if (find_task(index, task)) {
+                task();
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(_sleep_mutex);
+            _sleepers.fetch_add(1, std::memory_order_seq_cst);
+            _wake.wait(lock, [this] {
+                return _stop.load(std::memory_order_acquire) ||
+                       _pending.load(std::memory_order_seq_cst) > 0;
+            });
+            _sleepers.fetch_sub(1, std::memory_order_seq_cst);
+
+            if (_stop.load(std::memory_order_acquire) &&
+                _pending.load(std::memory_order_seq_cst) == 0)
+                return;
+        }
+    }
+
+    std::vector<std::thread> _workers;
+    std::vector<std::unique_ptr<WorkerQueue>> _queues;
+    MpmcRing<Task> _injector;
+
+    std::mutex _sleep_mutex;
+    std::condition_variable _wake;
+    std::atomic<bool> _stop;
+    std::atomic<long> _pending; // may dip below zero briefly while a pop races a submit
+    std::atomic<size_t> _sleepers;
+    std::atomic<size_t> _next_victim;
 };
 
 } // namespace utils
@@ -27,6 +27,7 @@ namespace controller {
         std::string user_id = request["user_id"];
         
         services::ChatParameters chat_params;
+        chat_params.stream_deltas = request.value("stream", true);
         if (request.contains("tts") && request["tts"].is_object()) {
             const auto& tts_json = request["tts"];
             chat_params.enable_tts = tts_json.value("enabled", false);
@@ -89,6 +90,9 @@ namespace controller {
             }
             
             response["duration_seconds"] = last_loop.duration_seconds;
+            if (last_loop.time_to_first_token_seconds >= 0) {
+                response["time_to_first_token_seconds"] = last_loop.time_to_first_token_seconds;
+            }
             
             nlohmann::json steps_json = nlohmann::json::array();
             for (const auto& step : last_loop.steps) {
@@ -127,7 +131,7 @@ namespace controller {
         if (!_memoryService) {
              return {{"error", "MemoryService not available"}};
         }
-        const auto& conversation = _memoryService->get_conversation(userId);
+        auto conversation = _memoryService->get_conversation(userId);
         nlohmann::json response;
         response["user_id"] = userId;
         nlohmann::json conv_json = nlohmann::json::array();
@@ -135,7 +139,7 @@ namespace controller {
         char buf[100];
         for (const auto& msg : conversation) {
             nlohmann::json msg_json;
-            msg_json["role"] = msg.role;
+            msg_json["role"] = lily::services::role_name(msg.role);
             msg_json["content"] = msg.content;
             
             auto time_point = std::chrono::system_clock::to_time_t(msg.timestamp);
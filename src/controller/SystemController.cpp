@@ -3,18 +3,38 @@
 #include "lily/utils/SystemMetrics.hpp"
 #include "lily/services/Service.hpp"
 #include "lily/services/AgentLoopService.hpp"
+#include "lily/services/GeminiClient.hpp"
+#include "lily/services/TTSService.hpp"
+#include "lily/services/EchoService.hpp"
+#include "lily/services/MemoryService.hpp"
 #include <iostream>
 
 namespace lily {
 namespace controller {
 
     SystemController::SystemController(config::AppConfig& config, services::Service& toolService) 
-        : _config(&config), _toolService(&toolService), _agentLoopService(nullptr) {}
+        : _config(&config), _toolService(&toolService), _agentLoopService(nullptr), _geminiClient(nullptr), _ttsService(nullptr), _echoService(nullptr), _memoryService(nullptr) {}
 
     void SystemController::setAgentLoopService(services::AgentLoopService* agentLoopService) {
         _agentLoopService = agentLoopService;
     }
 
+    void SystemController::setGeminiClient(services::GeminiClient* geminiClient) {
+        _geminiClient = geminiClient;
+    }
+
+    void SystemController::setTTSService(services::TTSService* ttsService) {
+        _ttsService = ttsService;
+    }
+
+    void SystemController::setEchoService(services::EchoService* echoService) {
+        _echoService = echoService;
+    }
+
+    void SystemController::setMemoryService(services::MemoryService* memoryService) {
+        _memoryService = memoryService;
+    }
+
     nlohmann::json SystemController::getHealth() {
         return {{"status", "UP"}};
     }
@@ -99,23 +119,38 @@ namespace controller {
             details[detail.first] = detail.second;
         }
         response["details"] = details;
+        
+        if (_geminiClient) {
+            response["gemini"] = _geminiClient->get_metrics();
+        }
+        if (_ttsService) {
+            response["tts"] = _ttsService->get_metrics();
+        }
+        if (_echoService) {
+            response["echo"] = _echoService->get_metrics();
+        }
+        if (_memoryService) {
+            response["memory"] = _memoryService->get_metrics();
+        }
         return response;
     }
 
     nlohmann::json SystemController::getTools() {
         if (!_toolService) return {{"error", "Tool service not initialized"}};
 
-        auto tools_per_server = _toolService->get_tools_per_server();
-        
+        auto catalog = _toolService->get_tool_catalog();
+        auto pool_metrics = _toolService->get_mcp_pool_metrics();
+
         nlohmann::json response;
-        for (const auto& server : tools_per_server) {
+        for (const auto& server : catalog->tools_per_server) {
             nlohmann::json server_entry;
             server_entry["server_url"] = server.first;
             server_entry["tools"] = server.second;
+            server_entry["connection"] = pool_metrics.value(server.first, nlohmann::json());
             response.push_back(server_entry);
         }
         
-        return {{"servers", response}};
+        return {{"servers", response}, {"routing", _toolService->get_routing_stats()}};
     }
     
     // Agent loop endpoints
@@ -145,6 +180,9 @@ namespace controller {
             loop_json["final_response"] = loop.final_response;
             loop_json["completed"] = loop.completed;
             loop_json["duration_seconds"] = loop.duration_seconds;
+            if (loop.time_to_first_token_seconds >= 0) {
+                loop_json["time_to_first_token_seconds"] = loop.time_to_first_token_seconds;
+            }
             
             // Convert times to ISO string
             auto start_time_t = std::chrono::system_clock::to_time_t(loop.start_time);
@@ -4,6 +4,7 @@
 
 #include "lily/LilyApplication.hpp"
 #include "lily/services/AgentLoopService.hpp"
+#include "lily/services/GeminiClient.hpp"
 #include "lily/services/ChatService.hpp"
 #include "lily/services/MemoryService.hpp"
 #include "lily/services/Service.hpp"
@@ -41,15 +42,26 @@ void signal_handler(int signal) {
 /**
  * @brief Memory Service Bean Configuration
  */
-std::shared_ptr<MemoryService> createMemoryService() {
-    return std::make_shared<MemoryService>();
+std::shared_ptr<MemoryService> createMemoryService(lily::config::AppConfig& config) {
+    auto service = std::make_shared<MemoryService>();
+    service->set_history_limit(config.max_history_tokens);
+    if (!config.memory_data_dir.empty()) {
+        // Replays the snapshot and log before any request can reach the store
+        service->set_journal(std::make_shared<MemoryJournal>(
+            config.memory_data_dir, std::chrono::milliseconds(config.memory_wal_flush_ms), config.memory_snapshot_wal_bytes));
+    }
+    return service;
 }
 
 /**
  * @brief Service (Tool) Bean Configuration
  */
-std::shared_ptr<Service> createToolService() {
+std::shared_ptr<Service> createToolService(lily::config::AppConfig& config) {
     auto service = std::make_shared<Service>();
+    service->set_discovery_limits(config.discovery_concurrency, std::chrono::seconds(config.discovery_timeout_seconds));
+    service->set_watch_intervals(std::chrono::seconds(config.consul_watch_wait_seconds), std::chrono::seconds(config.tools_refresh_seconds));
+    service->set_mcp_pool_limits(config.mcp_max_in_flight, std::chrono::seconds(config.mcp_idle_timeout_seconds));
+    // Consul watch runs on its own thread; startup does not wait for the first answers
     service->start_periodic_discovery();
     return service;
 }
@@ -62,15 +74,32 @@ std::shared_ptr<lily::utils::ThreadPool> createThreadPool() {
     return std::make_shared<lily::utils::ThreadPool>();
 }
 
+/**
+ * @brief Gemini Client Bean Configuration
+ */
+std::shared_ptr<GeminiClient> createGeminiClient(lily::config::AppConfig& config) {
+    return std::make_shared<GeminiClient>(config);
+}
+
 /**
  * @brief Agent Loop Service Bean Configuration
  */
 std::shared_ptr<AgentLoopService> createAgentLoopService(
     std::shared_ptr<MemoryService> memory_service,
     std::shared_ptr<Service> tool_service,
+    std::shared_ptr<GeminiClient> gemini_client,
     lily::config::AppConfig& config
 ) {
-    return std::make_shared<AgentLoopService>(*memory_service, *tool_service, config);
+    auto service = std::make_shared<AgentLoopService>(*memory_service, *tool_service, *gemini_client, config);
+    if (config.getGeminiApiKeyCount() > 0) {
+        // Weak, so the memory service does not keep the agent loop alive
+        std::weak_ptr<AgentLoopService> summarizer = service;
+        memory_service->set_summarizer([summarizer](const std::string& previous_summary, const std::vector<lily::services::Message>& turns, size_t max_tokens) {
+            auto agent_loop = summarizer.lock();
+            return agent_loop ? agent_loop->summarize_turns(previous_summary, turns, max_tokens) : std::string();
+        }, config.summary_threshold_tokens, config.summary_keep_recent_tokens, config.summary_max_tokens);
+    }
+    return service;
 }
 
 /**
@@ -90,15 +119,26 @@ std::shared_ptr<SessionService> createSessionService(std::shared_ptr<GatewayServ
 /**
  * @brief TTS Service Bean Configuration
  */
-std::shared_ptr<TTSService> createTTSService() {
-    return std::make_shared<TTSService>();
+std::shared_ptr<TTSService> createTTSService(lily::config::AppConfig& config) {
+    auto service = std::make_shared<TTSService>();
+    service->set_pool_limits(config.tts_pool_size, config.tts_max_queue, std::chrono::seconds(config.tts_request_timeout_seconds));
+    service->set_close_ends_utterance(config.tts_close_ends_utterance);
+    if (config.tts_cache_max_bytes > 0) {
+        service->set_cache(std::make_shared<TTSCache>(
+            config.tts_cache_max_bytes, config.tts_cache_dir, config.tts_cache_disk_max_bytes));
+    }
+    return service;
 }
 
 /**
  * @brief Echo Service Bean Configuration
  */
-std::shared_ptr<EchoService> createEchoService() {
-    return std::make_shared<EchoService>();
+std::shared_ptr<EchoService> createEchoService(lily::config::AppConfig& config) {
+    auto service = std::make_shared<EchoService>();
+    service->set_uplink_limits(std::chrono::milliseconds(config.echo_packet_ms),
+                               std::chrono::milliseconds(config.echo_jitter_buffer_ms),
+                               config.echo_audio_bytes_per_second);
+    return service;
 }
 
 /**
@@ -155,13 +195,17 @@ void connect_services_async(
     std::shared_ptr<TTSService> tts_service,
     std::shared_ptr<EchoService> echo_service,
     std::shared_ptr<Service> tool_service,
+    std::shared_ptr<GatewayService> gateway_service,
     std::atomic<bool>& tts_available,
     std::atomic<bool>& echo_available
 ) {
+    // Echo's transcription socket is owned by the gateway; like the other providers it is
+    // connected once discovery has found it rather than only at startup
+    bool echo_stream_connected = false;
     std::cout << "[ServiceConnector] Starting background service discovery..." << std::endl;
     int retry_count = 0;
     while (true) {
-        if (!tts_available || !echo_available) {
+        if (!tts_available || !echo_available || !echo_stream_connected) {
             if (!tts_available) {
                 // Try to get TTS URL (prefer WebSocket if available)
                 std::string tts_url = tool_service->getServiceUrl("tts-provider", "ws");
@@ -184,6 +228,19 @@ void connect_services_async(
                     }
                 }
             }
+
+            if (!echo_stream_connected) {
+                std::string echo_websocket_url = tool_service->getServiceUrl("echo", "ws");
+                if (!echo_websocket_url.empty()) {
+                    echo_websocket_url += "/ws/transcribe";
+                    std::cout << "[ServiceConnector] Found Echo WebSocket endpoint at " << echo_websocket_url << std::endl;
+                    if (gateway_service->connect_to_echo(echo_websocket_url)) {
+                        echo_stream_connected = true;
+                    } else {
+                        std::cerr << "[ServiceConnector] Failed to connect to Echo service" << std::endl;
+                    }
+                }
+            }
         }
         
         std::this_thread::sleep_for(std::chrono::seconds(retry_count < 5 ? 2 : 10));
@@ -220,8 +277,8 @@ int main(int argc, char** argv) {
     config.loadFromFile();
 
     // Register beans
-    context->registerBean("memoryService", createMemoryService());
-    context->registerBean("toolService", createToolService());
+    context->registerBean("memoryService", createMemoryService(config));
+    context->registerBean("toolService", createToolService(config));
     context->registerBean("threadPool", createThreadPool()); // Register ThreadPool
     
     // Get dependencies
@@ -230,7 +287,10 @@ int main(int argc, char** argv) {
     auto thread_pool = context->getBeanByName<lily::utils::ThreadPool>("threadPool");
     
     // Create and register other beans
-    auto agent_loop_service = createAgentLoopService(memory_service, tool_service, config);
+    auto gemini_client = createGeminiClient(config);
+    context->registerBean("geminiClient", gemini_client);
+    
+    auto agent_loop_service = createAgentLoopService(memory_service, tool_service, gemini_client, config);
     context->registerBean("agentLoopService", agent_loop_service);
     
     auto gateway_service = createGatewayService();
@@ -239,10 +299,10 @@ int main(int argc, char** argv) {
     auto session_service = createSessionService(gateway_service);
     context->registerBean("sessionService", session_service);
     
-    auto tts_service = createTTSService();
+    auto tts_service = createTTSService(config);
     context->registerBean("ttsService", tts_service);
     
-    auto echo_service = createEchoService();
+    auto echo_service = createEchoService(config);
     context->registerBean("echoService", echo_service);
     
     auto chat_service = createChatService(
@@ -260,6 +320,10 @@ int main(int argc, char** argv) {
     // Create Controllers
     auto system_controller = createSystemController(config, tool_service);
     system_controller->setAgentLoopService(agent_loop_service.get());
+    system_controller->setGeminiClient(gemini_client.get());
+    system_controller->setTTSService(tts_service.get());
+    system_controller->setEchoService(echo_service.get());
+    system_controller->setMemoryService(memory_service.get());
     auto session_controller = createSessionController(session_service, gateway_service);
     auto chat_controller = createChatController(chat_service, agent_loop_service, memory_service);
 
@@ -280,12 +344,6 @@ int main(int argc, char** argv) {
     std::atomic<bool> tts_available{false};
     std::atomic<bool> echo_available{false};
     
-    // Start background service connector
-    std::thread service_connector(connect_services_async, 
-                                   tts_service, echo_service, tool_service,
-                                   std::ref(tts_available), std::ref(echo_available));
-    service_connector.detach();
-    
     // Check for Gemini API
     bool gemini_available = config.getGeminiApiKeyCount() > 0;
     if (!gemini_available) {
@@ -297,8 +355,8 @@ int main(int argc, char** argv) {
     // Start Unified Server (HTTP + WebSocket)
     std::cout << "[Main] Starting Unified Server on port " << config.http_port << "..." << std::endl;
     
-    gateway_service->set_binary_message_handler([chat_service](const std::vector<uint8_t>& data, const std::string& user_id) {
-        chat_service->handle_audio_stream(data, user_id);
+    gateway_service->set_binary_message_handler([chat_service](const lily::utils::SharedBytes& frame, const std::string& user_id) {
+        chat_service->handle_audio_stream(frame, user_id);
     });
     
     gateway_service->set_port(config.http_port);
@@ -350,48 +408,22 @@ int main(int argc, char** argv) {
         }
     });
     
-    // Set Echo message handler
-    gateway_service->set_echo_message_handler([&chat_service, &gateway_service](const nlohmann::json& message) {
+    // Set Echo message handler: transcripts go to the user named by client_id only
+    gateway_service->set_echo_message_handler([chat_service](const nlohmann::json& message) {
         try {
-            std::string message_type = message["type"];
-            std::string text = message["text"];
-            
-            if (message_type == "interim") {
-                std::cout << "Interim transcription: " << text << std::endl;
-                nlohmann::json ui_message = {
-                    {"type", "interim"},
-                    {"text", text}
-                };
-                gateway_service->broadcast("transcription:" + ui_message.dump());
-            } else if (message_type == "final") {
-                std::cout << "Final transcription: " << text << std::endl;
-                nlohmann::json ui_message = {
-                    {"type", "final"},
-                    {"text", text}
-                };
-                gateway_service->broadcast("transcription:" + ui_message.dump());
-                
-                // ASYNC handling for voice command
-                chat_service->handle_chat_message_async(text, "default_user", nullptr); 
+            if (message.contains("type") && message.contains("text")) {
+                chat_service->handle_transcription(message, message.value("client_id", ""));
             }
         } catch (const std::exception& e) {
             std::cerr << "Error processing Echo message: " << e.what() << std::endl;
         }
     });
     
-    std::string echo_websocket_url = tool_service->getServiceUrl("echo", "ws");
-    if (!echo_websocket_url.empty()) {
-        echo_websocket_url += "/ws/transcribe";
-        std::cout << "Found Echo WebSocket endpoint at " << echo_websocket_url << std::endl;
-    }
-    
-    if (!echo_websocket_url.empty()) {
-        if (!gateway_service->connect_to_echo(echo_websocket_url)) {
-            std::cerr << "Failed to connect to Echo service" << std::endl;
-        }
-    } else {
-        std::cerr << "Echo service not found. Audio transcription will not work." << std::endl;
-    }
+    // Start background service connector (after the Echo handler is installed)
+    std::thread service_connector(connect_services_async, 
+                                   tts_service, echo_service, tool_service, gateway_service,
+                                   std::ref(tts_available), std::ref(echo_available));
+    service_connector.detach();
     
     gateway_service->run();
     
@@ -2,10 +2,9 @@
 #include <lily/services/MemoryService.hpp>
 #include <lily/services/Service.hpp>
 #include <lily/models/AgentLoop.hpp>
-#include <cpprest/http_client.h>
-#include <cpprest/json.h>
 #include <iostream>
 #include <cstdlib>
+#include <cstring>
 #include <sstream>
 #include <mutex>
 #include <map>
@@ -15,67 +14,83 @@
 
 namespace lily {
     namespace services {
-        AgentLoopService::AgentLoopService(MemoryService& memoryService, Service& toolService, config::AppConfig& config)
-            : _memoryService(memoryService), _toolService(toolService), _config(config) {}
+        struct AgentLoopService::LoopState {
+            lily::models::AgentLoop current_loop;
+            size_t tool_count = 0;
+            GeminiRequestBuilder request; // history and tools, serialized as they are added
+            int step_number = 1;
+            DeltaCallback on_delta;       // null when the caller does not stream
+            bool first_token_seen = false;
+        };
+
+        AgentLoopService::AgentLoopService(MemoryService& memoryService, Service& toolService, GeminiClient& geminiClient, config::AppConfig& config)
+            : _memoryService(memoryService), _toolService(toolService), _geminiClient(geminiClient), _config(config) {}
 
         std::string AgentLoopService::run_loop(const std::string& user_message, const std::string& user_id) {
+            return run_loop_async(user_message, user_id).get();
+        }
+
+        pplx::task<std::string> AgentLoopService::run_loop_async(const std::string& user_message, const std::string& user_id, DeltaCallback on_delta) {
             if (_config.getGeminiApiKeyCount() == 0) {
                 std::cerr << "GEMINI_API_KEY not configured" << std::endl;
-                return "Error: GEMINI_API_KEY not configured";
+                return pplx::task_from_result(std::string("Error: GEMINI_API_KEY not configured"));
+            }
+
+            auto state = begin_loop(user_message, user_id, on_delta);
+
+            // Process the message with step-based agent loop
+            return run_steps_async(state).then([this, state](pplx::task<std::string> previous) {
+                std::string response;
+                try {
+                    response = previous.get();
+                } catch (const std::exception& e) {
+                    std::cerr << "[AGENT LOOP] Error during agent loop: " << e.what() << std::endl;
+                    response = "I'm having trouble processing this request. Please try again with a simpler question.";
+                }
+                finish_loop(*state, response);
+                return response;
+            });
+        }
+
+        std::shared_ptr<AgentLoopService::LoopState> AgentLoopService::begin_loop(const std::string& user_message, const std::string& user_id, DeltaCallback on_delta) {
+            auto state = std::make_shared<LoopState>();
+            if (_config.gemini_streaming) {
+                state->on_delta = std::move(on_delta);
             }
 
             // Create a new agent loop
-            lily::models::AgentLoop current_loop;
+            lily::models::AgentLoop& current_loop = state->current_loop;
             current_loop.user_id = user_id;
             current_loop.user_message = user_message;
             current_loop.start_time = std::chrono::system_clock::now();
             current_loop.completed = false;
+            current_loop.time_to_first_token_seconds = -1;
 
             std::cout << "[AGENT LOOP] Starting agent loop for user: " << user_id << std::endl;
             std::cout << "[AGENT LOOP] User message: " << user_message << std::endl;
 
-            // Process the message with step-based agent loop
-            std::string response = process_with_tools(user_message, user_id, current_loop);
-
-            // Complete the agent loop
-            current_loop.end_time = std::chrono::system_clock::now();
-            current_loop.final_response = response;
-            current_loop.completed = true;
+            // Get available tools; their Gemini declarations are pre-rendered per discovery generation
+            auto catalog = _toolService.get_tool_catalog();
+            state->tool_count = catalog->tools.size();
+            state->request.set_tools_fragment(catalog->gemini_tools);
+            std::cout << "[AGENT LOOP] Available tools count: " << state->tool_count
+                      << " (catalog generation " << catalog->generation << ")" << std::endl;
             
-            // Calculate duration in seconds
-            auto duration = std::chrono::duration_cast<std::chrono::duration<double>>(
-                current_loop.end_time - current_loop.start_time
-            );
-            current_loop.duration_seconds = duration.count();
-
-            std::cout << "[AGENT LOOP] Completed agent loop with final response: " << response << std::endl;
-            std::cout << "[AGENT LOOP] Total steps executed: " << current_loop.steps.size() << std::endl;
-            std::cout << "[AGENT LOOP] Total time taken: " << current_loop.duration_seconds << " seconds" << std::endl;
-
-            // Store the agent loop per user
-            {
-                std::lock_guard<std::mutex> lock(_agentLoopsMutex);
-                auto& userLoops = _agentLoopsPerUser[user_id];
-                userLoops.push_back(current_loop);
-                // Keep only the last 10 agent loops per user to prevent memory issues
-                if (userLoops.size() > 10) {
-                    userLoops.erase(userLoops.begin());
-                }
+            // Build conversation context from the newest turns that fit the token budget
+            auto window = _memoryService.get_context_window(user_id, _config.max_context_tokens);
+            const char* summary_heading = "Summary of earlier conversation:\n";
+            std::string context;
+            size_t context_size = std::strlen(summary_heading) + window.summary.size() + 24;
+            for (const auto& msg : window.messages) {
+                context_size += role_name(msg.role).size() + msg.content.size() + 3;
             }
-
-            return response;
-        }
-
-        std::string AgentLoopService::process_with_tools(const std::string& user_message, const std::string& user_id, lily::models::AgentLoop& current_loop) {
-            // Get available tools
-            auto available_tools = _toolService.get_available_tools();
-            std::cout << "[AGENT LOOP] Available tools count: " << available_tools.size() << std::endl;
-            
-            // Build conversation context
-            auto conversation = _memoryService.get_conversation(user_id);
-            std::string context = "Conversation history:\n";
-            for (const auto& msg : conversation) {
-                context += msg.role + ": " + msg.content + "\n";
+            context.reserve(context_size);
+            if (!window.summary.empty()) {
+                context.append(summary_heading).append(window.summary).append("\n\n");
+            }
+            context.append("Conversation history:\n");
+            for (const auto& msg : window.messages) {
+                context.append(role_name(msg.role)).append(": ").append(msg.content).append("\n");
             }
             
             // Initial Prompt with context
@@ -97,316 +112,293 @@ namespace lily {
             initial_prompt += "If you can answer directly or have completed the task, provide your final response.\n";
 
             // Initialize conversation history for Gemini
-            nlohmann::json conversation_history = nlohmann::json::array();
-            
-            nlohmann::json user_turn = nlohmann::json::object();
-            user_turn["role"] = "user";
-            user_turn["parts"] = nlohmann::json::array();
+            nlohmann::json user_parts = nlohmann::json::array();
             nlohmann::json text_part;
             text_part["text"] = initial_prompt;
-            user_turn["parts"].push_back(text_part);
-            
-            conversation_history.push_back(user_turn);
+            user_parts.push_back(text_part);
 
-            int step_number = 1;
-            std::string final_response;
+            state->request.append_turn("user", user_parts);
 
             std::cout << "[AGENT LOOP] Starting step-based processing" << std::endl;
+            return state;
+        }
+
+        void AgentLoopService::finish_loop(LoopState& state, const std::string& response) {
+            lily::models::AgentLoop& current_loop = state.current_loop;
+
+            // Complete the agent loop
+            current_loop.end_time = std::chrono::system_clock::now();
+            current_loop.final_response = response;
+            current_loop.completed = true;
+            
+            // Calculate duration in seconds
+            auto duration = std::chrono::duration_cast<std::chrono::duration<double>>(
+                current_loop.end_time - current_loop.start_time
+            );
+            current_loop.duration_seconds = duration.count();
+
+            std::cout << "[AGENT LOOP] Completed agent loop with final response: " << response << std::endl;
+            std::cout << "[AGENT LOOP] Total steps executed: " << current_loop.steps.size() << std::endl;
+            if (current_loop.time_to_first_token_seconds >= 0) {
+                std::cout << "[AGENT LOOP] Time to first token: " << current_loop.time_to_first_token_seconds << " seconds" << std::endl;
+            }
+            std::cout << "[AGENT LOOP] Total time taken: " << current_loop.duration_seconds << " seconds" << std::endl;
+
+            // Store the agent loop per user
+            {
+                std::lock_guard<std::mutex> lock(_agentLoopsMutex);
+                auto& userLoops = _agentLoopsPerUser[current_loop.user_id];
+                userLoops.push_back(std::move(current_loop));
+                // Keep only the last 10 agent loops per user to prevent memory issues
+                if (userLoops.size() > 10) {
+                    userLoops.erase(userLoops.begin());
+                }
+            }
+        }
+
+        pplx::task<std::string> AgentLoopService::run_steps_async(std::shared_ptr<LoopState> state) {
+            std::cout << "[AGENT LOOP] Executing step " << state->step_number << std::endl;
+
+            // Agent loop: each step re-schedules the next one until the LLM decides to respond
+            return execute_agent_step_async(state).then([this, state](std::string step_result) -> pplx::task<std::string> {
+                const auto& steps = state->current_loop.steps;
+                int step_number = state->step_number;
 
-            // Agent loop: continue until LLM decides to respond
-            while (true) {
-                std::cout << "[AGENT LOOP] Executing step " << step_number << std::endl;
-                std::string step_result = execute_agent_step(available_tools, conversation_history, current_loop, step_number);
-                
                 // Check the type of the last step
-                if (!current_loop.steps.empty() && current_loop.steps.back().type == lily::models::AgentStepType::RESPONSE) {
+                if (!steps.empty() && steps.back().type == lily::models::AgentStepType::RESPONSE) {
                     // LLM decided to give final response
-                    final_response = step_result;
                     std::cout << "[AGENT LOOP] Step " << step_number << ": LLM decided to give final response" << std::endl;
-                    break;
-                } else {
-                    // Tool was called, we continue the loop
-                    // The function response has already been appended to conversation_history in execute_agent_step
-                    std::cout << "[AGENT LOOP] Step " << step_number << ": Tool executed, result: " << step_result << std::endl;
-                    step_number++;
-                    
-                    // Add safety check to prevent infinite loops
-                    if (step_number > 20) {
-                        std::cerr << "[AGENT LOOP] WARNING: Exceeded maximum step limit (20), breaking loop" << std::endl;
-                        final_response = "I'm having trouble processing this request. Please try again with a simpler question.";
-                        break;
-                    }
+                    std::cout << "[AGENT LOOP] Processing completed after " << step_number << " steps" << std::endl;
+                    return pplx::task_from_result(step_result);
                 }
-            }
 
-            std::cout << "[AGENT LOOP] Processing completed after " << (step_number - 1) << " steps" << std::endl;
-            return final_response;
+                // Tool was called, we continue the loop
+                // execute_agent_step_async has already added the function response to state->request
+                std::cout << "[AGENT LOOP] Step " << step_number << ": Tool executed, result: " << step_result << std::endl;
+                state->step_number++;
+                
+                // Add safety check to prevent infinite loops
+                if (state->step_number > 20) {
+                    std::cerr << "[AGENT LOOP] WARNING: Exceeded maximum step limit (20), breaking loop" << std::endl;
+                    return pplx::task_from_result(std::string("I'm having trouble processing this request. Please try again with a simpler question."));
+                }
+                return run_steps_async(state);
+            });
         }
 
-        std::string AgentLoopService::execute_agent_step(const std::vector<nlohmann::json>& available_tools,
-                                                     nlohmann::json& conversation_history,
-                                                     lily::models::AgentLoop& current_loop,
-                                                     int step_number) {
-            // Create step
-            lily::models::AgentStep step;
-            step.step_number = step_number;
-            step.timestamp = std::chrono::system_clock::now();
+        pplx::task<std::string> AgentLoopService::execute_agent_step_async(std::shared_ptr<LoopState> state) {
+            int step_number = state->step_number;
             auto step_start_time = std::chrono::system_clock::now();
 
-            std::cout << "[AGENT LOOP] Step " << step_number << ": Sending request to Gemini with history size " << conversation_history.size() << std::endl;
+            std::cout << "[AGENT LOOP] Step " << step_number << ": Sending request to Gemini with history size " << state->request.turn_count() << std::endl;
 
             // Call Gemini with the history
-            auto response = call_gemini_with_tools(conversation_history, available_tools);
-            
-            // Calculate step duration
-            auto step_end_time = std::chrono::system_clock::now();
-            auto step_duration = std::chrono::duration_cast<std::chrono::duration<double>>(
-                step_end_time - step_start_time
-            );
-            step.duration_seconds = step_duration.count();
-            
-            std::cout << "[AGENT LOOP] Step " << step_number << ": Received response from Gemini (took " << step.duration_seconds << "s)" << std::endl;
-            
-            if (response.contains("candidates") && response["candidates"].is_array() && response["candidates"].size() > 0) {
-                auto candidate = response["candidates"][0];
-                if (candidate.contains("content")) {
-                    auto content = candidate["content"];
-                    if (content.contains("parts") && content["parts"].is_array() && content["parts"].size() > 0) {
-                        
-                        // Append the model's turn to conversation history
-                        nlohmann::json model_turn = nlohmann::json::object();
-                        model_turn["role"] = "model";
-                        model_turn["parts"] = content["parts"]; // Keep the parts structure including function calls
-                        conversation_history.push_back(model_turn);
-
-                        bool tool_called = false;
-                        std::string text_response;
-
-                        // Iterate through parts to find function calls or text
-                        for (const auto& part : content["parts"]) {
-                            if (part.contains("functionCall")) {
-                                auto function_call = part["functionCall"];
-                                step.type = lily::models::AgentStepType::TOOL_CALL;
-                                step.tool_name = function_call["name"].get<std::string>();
-                                step.tool_parameters = function_call.value("args", nlohmann::json::object());
-                                step.reasoning = "Gemini native function call";
-                                
-                                std::cout << "[AGENT LOOP] Step " << step_number << ": Calling tool: " << step.tool_name << std::endl;
-                                std::cout << "[AGENT LOOP] Step " << step_number << ": Tool parameters: " << step.tool_parameters.dump() << std::endl;
-                                
-                                // Execute the tool
-                                step.tool_result = _toolService.execute_tool(step.tool_name, step.tool_parameters);
-                                
-                                std::cout << "[AGENT LOOP] Step " << step_number << ": Tool result: " << step.tool_result.dump() << std::endl;
-                                
-                                // Add step to loop
-                                current_loop.steps.push_back(step);
-                                
-                                // Append function response to conversation history (Function Turn)
-                                nlohmann::json function_turn = nlohmann::json::object();
-                                function_turn["role"] = "function";
-                                function_turn["parts"] = nlohmann::json::array();
-                                
-                                nlohmann::json function_response_part = nlohmann::json::object();
-                                nlohmann::json function_response = nlohmann::json::object();
-                                function_response["name"] = step.tool_name;
-                                
-                                // Gemini expects 'response' field with keys and values
-                                nlohmann::json response_content = nlohmann::json::object();
-                                response_content["name"] = step.tool_name; // Redundant but safe
-                                response_content["content"] = step.tool_result;
-                                
-                                function_response["response"] = response_content;
-                                function_response_part["functionResponse"] = function_response;
-                                
-                                function_turn["parts"].push_back(function_response_part);
-                                conversation_history.push_back(function_turn);
-
-                                tool_called = true;
-                                return step.tool_result.dump();
-                            } else if (part.contains("text")) {
-                                text_response += part["text"].get<std::string>();
+            return call_gemini_with_tools_async(state)
+                .then([this, state, step_number, step_start_time](nlohmann::json response) -> pplx::task<std::string> {
+                // Create step
+                lily::models::AgentStep step;
+                step.step_number = step_number;
+                step.timestamp = step_start_time;
+                
+                // Calculate step duration
+                auto step_end_time = std::chrono::system_clock::now();
+                auto step_duration = std::chrono::duration_cast<std::chrono::duration<double>>(
+                    step_end_time - step_start_time
+                );
+                step.duration_seconds = step_duration.count();
+                
+                std::cout << "[AGENT LOOP] Step " << step_number << ": Received response from Gemini (took " << step.duration_seconds << "s)" << std::endl;
+                
+                if (response.contains("candidates") && response["candidates"].is_array() && response["candidates"].size() > 0) {
+                    auto& candidate = response["candidates"][0];
+                    if (candidate.contains("content")) {
+                        auto& content = candidate["content"];
+                        if (content.contains("parts") && content["parts"].is_array() && content["parts"].size() > 0) {
+                            
+                            // Append the model's turn to conversation history
+                            state->request.append_turn("model", content["parts"]); // Keep the parts structure including function calls
+
+                            std::string text_response;
+                            std::vector<lily::models::AgentStep> tool_calls;
+
+                            // Iterate through parts to find function calls or text; Gemini may emit
+                            // several independent function calls in one turn
+                            for (const auto& part : content["parts"]) {
+                                if (part.contains("functionCall")) {
+                                    const auto& function_call = part["functionCall"];
+                                    lily::models::AgentStep call = step;
+                                    call.type = lily::models::AgentStepType::TOOL_CALL;
+                                    call.tool_name = function_call["name"].get<std::string>();
+                                    call.tool_parameters = function_call.value("args", nlohmann::json::object());
+                                    call.reasoning = "Gemini native function call";
+
+                                    std::cout << "[AGENT LOOP] Step " << step_number << ": Calling tool: " << call.tool_name << std::endl;
+                                    std::cout << "[AGENT LOOP] Step " << step_number << ": Tool parameters: " << call.tool_parameters.dump() << std::endl;
+                                    tool_calls.push_back(std::move(call));
+                                } else if (part.contains("text")) {
+                                    text_response += part["text"].get<std::string>();
+                                }
+                            }
+
+                            if (!tool_calls.empty()) {
+                                if (tool_calls.size() > 1) {
+                                    std::cout << "[AGENT LOOP] Step " << step_number << ": Running " << tool_calls.size() << " tool calls concurrently" << std::endl;
+                                }
+
+                                // Execute every tool at once; the loop resumes when all tool servers have answered
+                                std::vector<pplx::task<nlohmann::json>> executions;
+                                for (const auto& call : tool_calls) {
+                                    std::string tool_name = call.tool_name;
+                                    executions.push_back(_toolService.execute_tool_async(call.tool_name, call.tool_parameters)
+                                        .then([tool_name](pplx::task<nlohmann::json> result_task) {
+                                        // One failed call must not discard the others' results
+                                        try {
+                                            return result_task.get();
+                                        } catch (const std::exception& e) {
+                                            return nlohmann::json{
+                                                {"status", "error"},
+                                                {"message", std::string("Exception: ") + e.what()},
+                                                {"tool_name", tool_name}
+                                            };
+                                        }
+                                    }));
+                                }
+
+                                return pplx::when_all(executions.begin(), executions.end())
+                                    .then([state, tool_calls, step_number](std::vector<nlohmann::json> tool_results) mutable {
+                                    // Append every function response, in call order, as one Function Turn
+                                    nlohmann::json function_parts = nlohmann::json::array();
+                                    std::string result_str;
+
+                                    for (size_t i = 0; i < tool_calls.size(); ++i) {
+                                        auto& call = tool_calls[i];
+                                        call.tool_result = std::move(tool_results[i]);
+
+                                        std::cout << "[AGENT LOOP] Step " << step_number << ": Tool result (" << call.tool_name << "): " << call.tool_result.dump() << std::endl;
+
+                                        nlohmann::json function_response_part = nlohmann::json::object();
+                                        nlohmann::json function_response = nlohmann::json::object();
+                                        function_response["name"] = call.tool_name;
+
+                                        // Gemini expects 'response' field with keys and values
+                                        nlohmann::json response_content = nlohmann::json::object();
+                                        response_content["name"] = call.tool_name; // Redundant but safe
+                                        response_content["content"] = call.tool_result;
+
+                                        function_response["response"] = response_content;
+                                        function_response_part["functionResponse"] = function_response;
+                                        function_parts.push_back(std::move(function_response_part));
+
+                                        if (!result_str.empty()) result_str += "\n";
+                                        result_str += call.tool_result.dump();
+                                    }
+                                    state->request.append_turn("function", function_parts);
+
+                                    // Add one step per tool call to the loop
+                                    for (auto& call : tool_calls) {
+                                        state->current_loop.steps.push_back(std::move(call));
+                                    }
+                                    return result_str;
+                                });
                             }
-                        }
 
-                        if (!tool_called) {
                             // No tool call, treat as final response
                             std::cout << "[AGENT LOOP] Step " << step_number << ": LLM response: " << text_response << std::endl;
                             
                             step.type = lily::models::AgentStepType::RESPONSE;
                             step.reasoning = "Direct response";
-                            current_loop.steps.push_back(step);
-                            return text_response;
+                            state->current_loop.steps.push_back(step);
+                            return pplx::task_from_result(text_response);
+                        } else {
+                            std::cerr << "[AGENT LOOP] Step " << step_number << ": No parts in content" << std::endl;
                         }
                     } else {
-                        std::cerr << "[AGENT LOOP] Step " << step_number << ": No parts in content" << std::endl;
+                        std::cerr << "[AGENT LOOP] Step " << step_number << ": No content in candidate" << std::endl;
                     }
                 } else {
-                    std::cerr << "[AGENT LOOP] Step " << step_number << ": No content in candidate" << std::endl;
+                    std::cerr << "[AGENT LOOP] Step " << step_number << ": No candidates in response or empty candidates array" << std::endl;
+                    std::cout << "[AGENT LOOP] Step " << step_number << ": Full response: " << response.dump() << std::endl;
                 }
-            } else {
-                std::cerr << "[AGENT LOOP] Step " << step_number << ": No candidates in response or empty candidates array" << std::endl;
-                std::cout << "[AGENT LOOP] Step " << step_number << ": Full response: " << response.dump() << std::endl;
-            }
 
-            // Fallback: thinking step
-            std::cout << "[AGENT LOOP] Step " << step_number << ": Falling back to thinking step" << std::endl;
-            step.type = lily::models::AgentStepType::THINKING;
-            step.reasoning = "Analyzing request...";
-            current_loop.steps.push_back(step);
-            return "Continue analysis";
+                // Fallback: thinking step
+                std::cout << "[AGENT LOOP] Step " << step_number << ": Falling back to thinking step" << std::endl;
+                step.type = lily::models::AgentStepType::THINKING;
+                step.reasoning = "Analyzing request...";
+                state->current_loop.steps.push_back(step);
+                return pplx::task_from_result(std::string("Continue analysis"));
+            });
         }
 
-        // Helper function to convert MCP tool schema to Gemini tool schema
-        web::json::value convert_mcp_tool_to_gemini_format(const nlohmann::json& mcp_tool) {
-            web::json::value gemini_tool = web::json::value::object();
-            
-            // Gemini expects function declarations with specific fields
-            web::json::value function_decl = web::json::value::object();
-            
-            // Map MCP tool fields to Gemini function declaration fields
-            if (mcp_tool.contains("name")) {
-                function_decl["name"] = web::json::value::string(mcp_tool["name"].get<std::string>());
+        pplx::task<nlohmann::json> AgentLoopService::call_gemini_with_tools_async(std::shared_ptr<LoopState> state) {
+            // Build the body once; only the API key in the URL changes between attempts
+            auto body = std::make_shared<const std::string>(state->request.build_body());
+
+            if (state->tool_count > 0) {
+                std::cout << "[GEMINI API] Sending request with " << state->tool_count << " tools (" << body->size() << " bytes)" << std::endl;
+            } else {
+                std::cout << "[GEMINI API] Sending request without tools (" << body->size() << " bytes)" << std::endl;
             }
-            
-            if (mcp_tool.contains("description")) {
-                function_decl["description"] = web::json::value::string(mcp_tool["description"].get<std::string>());
+
+            if (!state->on_delta) {
+                return _geminiClient.generate_content(body);
             }
-            
-            // Convert inputSchema to parameters
-            if (mcp_tool.contains("inputSchema") && mcp_tool["inputSchema"].is_object()) {
-                web::json::value parameters = web::json::value::object();
-                parameters["type"] = web::json::value::string("OBJECT");
-                
-                web::json::value properties = web::json::value::object();
-                web::json::value required = web::json::value::array();
-                
-                const auto& input_schema = mcp_tool["inputSchema"];
-                if (input_schema.contains("properties") && input_schema["properties"].is_object()) {
-                    const auto& props = input_schema["properties"];
-                    for (auto it = props.begin(); it != props.end(); ++it) {
-                        web::json::value prop = web::json::value::object();
-                        prop["type"] = web::json::value::string(it.value().value("type", "string"));
-                        
-                        if (it.value().contains("description")) {
-                            prop["description"] = web::json::value::string(it.value()["description"].get<std::string>());
-                        }
-                        
-                        properties[utility::conversions::to_string_t(it.key())] = prop;
-                    }
-                }
-                
-                if (input_schema.contains("required") && input_schema["required"].is_array()) {
-                    const auto& req = input_schema["required"];
-                    for (size_t i = 0; i < req.size(); i++) {
-                        required[i] = web::json::value::string(req[i].get<std::string>());
-                    }
-                }
-                
-                parameters["properties"] = properties;
-                if (required.size() > 0) {
-                    parameters["required"] = required;
+
+            int step_number = state->step_number;
+            return _geminiClient.stream_generate_content(body, [state, step_number](const std::string& text) {
+                if (!state->first_token_seen) {
+                    state->first_token_seen = true;
+                    auto& loop = state->current_loop;
+                    loop.time_to_first_token_seconds = std::chrono::duration_cast<std::chrono::duration<double>>(
+                        std::chrono::system_clock::now() - loop.start_time
+                    ).count();
                 }
-                
-                function_decl["parameters"] = parameters;
-            }
-            
-            gemini_tool["functionDeclarations"] = web::json::value::array(1);
-            gemini_tool["functionDeclarations"][0] = function_decl;
-            
-            return gemini_tool;
+                state->on_delta(text, step_number);
+            });
         }
 
-        nlohmann::json AgentLoopService::call_gemini_with_tools(const nlohmann::json& contents, const std::vector<nlohmann::json>& tools) {
-            size_t max_retries = _config.getGeminiApiKeyCount();
-            if (max_retries == 0) {
-                std::cerr << "[GEMINI API] Error: No GEMINI_API_KEY configured" << std::endl;
-                return nlohmann::json::object();
+        std::string AgentLoopService::summarize_turns(const std::string& previous_summary, const std::vector<Message>& turns, size_t max_tokens) {
+            std::string prompt = turns.empty()
+                ? "Shorten the running summary of a conversation between a user and an AI assistant. "
+                : "Update the running summary of a conversation between a user and an AI assistant. ";
+            prompt += "Keep names, facts, decisions, preferences and open questions; drop greetings and filler. ";
+            if (max_tokens > 0) {
+                // ~4 characters per token, as MemoryService counts them
+                prompt += "Keep it under " + std::to_string(max_tokens * 3 / 4) + " words, dropping the least important "
+                          "older details first. ";
             }
-            
-            std::string model = _config.getGeminiModel();
-            if (model.empty()) {
-                model = "gemini-2.5-flash"; // Fallback
+            prompt += "Answer with the summary only, in plain prose.\n\n";
+            if (!previous_summary.empty()) {
+                prompt += "Current summary:\n" + previous_summary + "\n\n";
             }
-
-            web::http::client::http_client client(U("https://generativelanguage.googleapis.com"));
-            
-            // Try each API key in round-robin with retry on rate limit
-            for (size_t retry = 0; retry < max_retries; retry++) {
-                // Get next API key using round-robin
-                std::string api_key = _config.getCurrentGeminiApiKey();
-                if (api_key.empty()) {
-                    std::cerr << "[GEMINI API] Warning: Empty API key encountered" << std::endl;
-                    continue;
-                }
-                
-                std::cout << "[GEMINI API] Using API key (ending with ..." << api_key.substr(api_key.length() - 4) << ")" << std::endl;
-
-                web::http::http_request request(web::http::methods::POST);
-                std::string url = "/v1beta/models/" + model + ":generateContent?key=" + api_key;
-                request.set_request_uri(web::uri(url));
-
-                // Build request
-                web::json::value request_json = web::json::value::object();
-                
-                // Convert nlohmann::json contents to web::json::value
-                std::string contents_str = contents.dump();
-                
-                try {
-                    request_json["contents"] = web::json::value::parse(utility::conversions::to_string_t(contents_str));
-                } catch (const std::exception& e) {
-                     std::cerr << "[GEMINI API] Error converting contents json: " << e.what() << std::endl;
-                     return nlohmann::json::object();
-                }
-
-                // Add tools to the request if available
-                if (!tools.empty()) {
-                    web::json::value tools_json = web::json::value::array(tools.size());
-                    for (size_t i = 0; i < tools.size(); i++) {
-                        tools_json[i] = convert_mcp_tool_to_gemini_format(tools[i]);
-                    }
-                    request_json["tools"] = tools_json;
-                    std::cout << "[GEMINI API] Sending request with " << tools.size() << " tools" << std::endl;
-                } else {
-                    std::cout << "[GEMINI API] Sending request without tools" << std::endl;
+            if (!turns.empty()) {
+                prompt += "New turns:\n";
+                for (const auto& msg : turns) {
+                    prompt.append(role_name(msg.role)).append(": ").append(msg.content).append("\n");
                 }
+            }
 
-                request.set_body(request_json);
+            nlohmann::json parts = nlohmann::json::array();
+            parts.push_back({{"text", prompt}});
+            GeminiRequestBuilder request;
+            request.append_turn("user", parts);
+            auto body = std::make_shared<const std::string>(request.build_body());
 
-                try {
-                    std::cout << "[GEMINI API] Calling Gemini API (attempt " << (retry + 1) << "/" << max_retries << ")..." << std::endl;
-                    pplx::task<web::http::http_response> response_task = client.request(request);
-                    response_task.wait();
-                    web::http::http_response response = response_task.get();
-
-                    std::cout << "[GEMINI API] Response status: " << response.status_code() << std::endl;
-
-                    if (response.status_code() == 200) {
-                        auto json_response = response.extract_json().get();
-                        std::string response_str = utility::conversions::to_utf8string(json_response.serialize());
-                        std::cout << "[GEMINI API] Successfully received response from Gemini" << std::endl;
-                        return nlohmann::json::parse(response_str);
-                    } else if (response.status_code() == 429) {
-                        // Rate limit - try next key
-                        std::cerr << "[GEMINI API] Rate limited (429), trying next API key..." << std::endl;
-                        continue;
-                    } else {
-                        std::cerr << "[GEMINI API] Error: HTTP status " << response.status_code() << std::endl;
-                        auto error_body = response.extract_string().get();
-                        std::cerr << "[GEMINI API] Error response: " << error_body << std::endl;
-                        
-                        // For other errors, also try next key
-                        continue;
+            nlohmann::json response = _geminiClient.generate_content(body).get();
+            std::string summary;
+            if (response.contains("candidates") && response["candidates"].is_array() && response["candidates"].size() > 0) {
+                const auto& candidate = response["candidates"][0];
+                if (candidate.contains("content") && candidate["content"].contains("parts")) {
+                    for (const auto& part : candidate["content"]["parts"]) {
+                        if (part.contains("text")) {
+                            summary += part["text"].get<std::string>();
+                        }
                     }
-                } catch (const std::exception& e) {
-                    std::cerr << "[GEMINI API] Error calling Gemini: " << e.what() << std::endl;
-                    // Try next key on exception
-                    continue;
                 }
             }
-
-            std::cerr << "[GEMINI API] All API keys exhausted" << std::endl;
-            return nlohmann::json::object();
+            if (summary.empty()) {
+                std::cerr << "[AGENT LOOP] Summarization returned no text" << std::endl;
+            }
+            return summary;
         }
 
         // Per-user agent loop tracking methods
@@ -2,6 +2,7 @@
 #include <lily/services/EchoService.hpp>
 #include <iostream>
 #include <chrono>
+#include <future>
 #include <nlohmann/json.hpp>
 
 namespace lily {
@@ -25,16 +26,8 @@ namespace lily {
             _threadPool(threadPool) {
             
             // Set up the transcription handler
-            _echoService.set_transcription_handler([this](const std::string& payload) {
-                try {
-                    auto json = nlohmann::json::parse(payload);
-                    std::cout << "Received transcription from Echo: " << payload << std::endl;
-                    
-                    std::string message = "transcription:" + payload;
-                    _webSocketManager.broadcast(message);
-                } catch (const std::exception& e) {
-                    std::cerr << "Error handling transcription: " << e.what() << std::endl;
-                }
+            _echoService.set_transcription_handler([this](const nlohmann::json& message, const std::string& client_id) {
+                handle_transcription(message, client_id);
             });
         }
 
@@ -45,40 +38,56 @@ namespace lily {
             return response.text_response;
         }
 
-        ChatResponse ChatService::handle_chat_message_with_audio(const std::string& message, const std::string& user_id, const ChatParameters& params) {
+        void ChatService::begin_chat(const std::string& message, const std::string& user_id) {
             // Update session activity
             _sessionService.touch_session(user_id);
             if (!_sessionService.is_session_active(user_id)) {
                 _sessionService.start_session(user_id);
             }
 
-            // 1. Save user message
-            _memoryService.add_message(user_id, "user", message);
-
-            // 2. Get response from agent loop (BLOCKING)
-            std::string agent_response = _agentLoopService.run_loop(message, user_id);
+            // Save user message
+            _memoryService.add_message(user_id, Role::user, message);
+        }
 
-            // 3. Save agent response
-            _memoryService.add_message(user_id, "assistant", agent_response);
+        ChatResponse ChatService::complete_chat(const std::string& agent_response, const std::string& user_id) {
+            // Save agent response
+            _memoryService.add_message(user_id, Role::assistant, agent_response);
 
-            // 4. Prepare response
+            // Prepare response
             ChatResponse response;
             response.text_response = agent_response;
+            return response;
+        }
 
-            // 5. Synthesize TTS (BLOCKING)
-            if (params.enable_tts) {
-                auto audio_data = _ttsService.synthesize_speech(agent_response, params.tts_params);
-                if (!audio_data.empty()) {
-                    if (_webSocketManager.wait_for_connection_registration(user_id, 10)) {
-                        _webSocketManager.send_binary_to_client_by_id(user_id, audio_data);
-                    } else {
-                        std::cerr << "Connection for user_id " << user_id << " is not registered, unable to send audio data." << std::endl;
-                    }
-                } else {
-                    std::cerr << "Audio synthesis failed." << std::endl;
+        std::shared_ptr<SpeechPipeline> ChatService::start_speech(const std::string& user_id, const ChatParameters& params) {
+            if (!params.enable_tts) {
+                return nullptr;
+            }
+            return std::make_shared<SpeechPipeline>(_ttsService, _webSocketManager, user_id, params.tts_params);
+        }
+
+        ChatResponse ChatService::handle_chat_message_with_audio(const std::string& message, const std::string& user_id, const ChatParameters& params) {
+            begin_chat(message, user_id);
+            auto speech = start_speech(user_id, params);
+
+            // Get response from agent loop (BLOCKING)
+            std::string agent_response;
+            try {
+                agent_response = _agentLoopService.run_loop_async(message, user_id, delta_handler(user_id, params, speech)).get();
+            } catch (...) {
+                if (speech) {
+                    speech->abort();
                 }
+                throw;
             }
+            ChatResponse response = complete_chat(agent_response, user_id);
 
+            // Wait for the remaining sentences to be spoken (BLOCKING)
+            if (speech) {
+                auto spoken = std::make_shared<std::promise<void>>();
+                speech->finish(agent_response, [spoken]() { spoken->set_value(); });
+                spoken->get_future().wait();
+            }
             return response;
         }
 
@@ -95,28 +104,124 @@ namespace lily {
         }
 
         void ChatService::handle_chat_message_with_audio_async(const std::string& message, const std::string& user_id, const ChatParameters& params, AudioCompletionCallback callback) {
-            _threadPool.enqueue([this, message, user_id, params, callback]() {
-                try {
-                    // Reuse the synchronous logic which is now safe to call on worker thread
-                    ChatResponse response = handle_chat_message_with_audio(message, user_id, params);
-                    
-                    if (callback) {
-                        callback(response);
-                    }
-                } catch (const std::exception& e) {
-                    std::cerr << "Error in async chat processing: " << e.what() << std::endl;
-                    if (callback) {
-                        ChatResponse error_response;
-                        error_response.text_response = "Error processing request: " + std::string(e.what());
-                        callback(error_response);
+            auto report_error = [callback](const std::exception& e) {
+                std::cerr << "Error in async chat processing: " << e.what() << std::endl;
+                if (callback) {
+                    ChatResponse error_response;
+                    error_response.text_response = "Error processing request: " + std::string(e.what());
+                    callback(error_response);
+                }
+            };
+
+            // Session bookkeeping, the memory window and the first Gemini request body are built on
+            // the pool, so the gateway's I/O thread only hands the message over
+            try {
+                _threadPool.enqueue([this, message, user_id, params, callback, report_error]() {
+                    pplx::task<std::string> loop_task;
+                    std::shared_ptr<SpeechPipeline> speech;
+                    try {
+                        begin_chat(message, user_id);
+                        speech = start_speech(user_id, params);
+                        loop_task = _agentLoopService.run_loop_async(message, user_id, delta_handler(user_id, params, speech));
+                    } catch (const std::exception& e) {
+                        if (speech) {
+                            speech->abort();
+                        }
+                        report_error(e);
+                        return;
                     }
+
+                    // The agent loop holds no thread while it waits on Gemini or tools. Speech already
+                    // started as sentences were completed; the callback runs once the last one has
+                    // been sent.
+                    loop_task.then([this, user_id, speech, callback, report_error](pplx::task<std::string> previous) {
+                        try {
+                            std::string agent_response = previous.get();
+                            ChatResponse response = complete_chat(agent_response, user_id);
+                            if (speech) {
+                                speech->finish(agent_response, [callback, response]() {
+                                    if (callback) {
+                                        callback(response);
+                                    }
+                                });
+                                return;
+                            }
+
+                            if (callback) {
+                                callback(response);
+                            }
+                        } catch (const std::exception& e) {
+                            if (speech) {
+                                speech->abort();
+                            }
+                            report_error(e);
+                        }
+                    });
+                });
+            } catch (const std::exception& e) {
+                report_error(e);
+            }
+        }
+
+        AgentLoopService::DeltaCallback ChatService::delta_handler(const std::string& user_id, const ChatParameters& params, std::shared_ptr<SpeechPipeline> speech) {
+            bool forward = params.stream_deltas;
+            if (!forward && !speech) {
+                return nullptr;
+            }
+
+            // The final "response" frame is still sent, so clients that ignore deltas keep working
+            return [this, user_id, forward, speech](const std::string& text, int step) {
+                if (speech) {
+                    speech->add_text(text);
                 }
-            });
+                if (!forward || !_webSocketManager.is_connection_registered(user_id)) {
+                    return;
+                }
+                nlohmann::json delta_msg = {
+                    {"type", "delta"},
+                    {"user_id", user_id},
+                    {"text", text},
+                    {"step", step}
+                };
+                _webSocketManager.send_text_to_client_by_id(user_id, delta_msg.dump());
+            };
+        }
+
+        void ChatService::handle_transcription(const nlohmann::json& message, const std::string& client_id) {
+            try {
+                std::string type = message.value("type", "");
+                std::string text = message.value("text", "");
+                if (client_id.empty()) {
+                    std::cerr << "Dropping " << type << " transcription without a client_id" << std::endl;
+                    return;
+                }
+
+                nlohmann::json ui_message = {
+                    {"type", type},
+                    {"text", text}
+                };
+                _webSocketManager.send_text_to_client_by_id(client_id, "transcription:" + ui_message.dump());
+
+                if (type == "final" && !text.empty()) {
+                    std::cout << "Final transcription for " << client_id << ": " << text << std::endl;
+                    _sessionService.touch_session(client_id);
+                    handle_chat_message_async(text, client_id, [this, client_id](std::string response) {
+                        nlohmann::json response_msg = {
+                            {"type", "response"},
+                            {"user_id", client_id},
+                            {"text", response}
+                        };
+                        _webSocketManager.send_text_to_client_by_id(client_id, response_msg.dump());
+                    });
+                }
+            } catch (const std::exception& e) {
+                std::cerr << "Error handling transcription: " << e.what() << std::endl;
+            }
         }
 
-        void ChatService::handle_audio_stream(const std::vector<uint8_t>& audio_data, const std::string& user_id) {
+        void ChatService::handle_audio_stream(const utils::SharedBytes& frame, const std::string& user_id) {
             _sessionService.touch_session(user_id);
-            _echoService.send_audio(audio_data);
+            _echoService.send_audio(user_id, frame);
         }
     }
 }
@@ -1,9 +1,11 @@
 #include "lily/services/EchoService.hpp"
 #include <iostream>
+#include <algorithm>
+#include <stdexcept>
 #include <nlohmann/json.hpp>
 #include <cpprest/uri_builder.h>
 #include <cpprest/interopstream.h>
-#include <cpprest/containerstream.h>
+#include <cpprest/rawptrstream.h>
 
 using namespace web;
 using namespace web::websockets::client;
@@ -11,7 +13,18 @@ using namespace web::websockets::client;
 namespace lily {
     namespace services {
 
-        EchoService::EchoService() : _is_connected(false) {}
+        EchoService::EchoService()
+            : _is_connected(false),
+              _packet_duration(40),
+              _buffer_duration(400),
+              _bytes_per_second(32000) {}
+
+        void EchoService::set_uplink_limits(std::chrono::milliseconds packet, std::chrono::milliseconds buffer, size_t bytes_per_second) {
+            std::lock_guard<std::mutex> lock(_uplink_mutex);
+            _packet_duration = std::max(packet, std::chrono::milliseconds(1));
+            _buffer_duration = std::max(buffer, _packet_duration);
+            _bytes_per_second = bytes_per_second == 0 ? 32000 : bytes_per_second;
+        }
 
         EchoService::~EchoService() {
             close();
@@ -50,12 +63,24 @@ namespace lily {
                 _websocket_client = std::make_unique<websocket_client>(config);
 
                 _websocket_client->connect(builder.to_uri()).wait();
+                {
+                    std::lock_guard<std::mutex> lock(_socket_mutex);
+                    _stream_client_id.clear(); // a new socket has no stream selected
+                }
                 _is_connected = true;
                 std::cout << "Connected to Echo service at " << utility::conversions::to_utf8string(builder.to_string()) << std::endl;
 
                 // Start receive loop
                 _receive_thread = std::thread(&EchoService::receive_loop, this);
 
+                {
+                    std::lock_guard<std::mutex> lock(_uplink_mutex);
+                    _flushing = true;
+                }
+                if (!_flush_thread.joinable()) {
+                    _flush_thread = std::thread(&EchoService::flush_loop, this);
+                }
+
                 return true;
 
             } catch (const std::exception& e) {
@@ -67,6 +92,15 @@ namespace lily {
 
         void EchoService::close() {
             _is_connected = false;
+            {
+                std::lock_guard<std::mutex> lock(_uplink_mutex);
+                _flushing = false;
+                _uplinks.clear();
+            }
+            _uplink_wake.notify_all();
+            if (_flush_thread.joinable()) {
+                _flush_thread.join();
+            }
             if (_websocket_client) {
                 try {
                     _websocket_client->close().wait();
@@ -78,24 +112,215 @@ namespace lily {
             _websocket_client.reset();
         }
 
-        void EchoService::send_audio(const std::vector<uint8_t>& audio_data) {
-            if (!_is_connected || !_websocket_client) {
+        void EchoService::send_audio(const std::string& user_id, const utils::SharedBytes& frame) {
+            if (!_is_connected || frame.empty()) {
                 return;
             }
+            _frames_received++;
+
+            bool ready;
+            {
+                std::lock_guard<std::mutex> lock(_uplink_mutex);
+                auto now = std::chrono::steady_clock::now();
+                auto& uplink = _uplinks[user_id];
+                // Drop-oldest: the newest audio matters most for live transcription
+                size_t limit = _bytes_per_second * _buffer_duration.count() / 1000;
+                while (!uplink.frames.empty() && uplink.queued_bytes + frame.size() > limit) {
+                    uplink.queued_bytes -= uplink.frames.front().bytes.size();
+                    _bytes_dropped += uplink.frames.front().bytes.size();
+                    _frames_dropped++;
+                    uplink.frames.pop_front();
+                }
+                uplink.frames.push_back(Frame{frame, now});
+                uplink.queued_bytes += frame.size();
+                uplink.last_activity = now;
+                ready = !uplink.in_flight && uplink.queued_bytes >= _bytes_per_second * _packet_duration.count() / 1000;
+            }
+            if (ready) {
+                pump(user_id, false);
+            }
+        }
+
+        // Sends the user's next packet unless one is in flight. Without flush_partial, only a full packet is sent.
+        void EchoService::pump(const std::string& user_id, bool flush_partial) {
+            utils::SharedBytes payload;
+            std::shared_ptr<std::vector<uint8_t>> packet;
+            {
+                std::lock_guard<std::mutex> lock(_uplink_mutex);
+                auto it = _uplinks.find(user_id);
+                if (it == _uplinks.end()) {
+                    return;
+                }
+                Uplink& uplink = it->second;
+                size_t target = _bytes_per_second * _packet_duration.count() / 1000;
+                if (uplink.in_flight || uplink.frames.empty() || (!flush_partial && uplink.queued_bytes < target)) {
+                    return;
+                }
+
+                if (uplink.frames.front().bytes.size() >= target) {
+                    payload = uplink.frames.front().bytes; // already packet-sized: send it as is
+                    uplink.queued_bytes -= payload.size();
+                    uplink.frames.pop_front();
+                } else {
+                    if (!_spare_packets.empty()) {
+                        packet = std::move(_spare_packets.back());
+                        _spare_packets.pop_back();
+                        packet->clear();
+                    } else {
+                        packet = std::make_shared<std::vector<uint8_t>>();
+                        packet->reserve(target);
+                    }
+                    while (!uplink.frames.empty() && packet->size() + uplink.frames.front().bytes.size() <= target) {
+                        const auto& bytes = uplink.frames.front().bytes;
+                        packet->insert(packet->end(), bytes.begin(), bytes.end());
+                        uplink.queued_bytes -= bytes.size();
+                        uplink.frames.pop_front();
+                    }
+                    payload = utils::SharedBytes(packet, packet->data(), packet->size());
+                }
+                uplink.in_flight = true;
+            }
+
+            send_packet(user_id, payload, std::move(packet));
+        }
 
+        void EchoService::send_packet(const std::string& user_id, const utils::SharedBytes& payload,
+                                      std::shared_ptr<std::vector<uint8_t>> packet) {
             try {
+                if (!_is_connected || !_websocket_client) {
+                    throw std::runtime_error("not connected");
+                }
+                // Streams straight from the payload's bytes; the continuation keeps them alive until sent
                 websocket_outgoing_message msg;
-                // Create a container buffer from the vector
-                concurrency::streams::container_buffer<std::vector<uint8_t>> buffer(audio_data);
-                msg.set_binary_message(buffer.create_istream(), audio_data.size());
-                std::cout << "[DEBUG] Sending " << audio_data.size() << " bytes to Echo (connected=" << _is_connected << ")" << std::endl;
-                _websocket_client->send(msg).wait();
-                std::cout << "[DEBUG] Sent audio chunk successfully." << std::endl;
+                concurrency::streams::rawptr_buffer<uint8_t> buffer(payload.data(), payload.size(), std::ios::in);
+                msg.set_binary_message(buffer.create_istream(), payload.size());
+
+                pplx::task<void> sent;
+                {
+                    // The client sends in call order, so the selection stays right in front of the packet
+                    std::lock_guard<std::mutex> lock(_socket_mutex);
+                    if (_stream_client_id != user_id) {
+                        websocket_outgoing_message select;
+                        select.set_utf8_message(nlohmann::json{{"type", "stream"}, {"client_id", user_id}}.dump());
+                        _websocket_client->send(select).then([this, user_id](pplx::task<void> selected) {
+                            try {
+                                selected.get();
+                            } catch (const std::exception& e) {
+                                std::cerr << "Error selecting Echo stream for " << user_id << ": " << e.what() << std::endl;
+                                // Select again before the next packet
+                                std::lock_guard<std::mutex> lock(_socket_mutex);
+                                if (_stream_client_id == user_id) {
+                                    _stream_client_id.clear();
+                                }
+                            }
+                        });
+                        _stream_client_id = user_id;
+                    }
+                    sent = _websocket_client->send(msg);
+                }
+                sent.then([this, user_id, payload, packet](pplx::task<void> sent) {
+                    bool ok = true;
+                    try {
+                        sent.get();
+                        _packets_sent++;
+                        _bytes_sent += payload.size();
+                    } catch (const std::exception& e) {
+                        std::cerr << "Error sending audio to Echo: " << e.what() << std::endl;
+                        ok = false;
+                    }
+                    if (packet) {
+                        std::lock_guard<std::mutex> lock(_uplink_mutex);
+                        if (_spare_packets.size() < 16) {
+                            _spare_packets.push_back(packet);
+                        }
+                    }
+                    on_packet_sent(user_id, ok);
+                });
             } catch (const std::exception& e) {
                 std::cerr << "Error sending audio to Echo: " << e.what() << std::endl;
+                on_packet_sent(user_id, false);
+            }
+        }
+
+        void EchoService::on_packet_sent(const std::string& user_id, bool ok) {
+            if (!ok) {
+                _send_errors++;
+            }
+            bool ready = false;
+            {
+                std::lock_guard<std::mutex> lock(_uplink_mutex);
+                auto it = _uplinks.find(user_id);
+                if (it != _uplinks.end()) {
+                    it->second.in_flight = false;
+                    ready = it->second.queued_bytes >= _bytes_per_second * _packet_duration.count() / 1000;
+                }
+            }
+            if (ready && _is_connected) {
+                pump(user_id, false);
+            }
+        }
+
+        // Flushes partial packets that have waited a whole packet duration and forgets idle users
+        void EchoService::flush_loop() {
+            std::unique_lock<std::mutex> lock(_uplink_mutex);
+            while (_flushing) {
+                _uplink_wake.wait_for(lock, std::max(_packet_duration / 2, std::chrono::milliseconds(5)));
+                if (!_flushing) {
+                    break;
+                }
+
+                auto now = std::chrono::steady_clock::now();
+                std::vector<std::string> due;
+                for (auto it = _uplinks.begin(); it != _uplinks.end();) {
+                    const Uplink& uplink = it->second;
+                    if (!uplink.in_flight && !uplink.frames.empty() && now - uplink.frames.front().arrived >= _packet_duration) {
+                        due.push_back(it->first);
+                    } else if (!uplink.in_flight && uplink.frames.empty() && now - uplink.last_activity > std::chrono::minutes(1)) {
+                        it = _uplinks.erase(it);
+                        continue;
+                    }
+                    ++it;
+                }
+
+                lock.unlock();
+                for (const auto& user_id : due) {
+                    pump(user_id, true);
+                }
+                lock.lock();
             }
         }
 
+        nlohmann::json EchoService::get_metrics() const {
+            nlohmann::json metrics;
+            metrics["connected"] = _is_connected.load();
+            metrics["frames_received"] = _frames_received.load();
+            metrics["packets_sent"] = _packets_sent.load();
+            metrics["bytes_sent"] = _bytes_sent.load();
+            metrics["frames_dropped"] = _frames_dropped.load();
+            metrics["bytes_dropped"] = _bytes_dropped.load();
+            metrics["send_errors"] = _send_errors.load();
+
+            std::lock_guard<std::mutex> lock(_uplink_mutex);
+            metrics["packet_ms"] = _packet_duration.count();
+            metrics["buffer_ms"] = _buffer_duration.count();
+
+            size_t queued_frames = 0;
+            nlohmann::json users = nlohmann::json::object();
+            for (const auto& entry : _uplinks) {
+                const Uplink& uplink = entry.second;
+                queued_frames += uplink.frames.size();
+                users[entry.first] = {
+                    {"queued_frames", uplink.frames.size()},
+                    {"queued_bytes", uplink.queued_bytes},
+                    {"queued_ms", uplink.queued_bytes * 1000 / _bytes_per_second},
+                    {"in_flight", uplink.in_flight}
+                };
+            }
+            metrics["queue_depth"] = queued_frames;
+            metrics["users"] = users;
+            return metrics;
+        }
+
         void EchoService::set_transcription_handler(const TranscriptionHandler& handler) {
             _transcription_handler = handler;
         }
@@ -105,7 +330,6 @@ namespace lily {
             while (_is_connected && _websocket_client) {
                 try {
                     auto msg = _websocket_client->receive().get();
-                    std::cout << "[DEBUG] EchoService received message." << std::endl;
                     on_message(msg);
                 } catch (const std::exception& e) {
                     if (_is_connected) {
@@ -121,17 +345,17 @@ namespace lily {
             try {
                 if (msg.message_type() == websocket_message_type::text_message) {
                     std::string payload = msg.extract_string().get();
-                    std::cout << "[DEBUG] EchoService processing payload: " << payload << std::endl;
-                    
-                    // Parse JSON
                     auto json = nlohmann::json::parse(payload);
                     
                     // Echo sends: {'type': 'interim'|'final', 'text': '...', 'client_id': '...'}
-                    if (json.contains("text") && json.contains("type")) {
-                        // We forward the whole JSON string to let ChatService decide what to do
-                        if (_transcription_handler) {
-                            _transcription_handler(payload);
+                    if (json.contains("text") && json.contains("type") && _transcription_handler) {
+                        std::string client_id = json.value("client_id", "");
+                        if (client_id.empty()) {
+                            // Never guess the speaker: the selected stream may belong to another user by now
+                            std::cerr << "Dropping Echo " << json.value("type", "") << " transcript without a client_id" << std::endl;
+                            return;
                         }
+                        _transcription_handler(json, client_id);
                     }
                 }
             } catch (const std::exception& e) {
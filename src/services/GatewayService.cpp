@@ -186,6 +186,12 @@ namespace lily {
                 std::cerr << "Client not found: " << client_id << std::endl;
             }
         }
+
+        void GatewayService::send_binary_to_client_by_id(const std::string& client_id, const utils::SharedBuffer& data) {
+            if (data) {
+                send_binary_to_client_by_id(client_id, *data);
+            }
+        }
         
         void GatewayService::send_text_to_client_by_id(const std::string& client_id, const std::string& message) {
             ConnectionHandle conn;
@@ -312,8 +318,9 @@ namespace lily {
             }
             // Handle binary messages (audio data)
             else if (msg->get_opcode() == websocketpp::frame::opcode::binary) {
+                // The view keeps the message alive, so the payload is never copied out of it
                 const auto& payload = msg->get_payload();
-                std::vector<uint8_t> binary_data(payload.begin(), payload.end());
+                utils::SharedBytes frame(msg, reinterpret_cast<const uint8_t*>(payload.data()), payload.size());
                 
                 // Get user_id from connection mapping
                 std::string user_id;
@@ -326,7 +333,7 @@ namespace lily {
                 }
                 
                 if (_binary_message_handler) {
-                    _binary_message_handler(binary_data, user_id);
+                    _binary_message_handler(frame, user_id);
                 }
             }
         }
@@ -542,27 +549,7 @@ namespace lily {
                 try {
                     nlohmann::json message = nlohmann::json::parse(payload);
                     
-                    // Check if there's a client_id to forward the message to
-                    if (message.contains("client_id")) {
-                        std::string client_id = message["client_id"];
-                        ConnectionHandle conn;
-                        bool found = false;
-                        
-                        {
-                std::lock_guard<std::recursive_mutex> lock(_mutex);
-                            auto it = _connections.find(client_id);
-                            if (it != _connections.end()) {
-                                conn = it->second;
-                                found = true;
-                            }
-                        }
-
-                        if (found) {
-                            // Forward the original payload to the client
-                            _server.send(conn, payload, websocketpp::frame::opcode::text);
-                        }
-                    }
-                    
+                    // Delivery to the user named by client_id is left to the handler
                     if (_echo_message_handler) {
                         _echo_message_handler(message);
                     }
@@ -0,0 +1,309 @@
+#include <lily/services/GeminiClient.hpp>
+#include <lily/services/GeminiStream.hpp>
+#include <cpprest/containerstream.h>
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+
+namespace lily {
+    namespace services {
+        struct GeminiClient::StreamState {
+            DeltaCallback on_delta;
+            concurrency::streams::istream body;
+            SseParser parser;
+            GeminiStreamAccumulator accumulator;
+            size_t key_index = 0;
+            std::chrono::steady_clock::time_point start;
+            bool streamed = false; // at least one delta was handed to on_delta
+        };
+
+        // Bytes requested per read of a streaming body
+        static constexpr size_t kStreamReadSize = 4096;
+
+        GeminiClient::GeminiClient(config::AppConfig& config)
+            : _config(config), _base_url(config.gemini_base_url), _next_client(0) {
+            size_t pool_size = config.gemini_pool_size == 0 ? 1 : config.gemini_pool_size;
+
+            web::http::client::http_client_config client_config;
+            client_config.set_timeout(std::chrono::seconds(config.gemini_timeout_seconds));
+            if (!config.gemini_ca_file.empty()) {
+                std::string ca_file = config.gemini_ca_file;
+                // Trusted in addition to the system roots cpprest loads
+                client_config.set_ssl_context_callback([ca_file](boost::asio::ssl::context& context) {
+                    context.load_verify_file(ca_file);
+                });
+            }
+
+            for (size_t i = 0; i < pool_size; ++i) {
+                _clients.push_back(std::make_shared<web::http::client::http_client>(
+                    utility::conversions::to_string_t(_base_url), client_config));
+            }
+            std::cout << "[GEMINI API] Client pool ready: " << pool_size << " persistent client(s) to " << _base_url << std::endl;
+        }
+
+        std::shared_ptr<web::http::client::http_client> GeminiClient::next_client() {
+            size_t index = _next_client.fetch_add(1, std::memory_order_relaxed) % _clients.size();
+            return _clients[index];
+        }
+
+        pplx::task<nlohmann::json> GeminiClient::generate_content(std::shared_ptr<const std::string> body) {
+            size_t max_retries = _config.getGeminiApiKeyCount();
+            if (max_retries == 0) {
+                std::cerr << "[GEMINI API] Error: No GEMINI_API_KEY configured" << std::endl;
+                return pplx::task_from_result(nlohmann::json::object());
+            }
+
+            std::string model = _config.getGeminiModel();
+            if (model.empty()) {
+                model = "gemini-2.5-flash"; // Fallback
+            }
+
+            return attempt(body, model, 0, max_retries, nullptr);
+        }
+
+        pplx::task<nlohmann::json> GeminiClient::stream_generate_content(std::shared_ptr<const std::string> body, DeltaCallback on_delta) {
+            if (!on_delta) {
+                return generate_content(body);
+            }
+
+            size_t max_retries = _config.getGeminiApiKeyCount();
+            if (max_retries == 0) {
+                std::cerr << "[GEMINI API] Error: No GEMINI_API_KEY configured" << std::endl;
+                return pplx::task_from_result(nlohmann::json::object());
+            }
+
+            std::string model = _config.getGeminiModel();
+            if (model.empty()) {
+                model = "gemini-2.5-flash"; // Fallback
+            }
+
+            return attempt(body, model, 0, max_retries, on_delta);
+        }
+
+        // Send one generateContent (or, with on_delta, streamGenerateContent) attempt; on failure
+        // move on to the next API key (round-robin) by chaining another attempt, so no thread
+        // waits on the network in between.
+        pplx::task<nlohmann::json> GeminiClient::attempt(std::shared_ptr<const std::string> body,
+                                                         std::string model,
+                                                         size_t retry,
+                                                         size_t max_retries,
+                                                         DeltaCallback on_delta) {
+            if (retry >= max_retries) {
+                std::cerr << "[GEMINI API] All API keys exhausted" << std::endl;
+                return pplx::task_from_result(nlohmann::json::object());
+            }
+
+            // Get next API key using round-robin
+            size_t key_index = 0;
+            std::string api_key = _config.getCurrentGeminiApiKey(key_index);
+            if (api_key.empty()) {
+                std::cerr << "[GEMINI API] Warning: Empty API key encountered" << std::endl;
+                return attempt(body, model, retry + 1, max_retries, on_delta);
+            }
+
+            std::string key_label = mask_key(api_key);
+            std::cout << "[GEMINI API] Using API key (ending with " << key_label << ")" << std::endl;
+
+            web::http::http_request request(web::http::methods::POST);
+            std::string url = on_delta
+                ? "/v1beta/models/" + model + ":streamGenerateContent?alt=sse&key=" + api_key
+                : "/v1beta/models/" + model + ":generateContent?key=" + api_key;
+            request.set_request_uri(web::uri(url));
+            request.set_body(*body, "application/json");
+
+            std::cout << "[GEMINI API] Calling Gemini API (attempt " << (retry + 1) << "/" << max_retries << ")..." << std::endl;
+
+            auto next_attempt = [this, body, model, retry, max_retries, on_delta]() {
+                return attempt(body, model, retry + 1, max_retries, on_delta);
+            };
+
+            auto start = std::chrono::steady_clock::now();
+            record_start(key_index, key_label);
+
+            return next_client()->request(request).then([this, next_attempt, key_index, start, on_delta](pplx::task<web::http::http_response> response_task) -> pplx::task<nlohmann::json> {
+                web::http::http_response response;
+                try {
+                    response = response_task.get();
+                } catch (const std::exception& e) {
+                    record_finish(key_index, 0, start);
+                    std::cerr << "[GEMINI API] Error calling Gemini: " << e.what() << std::endl;
+                    // Try next key on exception
+                    return next_attempt();
+                }
+
+                std::cout << "[GEMINI API] Response status: " << response.status_code() << std::endl;
+
+                if (response.status_code() == 200 && on_delta) {
+                    // The response task completes once headers arrive; events are read as they come in
+                    auto state = std::make_shared<StreamState>();
+                    state->on_delta = on_delta;
+                    state->body = response.body();
+                    state->key_index = key_index;
+                    state->start = start;
+
+                    return read_stream(state).then([this, state, next_attempt](pplx::task<void> done) -> pplx::task<nlohmann::json> {
+                        try {
+                            done.get();
+                        } catch (const std::exception& e) {
+                            record_finish(state->key_index, 0, state->start);
+                            std::cerr << "[GEMINI API] Error reading Gemini stream: " << e.what() << std::endl;
+                            if (!state->streamed) {
+                                return next_attempt();
+                            }
+                            // The client has already seen part of this answer, so retrying would repeat it; the
+                            // rest (finishReason, perhaps part of a function call) is missing, so it is no answer either
+                            throw std::runtime_error(std::string("Gemini stream broke off mid-answer: ") + e.what());
+                        }
+                        record_finish(state->key_index, 200, state->start);
+                        std::cout << "[GEMINI API] Successfully received streamed response from Gemini" << std::endl;
+                        return pplx::task_from_result(state->accumulator.result());
+                    });
+                }
+
+                if (response.status_code() == 200) {
+                    // The body must be drained for the connection to go back to the keep-alive pool
+                    // Parsed once, straight from the raw bytes, into the representation the agent loop uses
+                    return response.extract_utf8string(true).then([this, next_attempt, key_index, start](pplx::task<std::string> body_task) -> pplx::task<nlohmann::json> {
+                        try {
+                            nlohmann::json parsed = nlohmann::json::parse(body_task.get());
+                            record_finish(key_index, 200, start);
+                            std::cout << "[GEMINI API] Successfully received response from Gemini" << std::endl;
+                            return pplx::task_from_result(std::move(parsed));
+                        } catch (const std::exception& e) {
+                            record_finish(key_index, 0, start);
+                            std::cerr << "[GEMINI API] Error reading Gemini response: " << e.what() << std::endl;
+                            return next_attempt();
+                        }
+                    });
+                }
+
+                int status = response.status_code();
+                return response.extract_string().then([this, next_attempt, key_index, start, status](pplx::task<utility::string_t> body_task) {
+                    record_finish(key_index, status, start);
+                    if (status == 429) {
+                        // Rate limit - try next key
+                        std::cerr << "[GEMINI API] Rate limited (429), trying next API key..." << std::endl;
+                    } else {
+                        std::cerr << "[GEMINI API] Error: HTTP status " << status << std::endl;
+                        try {
+                            std::cerr << "[GEMINI API] Error response: " << body_task.get() << std::endl;
+                        } catch (const std::exception&) {}
+                    }
+
+                    // For other errors, also try next key
+                    return next_attempt();
+                });
+            });
+        }
+
+        pplx::task<void> GeminiClient::read_stream(std::shared_ptr<StreamState> state) {
+            concurrency::streams::container_buffer<std::vector<uint8_t>> chunk;
+            return state->body.read(chunk, kStreamReadSize).then([this, state, chunk](size_t read) -> pplx::task<void> {
+                if (read == 0) {
+                    return pplx::task_from_result(); // end of body
+                }
+
+                const auto& bytes = chunk.collection();
+                for (const auto& event : state->parser.feed(reinterpret_cast<const char*>(bytes.data()), bytes.size())) {
+                    if (event.empty()) continue;
+                    std::string delta = state->accumulator.add_chunk(nlohmann::json::parse(event));
+                    if (delta.empty()) continue;
+
+                    if (!state->streamed) {
+                        state->streamed = true;
+                        record_first_token(state->key_index, state->start);
+                    }
+                    state->on_delta(delta);
+                }
+                return read_stream(state);
+            });
+        }
+
+        std::string GeminiClient::mask_key(const std::string& api_key) {
+            if (api_key.length() > 4) {
+                return "..." + api_key.substr(api_key.length() - 4);
+            }
+            return "****";
+        }
+
+        void GeminiClient::record_start(size_t key_index, const std::string& key_label) {
+            std::lock_guard<std::mutex> lock(_metrics_mutex);
+            auto& metrics = _key_metrics[key_index];
+            metrics.label = key_label;
+            metrics.requests++;
+            metrics.in_flight++;
+        }
+
+        void GeminiClient::record_finish(size_t key_index, int status, std::chrono::steady_clock::time_point start) {
+            double latency_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            std::lock_guard<std::mutex> lock(_metrics_mutex);
+            auto& metrics = _key_metrics[key_index];
+            if (metrics.in_flight > 0) metrics.in_flight--;
+
+            if (status == 200) {
+                metrics.successes++;
+            } else if (status == 429) {
+                metrics.rate_limited++;
+            } else {
+                metrics.errors++;
+            }
+
+            if (metrics.recent_latency_ms.size() < kLatencyWindow) {
+                metrics.recent_latency_ms.push_back(latency_ms);
+            } else {
+                metrics.recent_latency_ms[metrics.latency_cursor] = latency_ms;
+                metrics.latency_cursor = (metrics.latency_cursor + 1) % kLatencyWindow;
+            }
+        }
+
+        void GeminiClient::record_first_token(size_t key_index, std::chrono::steady_clock::time_point start) {
+            double ttft_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            std::lock_guard<std::mutex> lock(_metrics_mutex);
+            auto& metrics = _key_metrics[key_index];
+            if (metrics.recent_ttft_ms.size() < kLatencyWindow) {
+                metrics.recent_ttft_ms.push_back(ttft_ms);
+            } else {
+                metrics.recent_ttft_ms[metrics.ttft_cursor] = ttft_ms;
+                metrics.ttft_cursor = (metrics.ttft_cursor + 1) % kLatencyWindow;
+            }
+        }
+
+        nlohmann::json GeminiClient::get_metrics() const {
+            nlohmann::json response;
+            response["base_url"] = _base_url;
+            response["pool_size"] = _clients.size();
+
+            nlohmann::json keys = nlohmann::json::object();
+            std::lock_guard<std::mutex> lock(_metrics_mutex);
+            for (const auto& entry : _key_metrics) {
+                const auto& metrics = entry.second;
+                nlohmann::json key_json;
+                key_json["key"] = metrics.label;
+                key_json["requests"] = metrics.requests;
+                key_json["successes"] = metrics.successes;
+                key_json["rate_limited"] = metrics.rate_limited;
+                key_json["errors"] = metrics.errors;
+                key_json["in_flight"] = metrics.in_flight;
+
+                std::vector<double> sorted = metrics.recent_latency_ms;
+                std::sort(sorted.begin(), sorted.end());
+                if (!sorted.empty()) {
+                    key_json["latency_p50_ms"] = sorted[sorted.size() / 2];
+                    key_json["latency_p99_ms"] = sorted[std::min(sorted.size() - 1, (sorted.size() * 99) / 100)];
+                }
+
+                std::vector<double> ttft = metrics.recent_ttft_ms;
+                std::sort(ttft.begin(), ttft.end());
+                if (!ttft.empty()) {
+                    key_json["ttft_p50_ms"] = ttft[ttft.size() / 2];
+                    key_json["ttft_p99_ms"] = ttft[std::min(ttft.size() - 1, (ttft.size() * 99) / 100)];
+                }
+                keys[std::to_string(entry.first)] = key_json;
+            }
+            response["keys"] = keys;
+            return response;
+        }
+    }
+}
@@ -0,0 +1,105 @@
+#include <lily/services/GeminiRequestBuilder.hpp>
+
+namespace lily {
+    namespace services {
+        void GeminiRequestBuilder::append_turn(const nlohmann::json& turn) {
+            if (_turn_count > 0) {
+                _contents.push_back(',');
+            }
+            _contents += turn.dump();
+            _turn_count++;
+        }
+
+        void GeminiRequestBuilder::append_turn(const std::string& role, const nlohmann::json& parts) {
+            // Written by hand so the parts are not deep-copied into a wrapper object first
+            if (_turn_count > 0) {
+                _contents.push_back(',');
+            }
+            _contents += "{\"role\":";
+            _contents += nlohmann::json(role).dump();
+            _contents += ",\"parts\":";
+            _contents += parts.dump();
+            _contents.push_back('}');
+            _turn_count++;
+        }
+
+        void GeminiRequestBuilder::set_tools_fragment(std::shared_ptr<const std::string> tools_fragment) {
+            _tools_fragment = std::move(tools_fragment);
+        }
+
+        std::string GeminiRequestBuilder::build_body() const {
+            std::string body;
+            size_t tools_size = _tools_fragment ? _tools_fragment->size() : 0;
+            body.reserve(_contents.size() + tools_size + 32);
+            body += "{\"contents\":[";
+            body += _contents;
+            body.push_back(']');
+            if (tools_size > 0) {
+                body += ",\"tools\":";
+                body += *_tools_fragment;
+            }
+            body.push_back('}');
+            return body;
+        }
+
+        // Convert MCP tool schema to Gemini tool schema
+        nlohmann::json GeminiRequestBuilder::convert_mcp_tool(const nlohmann::json& mcp_tool) {
+            // Gemini expects function declarations with specific fields
+            nlohmann::json function_decl = nlohmann::json::object();
+
+            // Map MCP tool fields to Gemini function declaration fields
+            if (mcp_tool.contains("name")) {
+                function_decl["name"] = mcp_tool["name"];
+            }
+
+            if (mcp_tool.contains("description")) {
+                function_decl["description"] = mcp_tool["description"];
+            }
+
+            // Convert inputSchema to parameters
+            if (mcp_tool.contains("inputSchema") && mcp_tool["inputSchema"].is_object()) {
+                nlohmann::json parameters = nlohmann::json::object();
+                parameters["type"] = "OBJECT";
+
+                nlohmann::json properties = nlohmann::json::object();
+
+                const auto& input_schema = mcp_tool["inputSchema"];
+                if (input_schema.contains("properties") && input_schema["properties"].is_object()) {
+                    const auto& props = input_schema["properties"];
+                    for (auto it = props.begin(); it != props.end(); ++it) {
+                        nlohmann::json prop = nlohmann::json::object();
+                        prop["type"] = it.value().value("type", "string");
+
+                        if (it.value().contains("description")) {
+                            prop["description"] = it.value()["description"];
+                        }
+
+                        properties[it.key()] = std::move(prop);
+                    }
+                }
+
+                parameters["properties"] = std::move(properties);
+                if (input_schema.contains("required") && input_schema["required"].is_array() && !input_schema["required"].empty()) {
+                    parameters["required"] = input_schema["required"];
+                }
+
+                function_decl["parameters"] = std::move(parameters);
+            }
+
+            nlohmann::json gemini_tool = nlohmann::json::object();
+            gemini_tool["functionDeclarations"] = nlohmann::json::array({std::move(function_decl)});
+            return gemini_tool;
+        }
+
+        std::string GeminiRequestBuilder::render_tools(const std::vector<nlohmann::json>& mcp_tools) {
+            if (mcp_tools.empty()) {
+                return "";
+            }
+            nlohmann::json tools_json = nlohmann::json::array();
+            for (const auto& tool : mcp_tools) {
+                tools_json.push_back(convert_mcp_tool(tool));
+            }
+            return tools_json.dump();
+        }
+    }
+}
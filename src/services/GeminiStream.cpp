@@ -0,0 +1,105 @@
+#include <lily/services/GeminiStream.hpp>
+
+namespace lily {
+    namespace services {
+        std::vector<std::string> SseParser::feed(const char* data, size_t size) {
+            std::vector<std::string> events;
+
+            for (size_t i = 0; i < size; ++i) {
+                char c = data[i];
+                if (c != '\n') {
+                    _line.push_back(c);
+                    continue;
+                }
+
+                if (!_line.empty() && _line.back() == '\r') {
+                    _line.pop_back();
+                }
+
+                if (_line.empty()) {
+                    // Blank line: dispatch the event
+                    if (_has_data) {
+                        events.push_back(std::move(_event_data));
+                    }
+                    _event_data.clear();
+                    _has_data = false;
+                } else if (_line.compare(0, 5, "data:") == 0) {
+                    size_t start = (_line.size() > 5 && _line[5] == ' ') ? 6 : 5;
+                    if (_has_data) {
+                        _event_data.push_back('\n');
+                    }
+                    _event_data.append(_line, start, std::string::npos);
+                    _has_data = true;
+                }
+                // Comments (":...") and other fields (event:, id:, retry:) are not used by Gemini
+
+                _line.clear();
+            }
+
+            return events;
+        }
+
+        std::string GeminiStreamAccumulator::add_chunk(const nlohmann::json& chunk) {
+            _chunks++;
+            std::string delta;
+
+            if (chunk.contains("usageMetadata")) {
+                _usage = chunk["usageMetadata"];
+            }
+            if (!chunk.contains("candidates") || !chunk["candidates"].is_array() || chunk["candidates"].empty()) {
+                return delta;
+            }
+
+            const auto& candidate = chunk["candidates"][0];
+            if (candidate.contains("finishReason")) {
+                _finish_reason = candidate["finishReason"];
+            }
+            if (!candidate.contains("content")) {
+                return delta;
+            }
+
+            const auto& content = candidate["content"];
+            if (content.contains("role") && content["role"].is_string()) {
+                _role = content["role"].get<std::string>();
+            }
+            if (!content.contains("parts") || !content["parts"].is_array()) {
+                return delta;
+            }
+
+            for (const auto& part : content["parts"]) {
+                if (part.contains("text") && part["text"].is_string() && !part.contains("thought")) {
+                    const std::string& text = part["text"].get_ref<const std::string&>();
+                    delta += text;
+
+                    // Grow the previous text part instead of keeping one part per chunk
+                    if (!_parts.empty() && _parts.back().size() == 1 && _parts.back().contains("text")) {
+                        _parts.back()["text"].get_ref<std::string&>() += text;
+                        continue;
+                    }
+                }
+                _parts.push_back(part);
+            }
+
+            return delta;
+        }
+
+        nlohmann::json GeminiStreamAccumulator::result() const {
+            if (_chunks == 0) {
+                return nlohmann::json::object();
+            }
+
+            nlohmann::json candidate = nlohmann::json::object();
+            candidate["content"] = {{"role", _role}, {"parts", _parts}};
+            if (!_finish_reason.is_null()) {
+                candidate["finishReason"] = _finish_reason;
+            }
+
+            nlohmann::json response = nlohmann::json::object();
+            response["candidates"] = nlohmann::json::array({candidate});
+            if (!_usage.is_null()) {
+                response["usageMetadata"] = _usage;
+            }
+            return response;
+        }
+    }
+}
@@ -0,0 +1,178 @@
+#include <lily/services/McpClientPool.hpp>
+#include <iostream>
+#include <algorithm>
+
+using namespace web;
+using namespace web::http;
+using namespace web::http::client;
+
+namespace lily {
+    namespace services {
+        McpClientPool::McpClientPool(size_t max_in_flight_per_server, std::chrono::seconds idle_timeout)
+            : _max_in_flight(max_in_flight_per_server == 0 ? 1 : max_in_flight_per_server), _idle_timeout(idle_timeout) {}
+
+        void McpClientPool::set_limits(size_t max_in_flight_per_server, std::chrono::seconds idle_timeout) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _max_in_flight = max_in_flight_per_server == 0 ? 1 : max_in_flight_per_server;
+            _idle_timeout = idle_timeout;
+        }
+
+        const std::vector<double>& McpClientPool::latency_buckets_ms() {
+            static const std::vector<double> buckets = {10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 30000, 60000};
+            return buckets;
+        }
+
+        std::shared_ptr<McpClientPool::Server> McpClientPool::server_for(const std::string& server_url) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto& server = _servers[server_url];
+            if (!server) {
+                server = std::make_shared<Server>();
+                server->max_in_flight = _max_in_flight;
+                server->slots = std::make_shared<utils::AsyncSemaphore>(_max_in_flight);
+                server->latency_counts.assign(latency_buckets_ms().size() + 1, 0);
+                std::cout << "[HTTP CLIENT] Opened pooled MCP client for " << server_url << std::endl;
+            }
+            std::lock_guard<std::mutex> server_lock(server->mutex);
+            server->last_used = std::chrono::steady_clock::now();
+            return server;
+        }
+
+        pplx::task<http_response> McpClientPool::post(const std::string& server_url,
+                                                      const json::value& body,
+                                                      std::chrono::seconds timeout) {
+            auto server = server_for(server_url);
+
+            std::shared_ptr<http_client> client;
+            {
+                std::lock_guard<std::mutex> lock(server->mutex);
+                auto& pooled = server->clients[static_cast<long>(timeout.count())];
+                if (!pooled) {
+                    http_client_config config;
+                    config.set_timeout(timeout);
+                    pooled = std::make_shared<http_client>(U(server_url), config);
+                }
+                client = pooled;
+            }
+
+            auto started = std::make_shared<std::chrono::steady_clock::time_point>();
+            return server->slots->acquire().then([server, client, body, started]() {
+                server->in_flight++;
+                server->requests++;
+                *started = std::chrono::steady_clock::now();
+                return client->request(methods::POST, U(""), body);
+            }).then([server, started](pplx::task<http_response> response_task) {
+                double latency_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - *started).count();
+                server->in_flight--;
+                server->slots->release();
+                try {
+                    http_response response = response_task.get();
+                    record(*server, latency_ms, response.status_code() == status_codes::OK);
+                    return response;
+                } catch (...) {
+                    record(*server, latency_ms, false);
+                    throw;
+                }
+            });
+        }
+
+        void McpClientPool::record(Server& server, double latency_ms, bool ok) {
+            if (!ok) {
+                server.errors++;
+            }
+            const auto& buckets = latency_buckets_ms();
+            size_t bucket = std::lower_bound(buckets.begin(), buckets.end(), latency_ms) - buckets.begin();
+
+            std::lock_guard<std::mutex> lock(server.mutex);
+            server.latency_counts[bucket]++;
+            server.latency_sum_ms += latency_ms;
+            server.last_used = std::chrono::steady_clock::now();
+        }
+
+        void McpClientPool::evict(const std::string& server_url) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_servers.erase(server_url) > 0) {
+                std::cout << "[HTTP CLIENT] Closed pooled MCP client for " << server_url << std::endl;
+            }
+        }
+
+        size_t McpClientPool::evict_idle() {
+            auto now = std::chrono::steady_clock::now();
+            size_t evicted = 0;
+
+            std::lock_guard<std::mutex> lock(_mutex);
+            for (auto it = _servers.begin(); it != _servers.end();) {
+                auto& server = *it->second;
+                bool idle;
+                {
+                    std::lock_guard<std::mutex> server_lock(server.mutex);
+                    idle = server.in_flight.load() == 0 && now - server.last_used >= _idle_timeout;
+                }
+                if (idle) {
+                    // In-flight callers keep their own reference; only future calls get a new client
+                    std::cout << "[HTTP CLIENT] Evicting idle MCP client for " << it->first << std::endl;
+                    it = _servers.erase(it);
+                    evicted++;
+                } else {
+                    ++it;
+                }
+            }
+            return evicted;
+        }
+
+        nlohmann::json McpClientPool::server_metrics(Server& server) {
+            nlohmann::json metrics;
+            metrics["requests"] = server.requests.load();
+            metrics["errors"] = server.errors.load();
+            metrics["in_flight"] = server.in_flight.load();
+            metrics["max_in_flight"] = server.max_in_flight;
+
+            std::lock_guard<std::mutex> lock(server.mutex);
+            metrics["pooled_clients"] = server.clients.size();
+
+            const auto& buckets = latency_buckets_ms();
+            nlohmann::json histogram = nlohmann::json::array();
+            uint64_t total = 0;
+            for (size_t i = 0; i < server.latency_counts.size(); ++i) {
+                total += server.latency_counts[i];
+                nlohmann::json bucket;
+                if (i < buckets.size()) {
+                    bucket["le_ms"] = buckets[i];
+                } else {
+                    bucket["le_ms"] = "+Inf";
+                }
+                bucket["count"] = server.latency_counts[i];
+                histogram.push_back(bucket);
+            }
+            metrics["latency_histogram"] = histogram;
+            metrics["latency_count"] = total;
+            metrics["latency_mean_ms"] = total > 0 ? server.latency_sum_ms / static_cast<double>(total) : 0.0;
+            return metrics;
+        }
+
+        nlohmann::json McpClientPool::get_server_metrics(const std::string& server_url) const {
+            std::shared_ptr<Server> server;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                auto it = _servers.find(server_url);
+                if (it == _servers.end()) {
+                    return nullptr;
+                }
+                server = it->second;
+            }
+            return server_metrics(*server);
+        }
+
+        nlohmann::json McpClientPool::get_metrics() const {
+            std::vector<std::pair<std::string, std::shared_ptr<Server>>> servers;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                servers.assign(_servers.begin(), _servers.end());
+            }
+            nlohmann::json metrics = nlohmann::json::object();
+            for (const auto& entry : servers) {
+                metrics[entry.first] = server_metrics(*entry.second);
+            }
+            return metrics;
+        }
+    }
+}
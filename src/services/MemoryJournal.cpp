@@ -0,0 +1,488 @@
+#include <lily/services/MemoryJournal.hpp>
+#include <iostream>
+#include <algorithm>
+#include <cstdio>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace lily {
+    namespace services {
+        namespace {
+            const size_t kFrameHeader = 2 * sizeof(uint32_t); // length, crc32
+            const size_t kMaxBatchBytes = 1 << 20;            // flush early once this much is pending
+            const size_t kChunkBytes = 256 << 10;
+            const size_t kMaxSpareChunks = 8;
+
+            uint32_t crc32(const char* data, size_t size) {
+                static const std::vector<uint32_t> table = []() {
+                    std::vector<uint32_t> entries(256);
+                    for (uint32_t i = 0; i < 256; i++) {
+                        uint32_t c = i;
+                        for (int k = 0; k < 8; k++) {
+                            c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                        }
+                        entries[i] = c;
+                    }
+                    return entries;
+                }();
+                uint32_t crc = 0xFFFFFFFFu;
+                for (size_t i = 0; i < size; i++) {
+                    crc = table[(crc ^ static_cast<uint8_t>(data[i])) & 0xFF] ^ (crc >> 8);
+                }
+                return crc ^ 0xFFFFFFFFu;
+            }
+
+            bool write_all(int fd, const char* data, size_t size) {
+                while (size > 0) {
+                    ssize_t written = ::write(fd, data, size);
+                    if (written < 0) {
+                        if (errno == EINTR) {
+                            continue;
+                        }
+                        return false;
+                    }
+                    data += written;
+                    size -= static_cast<size_t>(written);
+                }
+                return true;
+            }
+
+            // Whole file, read-only; null for a missing or empty file
+            std::unique_ptr<MemoryJournal::Mapping> map_file(const std::string& path) {
+                int fd = ::open(path.c_str(), O_RDONLY);
+                if (fd < 0) {
+                    return nullptr;
+                }
+                struct stat info;
+                if (::fstat(fd, &info) != 0 || info.st_size == 0) {
+                    ::close(fd);
+                    return nullptr;
+                }
+                size_t size = static_cast<size_t>(info.st_size);
+                void* mapped = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+                ::close(fd);
+                if (mapped == MAP_FAILED) {
+                    std::cerr << "[MEMORY] Cannot map " << path << ": " << std::strerror(errno) << std::endl;
+                    return nullptr;
+                }
+                ::madvise(mapped, size, MADV_SEQUENTIAL);
+                return std::unique_ptr<MemoryJournal::Mapping>(new MemoryJournal::Mapping(static_cast<const char*>(mapped), size));
+            }
+        }
+
+        MemoryJournal::Mapping::~Mapping() {
+            ::munmap(const_cast<char*>(_data), _size);
+        }
+
+        MemoryJournal::MemoryJournal(const std::string& directory, std::chrono::milliseconds flush_interval, size_t snapshot_wal_bytes)
+            : _directory(directory), _flush_interval(flush_interval), _snapshot_wal_bytes(snapshot_wal_bytes) {
+            while (_directory.size() > 1 && _directory.back() == '/') {
+                _directory.pop_back();
+            }
+            if (_directory.empty()) {
+                return;
+            }
+            // Parents too: /app/data is only there when a volume is mounted
+            for (size_t slash = _directory.find('/', 1); slash != std::string::npos; slash = _directory.find('/', slash + 1)) {
+                ::mkdir(_directory.substr(0, slash).c_str(), 0755);
+            }
+            if (::mkdir(_directory.c_str(), 0755) == 0 || errno == EEXIST) {
+                _enabled = true;
+            } else {
+                std::cerr << "[MEMORY] Cannot create " << _directory << ": " << std::strerror(errno)
+                          << ", conversations will not survive a restart" << std::endl;
+            }
+        }
+
+        MemoryJournal::~MemoryJournal() {
+            stop();
+        }
+
+        std::string MemoryJournal::wal_path(uint64_t generation) const {
+            return _directory + "/wal-" + std::to_string(generation) + ".log";
+        }
+
+        std::string MemoryJournal::snapshot_path() const {
+            return _directory + "/snapshot.bin";
+        }
+
+        std::string MemoryJournal::previous_snapshot_path() const {
+            return _directory + "/snapshot.prev.bin";
+        }
+
+        std::unique_ptr<MemoryJournal::Mapping> MemoryJournal::map_snapshot() const {
+            return _enabled ? map_file(snapshot_path()) : nullptr;
+        }
+
+        std::unique_ptr<MemoryJournal::Mapping> MemoryJournal::map_previous_snapshot() const {
+            return _enabled ? map_file(previous_snapshot_path()) : nullptr;
+        }
+
+        void MemoryJournal::set_aside_snapshot() {
+            std::string damaged = _directory + "/snapshot.damaged.bin";
+            if (std::rename(snapshot_path().c_str(), damaged.c_str()) != 0) {
+                std::cerr << "[MEMORY] Cannot move the damaged snapshot aside: " << std::strerror(errno) << std::endl;
+            }
+        }
+
+        std::vector<uint64_t> MemoryJournal::generations() const {
+            std::vector<uint64_t> found;
+            DIR* dir = _enabled ? ::opendir(_directory.c_str()) : nullptr;
+            if (!dir) {
+                return found;
+            }
+            while (dirent* item = ::readdir(dir)) {
+                unsigned long long generation = 0;
+                char tail = 0;
+                if (std::sscanf(item->d_name, "wal-%llu.lo%c", &generation, &tail) == 2 && tail == 'g') {
+                    found.push_back(generation);
+                }
+            }
+            ::closedir(dir);
+            std::sort(found.begin(), found.end());
+            return found;
+        }
+
+        size_t MemoryJournal::replay(uint64_t generation, const std::function<void(const char* payload, size_t size)>& visit) const {
+            std::string path = wal_path(generation);
+            auto mapping = map_file(path);
+            if (!mapping) {
+                return 0;
+            }
+            size_t records = 0;
+            size_t offset = 0;
+            while (offset + kFrameHeader <= mapping->size()) {
+                uint32_t length;
+                uint32_t checksum;
+                std::memcpy(&length, mapping->data() + offset, sizeof(length));
+                std::memcpy(&checksum, mapping->data() + offset + sizeof(length), sizeof(checksum));
+                const char* payload = mapping->data() + offset + kFrameHeader;
+                if (length > mapping->size() - offset - kFrameHeader || crc32(payload, length) != checksum) {
+                    break;
+                }
+                visit(payload, length);
+                records++;
+                offset += kFrameHeader + length;
+            }
+            if (offset < mapping->size()) {
+                // A crash mid-flush leaves a partial batch at the end; everything before it is intact
+                std::cerr << "[MEMORY] Ignoring " << (mapping->size() - offset) << " torn bytes at the end of " << path << std::endl;
+            }
+            return records;
+        }
+
+        bool MemoryJournal::open_generation(uint64_t generation) {
+            int fd = ::open(wal_path(generation).c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+            if (fd < 0) {
+                std::cerr << "[MEMORY] Cannot open " << wal_path(generation) << ": " << std::strerror(errno) << std::endl;
+                return false;
+            }
+            if (_wal_fd >= 0) {
+                ::close(_wal_fd);
+            }
+            struct stat info;
+            _wal_fd = fd;
+            _wal_size = ::fstat(fd, &info) == 0 ? static_cast<uint64_t>(info.st_size) : 0;
+            _wal_torn = false;
+            _generation = generation;
+            return true;
+        }
+
+        void MemoryJournal::start(CompactionHandler on_compact, uint64_t snapshot_generation) {
+            if (!_enabled || _flush_thread.joinable()) {
+                return;
+            }
+            // Never append to a generation that may end in a torn frame
+            auto existing = generations();
+            if (!open_generation(existing.empty() ? 1 : existing.back() + 1)) {
+                _enabled = false;
+                return;
+            }
+            _on_compact = std::move(on_compact);
+            _snapshot_generation = snapshot_generation;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _running = true;
+            }
+            _flush_thread = std::thread(&MemoryJournal::flush_loop, this);
+        }
+
+        void MemoryJournal::stop() {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _running = false;
+            }
+            _wake.notify_all();
+            if (_flush_thread.joinable()) {
+                _flush_thread.join();
+            }
+            if (_wal_fd >= 0) {
+                ::close(_wal_fd);
+                _wal_fd = -1;
+            }
+        }
+
+        void MemoryJournal::append(const std::string& payload) {
+            if (!_enabled) {
+                return;
+            }
+            size_t frame = kFrameHeader + payload.size();
+            bool wake;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if (!_running) {
+                    return;
+                }
+                if (_pending.empty() || (!_pending.back().empty() && _pending.back().size() + frame > kChunkBytes)) {
+                    if (_spare.empty()) {
+                        _pending.emplace_back();
+                        _pending.back().reserve(kChunkBytes);
+                    } else {
+                        _pending.push_back(std::move(_spare.back()));
+                        _spare.pop_back();
+                    }
+                }
+                std::string& chunk = _pending.back();
+                journal::put<uint32_t>(chunk, static_cast<uint32_t>(payload.size()));
+                journal::put<uint32_t>(chunk, 0); // checksum, filled in by the flush thread
+                chunk.append(payload);
+
+                size_t before = _pending_bytes;
+                _pending_bytes += frame;
+                _pending_records++;
+                // The first record starts a group commit window; a full batch ends it early
+                wake = before == 0 || (before < kMaxBatchBytes && _pending_bytes >= kMaxBatchBytes);
+            }
+            if (wake) {
+                _wake.notify_one();
+            }
+        }
+
+        void MemoryJournal::flush_loop() {
+            std::vector<std::string> batch;
+            // After a failed snapshot (e.g. a full disk), wait before rotating and trying again
+            std::chrono::seconds backoff(0);
+            std::chrono::steady_clock::time_point retry_at;
+            std::unique_lock<std::mutex> lock(_mutex);
+            while (true) {
+                _wake.wait(lock, [this]() { return !_running || _pending_bytes > 0; });
+                if (_running) {
+                    // Group commit: let concurrent requests join this flush
+                    _wake.wait_for(lock, _flush_interval, [this]() { return !_running || _pending_bytes >= kMaxBatchBytes; });
+                }
+                bool stopping = !_running;
+                batch.swap(_pending);
+                size_t records = _pending_records;
+                _pending_bytes = 0;
+                _pending_records = 0;
+                lock.unlock();
+
+                if (!batch.empty()) {
+                    write_batch(batch, records);
+                    recycle(batch);
+                }
+                if (!stopping && _on_compact && _snapshot_wal_bytes > 0 && _wal_bytes_since_snapshot >= _snapshot_wal_bytes &&
+                    std::chrono::steady_clock::now() >= retry_at) {
+                    if (_on_compact()) {
+                        backoff = std::chrono::seconds(0);
+                    } else {
+                        _snapshot_errors++;
+                        backoff = std::min(std::chrono::seconds(300), std::max(std::chrono::seconds(1), backoff * 2));
+                        retry_at = std::chrono::steady_clock::now() + backoff;
+                        std::cerr << "[MEMORY] Snapshot failed, retrying in " << backoff.count() << "s" << std::endl;
+                    }
+                }
+
+                lock.lock();
+                if (stopping && _pending_bytes == 0) {
+                    return;
+                }
+            }
+        }
+
+        // Checksums every frame, then one fdatasync for the whole batch. Flush thread only.
+        void MemoryJournal::write_batch(std::vector<std::string>& chunks, size_t records) {
+            // Replay stops at the first bad frame, so nothing may follow a partial batch
+            if (_wal_torn && !open_generation(_generation + 1)) {
+                _flush_errors++;
+                std::cerr << "[MEMORY] Dropping " << records << " records: no usable log file" << std::endl;
+                return;
+            }
+            auto start = std::chrono::steady_clock::now();
+            size_t bytes = 0;
+            bool written = true;
+            for (auto& chunk : chunks) {
+                for (size_t offset = 0; offset + kFrameHeader <= chunk.size();) {
+                    uint32_t length;
+                    std::memcpy(&length, &chunk[offset], sizeof(length));
+                    uint32_t checksum = crc32(&chunk[offset + kFrameHeader], length);
+                    std::memcpy(&chunk[offset + sizeof(length)], &checksum, sizeof(checksum));
+                    offset += kFrameHeader + length;
+                }
+                written = written && write_all(_wal_fd, chunk.data(), chunk.size());
+                bytes += chunk.size();
+            }
+            if (!written || ::fdatasync(_wal_fd) != 0) {
+                _flush_errors++;
+                std::cerr << "[MEMORY] Failed to write " << records << " records to " << wal_path(_generation)
+                          << ": " << std::strerror(errno) << std::endl;
+                // Cut the batch off again; the next one starts a fresh generation if that fails too
+                if (::ftruncate(_wal_fd, static_cast<off_t>(_wal_size)) != 0 || ::fdatasync(_wal_fd) != 0) {
+                    _wal_torn = true;
+                }
+                return;
+            }
+            _wal_size += bytes;
+            auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+            _fsync_micros += static_cast<uint64_t>(elapsed.count());
+            _flushes++;
+            _records += records;
+            _bytes += bytes;
+            _wal_bytes_since_snapshot += bytes;
+            if (records > _max_batch_records) {
+                _max_batch_records = records;
+            }
+        }
+
+        // Hands written chunks back to append() with their capacity
+        void MemoryJournal::recycle(std::vector<std::string>& chunks) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            for (auto& chunk : chunks) {
+                if (_spare.size() >= kMaxSpareChunks) {
+                    break;
+                }
+                chunk.clear();
+                _spare.push_back(std::move(chunk));
+            }
+            chunks.clear();
+        }
+
+        uint64_t MemoryJournal::rotate() {
+            std::vector<std::string> batch;
+            size_t records;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                batch.swap(_pending);
+                records = _pending_records;
+                _pending_bytes = 0;
+                _pending_records = 0;
+            }
+            // Everything appended before the swap belongs to the old generation
+            if (!batch.empty()) {
+                write_batch(batch, records);
+                recycle(batch);
+            }
+            uint64_t next = _generation + 1;
+            if (!open_generation(next)) {
+                return 0;
+            }
+            return next;
+        }
+
+        bool MemoryJournal::begin_snapshot() {
+            std::string temporary = snapshot_path() + ".tmp";
+            _snapshot_fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (_snapshot_fd < 0) {
+                std::cerr << "[MEMORY] Cannot create " << temporary << ": " << std::strerror(errno) << std::endl;
+                return false;
+            }
+            return true;
+        }
+
+        bool MemoryJournal::write_snapshot(const std::string& bytes) {
+            if (_snapshot_fd < 0) {
+                return false;
+            }
+            if (!write_all(_snapshot_fd, bytes.data(), bytes.size())) {
+                std::cerr << "[MEMORY] Failed to write snapshot: " << std::strerror(errno) << std::endl;
+                ::close(_snapshot_fd);
+                _snapshot_fd = -1;
+                std::remove((snapshot_path() + ".tmp").c_str());
+                return false;
+            }
+            return true;
+        }
+
+        void MemoryJournal::abort_snapshot() {
+            if (_snapshot_fd >= 0) {
+                ::close(_snapshot_fd);
+                _snapshot_fd = -1;
+                std::remove((snapshot_path() + ".tmp").c_str());
+            }
+        }
+
+        // header overwrites the start of the file, which the caller reserved when it began writing
+        bool MemoryJournal::commit_snapshot(const std::string& header, uint64_t generation) {
+            if (_snapshot_fd < 0) {
+                return false;
+            }
+            std::string temporary = snapshot_path() + ".tmp";
+            struct stat info;
+            bool written = ::pwrite(_snapshot_fd, header.data(), header.size(), 0) == static_cast<ssize_t>(header.size()) &&
+                           ::fsync(_snapshot_fd) == 0 && ::fstat(_snapshot_fd, &info) == 0;
+            ::close(_snapshot_fd);
+            _snapshot_fd = -1;
+            // The snapshot being replaced stays behind as the previous one (a second name for the same file);
+            // with none (first snapshot, or one set aside), an existing previous snapshot stays
+            std::string previous = previous_snapshot_path();
+            bool kept_previous = false;
+            if (written && ::access(snapshot_path().c_str(), F_OK) == 0) {
+                std::remove(previous.c_str());
+                kept_previous = ::link(snapshot_path().c_str(), previous.c_str()) == 0;
+            } else if (written) {
+                kept_previous = ::access(previous.c_str(), F_OK) == 0;
+            }
+            // Readers see the old snapshot or the complete new one
+            if (!written || std::rename(temporary.c_str(), snapshot_path().c_str()) != 0) {
+                std::cerr << "[MEMORY] Failed to commit snapshot: " << std::strerror(errno) << std::endl;
+                std::remove(temporary.c_str());
+                return false;
+            }
+            int dir = ::open(_directory.c_str(), O_RDONLY | O_DIRECTORY);
+            if (dir >= 0) {
+                ::fsync(dir);
+                ::close(dir);
+            }
+
+            // The previous snapshot needs the log from its own generation on
+            uint64_t keep_from = kept_previous ? _snapshot_generation : generation;
+            for (uint64_t old : generations()) {
+                if (old < keep_from) {
+                    std::remove(wal_path(old).c_str());
+                }
+            }
+            _snapshot_generation = generation;
+            _wal_bytes_since_snapshot = 0;
+            _snapshots++;
+            _last_snapshot_bytes = static_cast<uint64_t>(info.st_size);
+            return true;
+        }
+
+        nlohmann::json MemoryJournal::get_metrics() const {
+            nlohmann::json metrics;
+            metrics["enabled"] = _enabled;
+            if (!_enabled) {
+                return metrics;
+            }
+            uint64_t flushes = _flushes.load();
+            metrics["directory"] = _directory;
+            metrics["generation"] = _generation.load();
+            metrics["records"] = _records.load();
+            metrics["bytes"] = _bytes.load();
+            metrics["flushes"] = flushes;
+            metrics["flush_errors"] = _flush_errors.load();
+            metrics["records_per_flush"] = flushes > 0 ? static_cast<double>(_records.load()) / flushes : 0.0;
+            metrics["max_records_per_flush"] = _max_batch_records.load();
+            metrics["avg_flush_ms"] = flushes > 0 ? _fsync_micros.load() / 1000.0 / flushes : 0.0;
+            metrics["wal_bytes_since_snapshot"] = _wal_bytes_since_snapshot.load();
+            metrics["snapshots"] = _snapshots.load();
+            metrics["snapshot_errors"] = _snapshot_errors.load();
+            metrics["last_snapshot_bytes"] = _last_snapshot_bytes.load();
+            return metrics;
+        }
+    }
+}
@@ -1,38 +1,758 @@
 #include "lily/services/MemoryService.hpp"
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 using namespace lily::services;
 
+namespace {
+    // Journal record types
+    const uint8_t kAddRecord = 1;
+    const uint8_t kClearRecord = 2;
+    const uint8_t kSummaryRecord = 3;
+    const size_t kLsnOffset = 1; // the sequence number follows the type byte
+
+    const char kSnapshotMagic[8] = {'L', 'I', 'L', 'Y', 'M', 'E', 'M', '1'};
+    const uint32_t kSnapshotVersion = 1;
+
+    int64_t to_nanoseconds(std::chrono::system_clock::time_point timestamp) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(timestamp.time_since_epoch()).count();
+    }
+
+    std::chrono::system_clock::time_point from_nanoseconds(int64_t nanoseconds) {
+        return std::chrono::system_clock::time_point(
+            std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds(nanoseconds)));
+    }
+
+    // Type, a placeholder sequence number (filled in under the shard lock) and the user
+    std::string begin_record(uint8_t type, const std::string& user_id, size_t extra) {
+        std::string record;
+        record.reserve(1 + sizeof(uint64_t) + sizeof(uint32_t) + user_id.size() + extra);
+        journal::put<uint8_t>(record, type);
+        journal::put<uint64_t>(record, 0);
+        journal::put_bytes(record, user_id);
+        return record;
+    }
+}
+
 MemoryService::MemoryService() {
     // Constructor implementation
 }
 
 MemoryService::~MemoryService() {
-    // Destructor implementation
+    {
+        std::lock_guard<std::mutex> lock(_summary_mutex);
+        _summary_running = false;
+    }
+    _summary_wake.notify_all();
+    if (_summary_thread.joinable()) {
+        _summary_thread.join();
+    }
+    // Flushes what is pending; no snapshot can run against a half-destroyed store
+    if (_journal) {
+        _journal->stop();
+    }
+}
+
+size_t MemoryService::shard_index(const std::string& user_id) {
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : user_id) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return static_cast<size_t>(hash % kShards);
+}
+
+MemoryService::Shard& MemoryService::shard_for(const std::string& user_id) {
+    return _shards[shard_index(user_id)];
+}
+
+const MemoryService::Shard& MemoryService::shard_for(const std::string& user_id) const {
+    return _shards[shard_index(user_id)];
+}
+
+MemoryService::Conversation& MemoryService::conversation_locked(Shard& shard, const std::string& user_id) {
+    auto inserted = shard.conversations.emplace(user_id, Conversation());
+    if (inserted.second) {
+        inserted.first->second.id = ++_next_conversation_id;
+    }
+    return inserted.first->second;
+}
+
+void MemoryService::set_history_limit(size_t max_history_tokens) {
+    _max_history_tokens = max_history_tokens;
+}
+
+void MemoryService::set_summarizer(Summarizer summarizer, size_t threshold_tokens, size_t keep_recent_tokens, size_t max_summary_tokens) {
+    bool enabled = summarizer && threshold_tokens > 0;
+    {
+        // Waits for a summary in progress, so the old summarizer is not running after this returns
+        std::lock_guard<std::mutex> lock(_summarizer_mutex);
+        _summarizer = std::move(summarizer);
+        _summary_threshold_tokens = enabled ? threshold_tokens : 0;
+        _summary_keep_tokens = keep_recent_tokens;
+        _summary_max_tokens = max_summary_tokens;
+    }
+
+    std::lock_guard<std::mutex> lock(_summary_mutex);
+    if (enabled && !_summary_thread.joinable()) {
+        _summary_running = true;
+        _summary_thread = std::thread(&MemoryService::summarize_loop, this);
+    }
+}
+
+const std::string& lily::services::role_name(Role role) {
+    static const std::string names[] = {"user", "assistant", "system"};
+    return names[static_cast<size_t>(role)];
+}
+
+// Copies content into the open block, or gives a large body a block of its own (taking over
+// the buffer of owned, which is content itself, when the caller gave it up and it has little slack)
+MemoryService::Record MemoryService::Arena::append(const char* data, size_t size, std::string* owned) {
+    Record record{};
+    record.length = static_cast<uint32_t>(size);
+
+    if (size >= kMaxBlockBytes) {
+        Block block;
+        if (owned && owned->capacity() - owned->size() <= owned->size() / 4) {
+            block.bytes = std::move(*owned);
+        } else {
+            block.bytes.reserve(size);
+            block.bytes.assign(data, size);
+        }
+        block.live = 1;
+        blocks.push_back(std::move(block));
+        record.block = first_block + static_cast<uint32_t>(blocks.size() - 1);
+        record.offset = 0;
+        return record;
+    }
+
+    Block* open = has_open ? &blocks[open_block - first_block] : nullptr;
+    if (!open || open->bytes.size() + size > kMaxBlockBytes) {
+        if (open) {
+            open->bytes.shrink_to_fit(); // sealed: no more appends
+        }
+        Block block;
+        block.bytes.reserve(std::max(kMinBlockBytes, size));
+        blocks.push_back(std::move(block));
+        open_block = first_block + static_cast<uint32_t>(blocks.size() - 1);
+        has_open = true;
+        open = &blocks.back();
+    } else if (open->bytes.size() + size > open->bytes.capacity()) {
+        // Grows like a vector, so a short conversation holds little slack; offsets survive the move
+        open->bytes.reserve(std::min(std::max(open->bytes.capacity() * 2, open->bytes.size() + size), kMaxBlockBytes));
+    }
+    record.block = open_block;
+    record.offset = static_cast<uint32_t>(open->bytes.size());
+    open->bytes.append(data, size);
+    open->live++;
+    return record;
 }
 
-const std::vector<Message>& MemoryService::get_conversation(const std::string& user_id) {
-    if (conversations.find(user_id) == conversations.end()) {
-        conversations[user_id] = std::vector<Message>();
+void MemoryService::Arena::release(const Record& record) {
+    blocks[record.block - first_block].live--;
+    size_t drop = 0;
+    while (drop < blocks.size() && blocks[drop].live == 0) {
+        if (has_open && open_block == first_block) {
+            has_open = false;
+        }
+        drop++;
+        first_block++;
     }
-    return conversations[user_id];
+    blocks.erase(blocks.begin(), blocks.begin() + static_cast<std::ptrdiff_t>(drop));
 }
 
-void MemoryService::add_message(const std::string& user_id, const std::string& role, const std::string& content) {
+const char* MemoryService::Arena::data(const Record& record) const {
+    return blocks[record.block - first_block].bytes.data() + record.offset;
+}
+
+Message MemoryService::to_message(const Conversation& conversation, const Record& record) {
     Message message;
-    message.role = role;
-    message.content = content;
-    message.timestamp = std::chrono::system_clock::now();
-    conversations[user_id].push_back(message);
+    message.role = record.role;
+    message.content.assign(conversation.arena.data(record), record.length);
+    message.timestamp = record.timestamp;
+    message.tokens = record.tokens;
+    return message;
+}
+
+void MemoryService::pop_front(Conversation& conversation) {
+    const Record& record = conversation.messages.front();
+    conversation.tokens -= record.tokens;
+    conversation.arena.release(record);
+    conversation.messages.pop_front();
+    conversation.first_sequence++;
+}
+
+size_t MemoryService::estimate_tokens(const std::string& text) {
+    size_t ascii = 0;
+    size_t other = 0;
+    for (unsigned char c : text) {
+        if (c < 0x80) {
+            ascii++;
+        } else if (c >= 0xC0) {
+            other++; // lead byte of a multi-byte character
+        }
+    }
+    return (ascii + 3) / 4 + other;
+}
+
+std::string MemoryService::truncate_to_tokens(const std::string& text, size_t max_tokens) {
+    size_t ascii = 0;
+    size_t other = 0;
+    size_t end = 0;
+    while (end < text.size()) {
+        unsigned char c = static_cast<unsigned char>(text[end]);
+        size_t length = c < 0x80 ? 1 : c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : 2;
+        size_t tokens = c < 0x80 ? (ascii + 4) / 4 + other : (ascii + 3) / 4 + other + 1;
+        if (tokens > max_tokens || end + length > text.size()) {
+            break;
+        }
+        (c < 0x80 ? ascii : other)++;
+        end += length;
+    }
+    if (end == text.size() || end == 0) {
+        return text.substr(0, end);
+    }
+    // Prefer a whole sentence unless that would give up more than half of what fits
+    size_t sentence = text.find_last_of(".!?\n", end - 1);
+    if (sentence != std::string::npos && sentence + 1 >= end / 2) {
+        end = sentence + 1;
+    }
+    return text.substr(0, end);
+}
+
+std::vector<Message> MemoryService::get_conversation(const std::string& user_id) const {
+    const Shard& shard = shard_for(user_id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.conversations.find(user_id);
+    if (it == shard.conversations.end()) {
+        return {};
+    }
+    std::vector<Message> messages;
+    messages.reserve(it->second.messages.size());
+    for (const auto& record : it->second.messages) {
+        messages.push_back(to_message(it->second, record));
+    }
+    return messages;
+}
+
+MemoryService::ContextWindow MemoryService::get_context_window(const std::string& user_id, size_t max_tokens) const {
+    ContextWindow window;
+    const Shard& shard = shard_for(user_id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.conversations.find(user_id);
+    if (it == shard.conversations.end()) {
+        return window;
+    }
+    const Conversation& conversation = it->second;
+
+    size_t used = 0;
+    if (!conversation.summary.empty() && conversation.summary_tokens <= max_tokens) {
+        window.summary = conversation.summary;
+        used = conversation.summary_tokens;
+    } else if (!conversation.summary.empty()) {
+        // Larger than the whole window (a small budget, or a summary from before the cap): keep its start
+        // in half the budget rather than dropping it
+        window.summary = truncate_to_tokens(conversation.summary, max_tokens / 2);
+        used = window.summary.empty() ? 0 : estimate_tokens(window.summary) + 2;
+    }
+
+    // Walk back from the newest message until the budget is spent
+    size_t count = 0;
+    for (auto message = conversation.messages.rbegin(); message != conversation.messages.rend(); ++message) {
+        if (used + message->tokens > max_tokens) {
+            break;
+        }
+        used += message->tokens;
+        count++;
+    }
+    window.messages.reserve(count);
+    for (auto record = conversation.messages.end() - static_cast<std::ptrdiff_t>(count); record != conversation.messages.end(); ++record) {
+        window.messages.push_back(to_message(conversation, *record));
+    }
+    return window;
+}
+
+void MemoryService::add_message(const std::string& user_id, Role role, const std::string& content) {
+    append(user_id, role, content, nullptr);
+}
+
+void MemoryService::add_message(const std::string& user_id, Role role, std::string&& content) {
+    append(user_id, role, content, &content);
+}
+
+void MemoryService::append(const std::string& user_id, Role role, const std::string& content, std::string* owned) {
+    // Estimated (and encoded) before taking the lock so the critical section is just the append
+    size_t tokens = estimate_tokens(role_name(role)) + estimate_tokens(content) + 2; // plus the "role: " framing
+    auto timestamp = std::chrono::system_clock::now();
+    size_t threshold = _summary_threshold_tokens;
+    std::string record;
+    if (journaling()) {
+        record = begin_record(kAddRecord, user_id, 1 + sizeof(int64_t) + 2 * sizeof(uint32_t) + content.size());
+        journal::put<uint8_t>(record, static_cast<uint8_t>(role));
+        journal::put<int64_t>(record, to_nanoseconds(timestamp));
+        journal::put<uint32_t>(record, static_cast<uint32_t>(tokens));
+        journal::put_bytes(record, content);
+    }
+
+    bool due = false;
+    {
+        Shard& shard = shard_for(user_id);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        Conversation& conversation = conversation_locked(shard, user_id);
+        append_locked(conversation, role, timestamp, tokens, content.data(), content.size(), owned);
+        if (!record.empty()) {
+            log_locked(record);
+        }
+
+        if (threshold > 0 && !conversation.summary_pending &&
+            conversation.tokens > threshold && conversation.tokens > conversation.summary_retry_tokens) {
+            conversation.summary_pending = true;
+            due = true;
+        }
+    }
+
+    if (due) {
+        {
+            std::lock_guard<std::mutex> lock(_summary_mutex);
+            _summary_queue.push_back(user_id);
+        }
+        _summary_wake.notify_one();
+    }
+}
+
+// Also replays logged messages, so eviction here must stay a pure function of the conversation
+void MemoryService::append_locked(Conversation& conversation, Role role, std::chrono::system_clock::time_point timestamp,
+                                  size_t tokens, const char* data, size_t size, std::string* owned) {
+    Record record = conversation.arena.append(data, size, owned);
+    record.timestamp = timestamp;
+    record.tokens = static_cast<uint32_t>(tokens);
+    record.role = role;
+    conversation.tokens += tokens;
+    conversation.messages.push_back(record);
+
+    // Evict the oldest turns, always keeping the newest message
+    size_t limit = _max_history_tokens;
+    while (limit > 0 && conversation.tokens > limit && conversation.messages.size() > 1) {
+        pop_front(conversation);
+    }
+}
+
+void MemoryService::apply_summary_locked(Conversation& conversation, uint64_t cut_sequence, std::string summary) {
+    // Turns evicted meanwhile by the history limit are already gone
+    while (!conversation.messages.empty() && conversation.first_sequence < cut_sequence) {
+        pop_front(conversation);
+    }
+    conversation.summary = std::move(summary);
+    conversation.summary_tokens = estimate_tokens(conversation.summary) + 2;
+    conversation.summary_retry_tokens = 0;
 }
 
 void MemoryService::clear_conversation(const std::string& user_id) {
-    if (conversations.find(user_id) != conversations.end()) {
-        conversations.erase(user_id);
+    std::string record;
+    if (journaling()) {
+        record = begin_record(kClearRecord, user_id, 0);
+    }
+    Shard& shard = shard_for(user_id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.conversations.erase(user_id);
+    if (!record.empty()) {
+        log_locked(record);
     }
 }
 
 std::string MemoryService::summarize_conversation(const std::string& user_id) {
-    // Suppress unused parameter warning
-    (void)user_id;
-    return "This is a placeholder summary.";
-}
\ No newline at end of file
+    const Shard& shard = shard_for(user_id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.conversations.find(user_id);
+    return it == shard.conversations.end() ? std::string() : it->second.summary;
+}
+
+void MemoryService::summarize_loop() {
+#ifdef __linux__
+    // Below the request threads: compaction only uses otherwise idle CPU
+    setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 10);
+#endif
+    std::unique_lock<std::mutex> lock(_summary_mutex);
+    while (true) {
+        _summary_wake.wait(lock, [this]() { return !_summary_running || !_summary_queue.empty(); });
+        if (!_summary_running) {
+            return;
+        }
+        std::string user_id = std::move(_summary_queue.front());
+        _summary_queue.pop_front();
+        lock.unlock();
+        summarize(user_id);
+        lock.lock();
+    }
+}
+
+// Folds all but the newest keep_recent_tokens of the conversation into its summary
+void MemoryService::summarize(const std::string& user_id) {
+    Shard& shard = shard_for(user_id);
+    uint64_t id;
+    uint64_t cut_sequence;
+    std::string previous;
+    std::vector<Message> turns;
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.conversations.find(user_id);
+        if (it == shard.conversations.end()) {
+            return;
+        }
+        Conversation& conversation = it->second;
+        size_t keep = _summary_keep_tokens;
+        size_t tail_tokens = 0;
+        size_t tail = 0;
+        for (auto message = conversation.messages.rbegin(); message != conversation.messages.rend(); ++message) {
+            if (tail > 0 && tail_tokens + message->tokens > keep) {
+                break;
+            }
+            tail_tokens += message->tokens;
+            tail++;
+        }
+        size_t older = conversation.messages.size() - tail;
+        if (older == 0) {
+            conversation.summary_pending = false;
+            return;
+        }
+        id = conversation.id;
+        cut_sequence = conversation.first_sequence + older;
+        previous = conversation.summary;
+        turns.reserve(older);
+        for (size_t i = 0; i < older; i++) {
+            turns.push_back(to_message(conversation, conversation.messages[i]));
+        }
+    }
+
+    std::string summary;
+    {
+        std::lock_guard<std::mutex> lock(_summarizer_mutex);
+        if (_summarizer) {
+            size_t max_tokens = _summary_max_tokens;
+            try {
+                summary = _summarizer(previous, turns, max_tokens);
+                if (max_tokens > 0 && estimate_tokens(summary) > max_tokens) {
+                    // The rolling summary must not outgrow the prompt window: compact it on its own once
+                    std::string shorter = _summarizer(summary, {}, max_tokens);
+                    if (!shorter.empty()) {
+                        summary = std::move(shorter);
+                    }
+                }
+            } catch (const std::exception& e) {
+                std::cerr << "[MEMORY] Summarizing conversation for " << user_id << " failed: " << e.what() << std::endl;
+            }
+            if (max_tokens > 0 && estimate_tokens(summary) > max_tokens) {
+                std::cerr << "[MEMORY] Summary for " << user_id << " is still over " << max_tokens << " tokens, cutting it" << std::endl;
+                summary = truncate_to_tokens(summary, max_tokens);
+            }
+        }
+    }
+
+    std::string record;
+    if (journaling() && !summary.empty()) {
+        record = begin_record(kSummaryRecord, user_id, sizeof(uint64_t) + sizeof(uint32_t) + summary.size());
+        journal::put<uint64_t>(record, cut_sequence);
+        journal::put_bytes(record, summary);
+    }
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.conversations.find(user_id);
+    if (it == shard.conversations.end() || it->second.id != id) {
+        return; // cleared meanwhile
+    }
+    Conversation& conversation = it->second;
+    conversation.summary_pending = false;
+    if (summary.empty()) {
+        // Try again once the conversation has grown by another tail's worth
+        conversation.summary_retry_tokens = conversation.tokens + _summary_keep_tokens;
+        return;
+    }
+
+    apply_summary_locked(conversation, cut_sequence, std::move(summary));
+    if (!record.empty()) {
+        log_locked(record);
+    }
+    std::cout << "[MEMORY] Compacted " << turns.size() << " turns for " << user_id << " into a "
+              << conversation.summary_tokens << "-token summary" << std::endl;
+}
+
+void MemoryService::set_journal(std::shared_ptr<MemoryJournal> journal) {
+    _journal = std::move(journal);
+    if (!journaling()) {
+        return;
+    }
+    uint64_t snapshot_generation = recover();
+    _journal->start([this]() { return write_snapshot(); }, snapshot_generation);
+}
+
+// Caller holds the shard lock, so the log orders a conversation's records as they were applied
+void MemoryService::log_locked(std::string& record) {
+    uint64_t lsn = _next_lsn++;
+    std::memcpy(&record[kLsnOffset], &lsn, sizeof(lsn));
+    _journal->append(record);
+}
+
+// Throws when the snapshot is damaged and the previous one cannot stand in: the log before the snapshot's
+// generation is gone, so replaying what is left would silently lose most conversations
+uint64_t MemoryService::recover() {
+    auto start = std::chrono::steady_clock::now();
+    std::array<uint64_t, kShards> shard_lsn{};
+    uint64_t generation = 0;
+    auto snapshot = _journal->map_snapshot();
+    if (!snapshot || !load_snapshot(*snapshot, shard_lsn, generation)) {
+        if (snapshot) {
+            std::cerr << "[MEMORY] Snapshot is damaged, recovering from the previous one" << std::endl;
+            for (auto& shard : _shards) {
+                shard.conversations.clear();
+            }
+            shard_lsn.fill(0);
+            generation = 0;
+        }
+        auto previous = _journal->map_previous_snapshot();
+        if (previous && !load_snapshot(*previous, shard_lsn, generation)) {
+            throw std::runtime_error("Both memory snapshots are damaged; refusing to start without them");
+        }
+        if (!previous && snapshot) {
+            throw std::runtime_error("Memory snapshot is damaged and there is no previous one; refusing to start without it");
+        }
+        if (previous && snapshot) {
+            _journal->set_aside_snapshot(); // the next commit must not keep it as the previous one
+        }
+    }
+    snapshot.reset();
+
+    uint64_t max_lsn = 0;
+    size_t records = 0;
+    for (uint64_t wal : _journal->generations()) {
+        if (wal < generation) {
+            continue; // already in the snapshot; left behind by a crash before it was deleted
+        }
+        records += _journal->replay(wal, [&](const char* payload, size_t size) {
+            replay(payload, size, shard_lsn, max_lsn);
+        });
+    }
+    uint64_t next = max_lsn + 1;
+    for (uint64_t lsn : shard_lsn) {
+        next = std::max(next, lsn);
+    }
+    _next_lsn = next;
+
+    size_t conversations = 0;
+    for (const auto& shard : _shards) {
+        conversations += shard.conversations.size();
+        for (const auto& entry : shard.conversations) {
+            _recovered_messages += entry.second.messages.size();
+        }
+    }
+    _recovery_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "[MEMORY] Recovered " << _recovered_messages << " messages in " << conversations << " conversations ("
+              << records << " log records replayed) in " << _recovery_seconds << "s" << std::endl;
+    return generation;
+}
+
+// Snapshot layout (host byte order):
+//   header:       magic, version, shard count, log generation, conversations, messages, per-shard sequence numbers
+//   conversation: user id, first sequence, summary, message count,
+//                 per message (role, timestamp, tokens, length), then the bodies back to back
+bool MemoryService::load_snapshot(const MemoryJournal::Mapping& snapshot, std::array<uint64_t, kShards>& shard_lsn, uint64_t& generation) {
+    journal::Reader reader(snapshot.data(), snapshot.size());
+    const char* magic = reader.take(sizeof(kSnapshotMagic));
+    uint32_t version = reader.get<uint32_t>();
+    uint32_t shards = reader.get<uint32_t>();
+    if (!magic || std::memcmp(magic, kSnapshotMagic, sizeof(kSnapshotMagic)) != 0 || version != kSnapshotVersion || shards != kShards) {
+        return false;
+    }
+    generation = reader.get<uint64_t>();
+    uint64_t conversations = reader.get<uint64_t>();
+    reader.get<uint64_t>(); // message count (informational)
+    for (auto& lsn : shard_lsn) {
+        lsn = reader.get<uint64_t>();
+    }
+
+    const size_t kMetadata = sizeof(uint8_t) + sizeof(int64_t) + 2 * sizeof(uint32_t);
+    for (uint64_t i = 0; i < conversations && reader.ok(); i++) {
+        std::string user_id = reader.get_bytes();
+        uint64_t first_sequence = reader.get<uint64_t>();
+        std::string summary = reader.get_bytes();
+        uint32_t count = reader.get<uint32_t>();
+        const char* metadata = reader.take(static_cast<size_t>(count) * kMetadata);
+        if (!metadata) {
+            return false;
+        }
+        size_t body_bytes = 0;
+        for (uint32_t m = 0; m < count; m++) {
+            uint32_t length;
+            std::memcpy(&length, metadata + m * kMetadata + kMetadata - sizeof(length), sizeof(length));
+            body_bytes += length;
+        }
+        const char* body = reader.take(body_bytes);
+        if (!body) {
+            return false;
+        }
+
+        Conversation& conversation = conversation_locked(_shards[shard_index(user_id)], user_id);
+        conversation.first_sequence = first_sequence;
+        if (!summary.empty()) {
+            conversation.summary_tokens = estimate_tokens(summary) + 2;
+            conversation.summary = std::move(summary);
+        }
+        for (uint32_t m = 0; m < count; m++) {
+            const char* entry = metadata + m * kMetadata;
+            uint8_t role;
+            int64_t timestamp;
+            uint32_t tokens;
+            uint32_t length;
+            std::memcpy(&role, entry, sizeof(role));
+            std::memcpy(&timestamp, entry + 1, sizeof(timestamp));
+            std::memcpy(&tokens, entry + 1 + sizeof(timestamp), sizeof(tokens));
+            std::memcpy(&length, entry + 1 + sizeof(timestamp) + sizeof(tokens), sizeof(length));
+            if (role > static_cast<uint8_t>(Role::system)) {
+                return false;
+            }
+            append_locked(conversation, static_cast<Role>(role), from_nanoseconds(timestamp), tokens, body, length, nullptr);
+            body += length;
+        }
+    }
+    return reader.ok();
+}
+
+// Applies one log record unless the snapshot of its shard already contains it
+void MemoryService::replay(const char* payload, size_t size, const std::array<uint64_t, kShards>& shard_lsn, uint64_t& max_lsn) {
+    journal::Reader reader(payload, size);
+    uint8_t type = reader.get<uint8_t>();
+    uint64_t lsn = reader.get<uint64_t>();
+    std::string user_id = reader.get_bytes();
+    if (!reader.ok()) {
+        return;
+    }
+    max_lsn = std::max(max_lsn, lsn);
+    size_t index = shard_index(user_id);
+    if (lsn < shard_lsn[index]) {
+        return;
+    }
+
+    Shard& shard = _shards[index];
+    if (type == kAddRecord) {
+        uint8_t role = reader.get<uint8_t>();
+        int64_t timestamp = reader.get<int64_t>();
+        uint32_t tokens = reader.get<uint32_t>();
+        uint32_t length = reader.get<uint32_t>();
+        const char* content = reader.take(length);
+        if (content && role <= static_cast<uint8_t>(Role::system)) {
+            append_locked(conversation_locked(shard, user_id), static_cast<Role>(role), from_nanoseconds(timestamp), tokens, content, length, nullptr);
+        }
+    } else if (type == kClearRecord) {
+        shard.conversations.erase(user_id);
+    } else if (type == kSummaryRecord) {
+        uint64_t cut_sequence = reader.get<uint64_t>();
+        std::string summary = reader.get_bytes();
+        auto it = shard.conversations.find(user_id);
+        if (reader.ok() && it != shard.conversations.end()) {
+            apply_summary_locked(it->second, cut_sequence, std::move(summary));
+        }
+    }
+}
+
+// Runs on the journal's flush thread. Each shard is locked only while it is serialized.
+bool MemoryService::write_snapshot() {
+    auto start = std::chrono::steady_clock::now();
+    // Rotate only once the snapshot file exists, so a failing disk does not pile up generations
+    if (!_journal->begin_snapshot()) {
+        return false;
+    }
+    uint64_t generation = _journal->rotate();
+    if (generation == 0) {
+        _journal->abort_snapshot();
+        return false;
+    }
+
+    const size_t header_size = sizeof(kSnapshotMagic) + 2 * sizeof(uint32_t) + 3 * sizeof(uint64_t) + kShards * sizeof(uint64_t);
+    if (!_journal->write_snapshot(std::string(header_size, '\0'))) {
+        return false;
+    }
+
+    std::array<uint64_t, kShards> shard_lsn{};
+    uint64_t conversations = 0;
+    uint64_t messages = 0;
+    std::string buffer;
+    for (size_t i = 0; i < kShards; i++) {
+        buffer.clear();
+        {
+            std::lock_guard<std::mutex> lock(_shards[i].mutex);
+            // Every record of this shard below this number is reflected in what follows
+            shard_lsn[i] = _next_lsn.load();
+            for (const auto& entry : _shards[i].conversations) {
+                const Conversation& conversation = entry.second;
+                journal::put_bytes(buffer, entry.first);
+                journal::put<uint64_t>(buffer, conversation.first_sequence);
+                journal::put_bytes(buffer, conversation.summary);
+                journal::put<uint32_t>(buffer, static_cast<uint32_t>(conversation.messages.size()));
+                for (const auto& record : conversation.messages) {
+                    journal::put<uint8_t>(buffer, static_cast<uint8_t>(record.role));
+                    journal::put<int64_t>(buffer, to_nanoseconds(record.timestamp));
+                    journal::put<uint32_t>(buffer, record.tokens);
+                    journal::put<uint32_t>(buffer, record.length);
+                }
+                for (const auto& record : conversation.messages) {
+                    buffer.append(conversation.arena.data(record), record.length);
+                }
+                conversations++;
+                messages += conversation.messages.size();
+            }
+        }
+        if (!_journal->write_snapshot(buffer)) {
+            return false;
+        }
+    }
+
+    std::string header;
+    header.reserve(header_size);
+    header.append(kSnapshotMagic, sizeof(kSnapshotMagic));
+    journal::put<uint32_t>(header, kSnapshotVersion);
+    journal::put<uint32_t>(header, static_cast<uint32_t>(kShards));
+    journal::put<uint64_t>(header, generation);
+    journal::put<uint64_t>(header, conversations);
+    journal::put<uint64_t>(header, messages);
+    for (uint64_t lsn : shard_lsn) {
+        journal::put<uint64_t>(header, lsn);
+    }
+    if (!_journal->commit_snapshot(header, generation)) {
+        return false;
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    _snapshot_micros = static_cast<uint64_t>(elapsed.count());
+    std::cout << "[MEMORY] Snapshot of " << messages << " messages in " << conversations << " conversations took "
+              << elapsed.count() / 1000.0 << "ms" << std::endl;
+    return true;
+}
+
+nlohmann::json MemoryService::get_metrics() const {
+    size_t conversations = 0;
+    size_t messages = 0;
+    for (const auto& shard : _shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        conversations += shard.conversations.size();
+        for (const auto& entry : shard.conversations) {
+            messages += entry.second.messages.size();
+        }
+    }
+
+    nlohmann::json metrics;
+    metrics["conversations"] = conversations;
+    metrics["messages"] = messages;
+    metrics["recovered_messages"] = _recovered_messages;
+    metrics["recovery_seconds"] = _recovery_seconds;
+    metrics["last_snapshot_ms"] = _snapshot_micros.load() / 1000.0;
+    metrics["journal"] = _journal ? _journal->get_metrics() : nlohmann::json{{"enabled", false}};
+    return metrics;
+}
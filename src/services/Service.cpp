@@ -1,4 +1,5 @@
 #include <lily/services/Service.hpp>
+#include <lily/services/GeminiRequestBuilder.hpp>
 #include <iostream>
 #include <fstream>
 #include <nlohmann/json.hpp>
@@ -8,6 +9,8 @@
 #include <chrono>
 #include <cstdlib>
 #include <unistd.h>
+#include <algorithm>
+#include <mutex>
 
 using namespace web;
 using namespace web::http;
@@ -15,9 +18,14 @@ using namespace web::http::client;
 
 namespace lily {
     namespace services {
-        Service::Service() : _discovery_running(false) {
-            discover_services_from_consul();
-            discover_tools();
+        Service::Service()
+            : _discovery_slots(std::make_shared<utils::AsyncSemaphore>(8)), _discovery_timeout(5),
+              _watch_wait(55), _tools_refresh_interval(300), _active_watches(0),
+              _discovery_running(false), _routing_hits(0), _routing_misses(0) {
+            auto empty_catalog = std::make_shared<ToolCatalog>();
+            empty_catalog->gemini_tools = std::make_shared<const std::string>();
+            std::atomic_store(&_catalog, std::shared_ptr<const ToolCatalog>(std::move(empty_catalog)));
+            // Discovery runs in the background (start_periodic_discovery, ServiceWatch.cpp), never in the constructor
         }
 
         Service::~Service() {
@@ -32,15 +40,7 @@ namespace lily {
 
         bool Service::register_service(const std::string& service_name, int port, const std::vector<std::string>& tags) {
             try {
-                std::string consul_host = "http://consul:8500";
-                if (const char* env_p = std::getenv("CONSUL_HTTP_ADDR")) {
-                    std::string env_s(env_p);
-                    if (env_s.find("://") == std::string::npos) {
-                        consul_host = "http://" + env_s;
-                    } else {
-                        consul_host = env_s;
-                    }
-                }
+                std::string consul_host = consul_address();
 
                 // Get hostname
                 char hostname[256];
@@ -129,15 +129,7 @@ namespace lily {
 
         void Service::deregister_service(const std::string& service_id) {
             try {
-                std::string consul_host = "http://consul:8500";
-                if (const char* env_p = std::getenv("CONSUL_HTTP_ADDR")) {
-                    std::string env_s(env_p);
-                    if (env_s.find("://") == std::string::npos) {
-                        consul_host = "http://" + env_s;
-                    } else {
-                        consul_host = env_s;
-                    }
-                }
+                std::string consul_host = consul_address();
 
                 std::string url = consul_host + "/v1/agent/service/deregister/" + service_id;
                 http_client client(utility::conversions::to_string_t(url));
@@ -151,177 +143,219 @@ namespace lily {
             }
         }
 
-        void Service::discover_services_from_consul() {
-            try {
-                _services.clear();
-                
-                std::string consul_host = "http://consul:8500";
-                if (const char* env_p = std::getenv("CONSUL_HTTP_ADDR")) {
-                     std::string env_s(env_p);
-                     if (env_s.find("://") == std::string::npos) {
-                         consul_host = "http://" + env_s;
-                     } else {
-                         consul_host = env_s;
-                     }
+        void Service::set_discovery_limits(size_t max_concurrency, std::chrono::seconds server_timeout) {
+            _discovery_slots = std::make_shared<utils::AsyncSemaphore>(max_concurrency);
+            _discovery_timeout = server_timeout;
+        }
+
+        void Service::set_mcp_pool_limits(size_t max_in_flight_per_server, std::chrono::seconds idle_timeout) {
+            _mcp_pool.set_limits(max_in_flight_per_server, idle_timeout);
+        }
+
+        void Service::set_watch_intervals(std::chrono::seconds wait, std::chrono::seconds tools_refresh) {
+            _watch_wait = wait;
+            _tools_refresh_interval = tools_refresh;
+        }
+
+        std::string Service::consul_address() {
+            std::string consul_host = "http://consul:8500";
+            if (const char* env_p = std::getenv("CONSUL_HTTP_ADDR")) {
+                std::string env_s(env_p);
+                if (env_s.find("://") == std::string::npos) {
+                    consul_host = "http://" + env_s;
+                } else {
+                    consul_host = env_s;
                 }
-                
-                http_client client(utility::conversions::to_string_t(consul_host));
-                
-                // 1. Get List of Services
-                auto response = client.request(methods::GET, U("/v1/catalog/services")).get();
-                if (response.status_code() == status_codes::OK) {
-                     auto services_json = response.extract_json().get();
-                     auto services_obj = services_json.as_object();
-                     
-                     for (auto it = services_obj.begin(); it != services_obj.end(); ++it) {
-                         std::string service_name = utility::conversions::to_utf8string(it->first);
-                         if (service_name == "consul") continue;
-                         
-                         // 2. Get Healthy Nodes
-                         uri_builder builder(U("/v1/health/service/" + utility::conversions::to_string_t(service_name)));
-                         builder.append_query(U("passing"), U("true"));
-                         
-                         auto health_resp = client.request(methods::GET, builder.to_string()).get();
-                         if (health_resp.status_code() == status_codes::OK) {
-                              auto nodes_json = health_resp.extract_json().get();
-                              if (nodes_json.is_array()) {
-                                  auto nodes = nodes_json.as_array();
-                                  if (nodes.size() > 0) {
-                                      auto node = nodes[0]; // Pick first healthy node
-                                      auto service_obj = node[U("Service")];
-                                      
-                                      ServiceInfo info;
-                                      info.id = service_name;
-                                      info.name = service_name;
-                                      
-                                      std::string hostname_tag;
-                                      info.mcp = false;
-                                      if (service_obj.has_field(U("Tags"))) {
-                                          auto tags = service_obj[U("Tags")].as_array();
-                                          for (const auto& tag : tags) {
-                                               std::string tag_str = utility::conversions::to_utf8string(tag.as_string());
-                                               if (tag_str == "mcp") {
-                                                   info.mcp = true;
-                                               }
-                                               if (tag_str.rfind("hostname=", 0) == 0) {
-                                                   hostname_tag = tag_str.substr(9);
-                                               }
-                                          }
-                                      }
-                                      
-                                      if (!hostname_tag.empty()) {
-                                          info.http_url = "https://" + hostname_tag + "/api";
-                                          info.websocket_url = "wss://" + hostname_tag + "/ws";
-                                          info.mcp_url = "https://" + hostname_tag + "/mcp";
-                                          
-                                          _services.push_back(info);
-                                          std::cout << "[ServiceDiscovery] Discovered: " << service_name << " at " << info.http_url << std::endl;
-                                      }
-                                  }
-                              }
-                         }
-                     }
+            }
+            return consul_host;
+        }
+
+        // Caller holds _tools_mutex
+        std::shared_ptr<const ToolCatalog> Service::publish_catalog() {
+            auto catalog = std::make_shared<ToolCatalog>();
+            catalog->generation = get_tool_catalog()->generation + 1;
+
+            for (const auto& entry : _server_tools) {
+                const std::string& server_url = entry.first;
+                for (const auto& tool : entry.second) {
+                    std::string name = tool.value("name", "");
+                    if (name.empty()) continue;
+                    auto& owners = catalog->tool_servers[name];
+                    if (owners.empty()) {
+                        // Replicas advertise the same tool; declare it to Gemini only once
+                        catalog->tools.push_back(tool);
+                    }
+                    owners.push_back(server_url);
                 }
-            } catch (const std::exception& e) {
-                std::cerr << "Error discovering services from Consul: " << e.what() << std::endl;
+                catalog->servers.push_back(server_url);
+                catalog->tools_per_server[server_url] = entry.second;
             }
+
+            // Render the Gemini declarations once for this generation instead of on every request
+            catalog->gemini_tools = std::make_shared<const std::string>(GeminiRequestBuilder::render_tools(catalog->tools));
+
+            std::shared_ptr<const ToolCatalog> published(std::move(catalog));
+            std::atomic_store(&_catalog, published);
+            return published;
         }
 
-        void Service::discover_tools() {
-            _tools.clear();
-            _discovered_servers.clear();
-            _tools_per_server.clear();
+        void Service::set_server_tools(const std::string& server_url, std::vector<nlohmann::json> tools) {
+            std::lock_guard<std::mutex> lock(_tools_mutex);
+            {
+                // A late answer from a server that has since left discovery must not bring it back
+                std::lock_guard<std::mutex> services_lock(_services_mutex);
+                bool live = std::any_of(_services.begin(), _services.end(), [&](const ServiceInfo& service) {
+                    return service.mcp && service.mcp_url == server_url;
+                });
+                if (!live) return;
+            }
+            _server_tools[server_url] = std::move(tools);
+            publish_catalog();
+        }
 
-            for (const auto& service : _services) {
+        void Service::remove_server_tools(const std::string& server_url) {
+            std::lock_guard<std::mutex> lock(_tools_mutex);
+            if (_server_tools.erase(server_url) > 0) {
+                publish_catalog();
+            }
+            _mcp_pool.evict(server_url);
+        }
+
+        void Service::discover_tools() {
+            std::vector<std::string> mcp_urls;
+            for (const auto& service : get_services_info()) {
                 // Only discover tools from MCP-enabled services
                 if (service.mcp) {
-                    try {
-                        auto tools = discover_tools_from_server(service.mcp_url);
-                        _tools.insert(_tools.end(), tools.begin(), tools.end());
-                        _discovered_servers.push_back(service.mcp_url);
-                        _tools_per_server[service.mcp_url] = tools;
-                    } catch (const std::exception& e) {
-                        std::cerr << "Failed to discover tools from " << service.mcp_url << " (" << service.name << "): " << e.what() << std::endl;
+                    mcp_urls.push_back(service.mcp_url);
+                }
+            }
+
+            // All servers are queried concurrently (bounded by _discovery_slots) and every answer
+            // publishes a new generation right away; servers not yet answered keep their old tools.
+            auto refreshed = std::make_shared<std::vector<char>>(mcp_urls.size(), 0);
+            std::vector<pplx::task<void>> fetches;
+            for (size_t i = 0; i < mcp_urls.size(); ++i) {
+                std::string server_url = mcp_urls[i];
+                fetches.push_back(discover_tools_from_server_async(server_url)
+                    .then([this, refreshed, i, server_url](pplx::task<std::vector<nlohmann::json>> tools_task) {
+                        try {
+                            set_server_tools(server_url, tools_task.get());
+                            (*refreshed)[i] = 1;
+                        } catch (const std::exception& e) {
+                            std::cerr << "Failed to discover tools from " << server_url << ": " << e.what() << std::endl;
+                        }
+                    }));
+            }
+            pplx::when_all(fetches.begin(), fetches.end()).wait();
+
+            // Final generation for this pass: servers that failed or disappeared drop out
+            std::shared_ptr<const ToolCatalog> catalog;
+            {
+                std::lock_guard<std::mutex> lock(_tools_mutex);
+                for (auto it = _server_tools.begin(); it != _server_tools.end();) {
+                    auto pos = std::find(mcp_urls.begin(), mcp_urls.end(), it->first);
+                    if (pos == mcp_urls.end() || !(*refreshed)[pos - mcp_urls.begin()]) {
+                        it = _server_tools.erase(it);
+                    } else {
+                        ++it;
                     }
                 }
+                catalog = publish_catalog();
             }
+            std::cout << "[ServiceDiscovery] Tool catalog generation " << catalog->generation << ": " << catalog->tools.size()
+                      << " tools from " << catalog->servers.size() << " server(s), " << catalog->gemini_tools->size()
+                      << " bytes of Gemini declarations" << std::endl;
         }
 
-        std::vector<nlohmann::json> Service::discover_tools_from_server(const std::string& server_url) {
-            std::vector<nlohmann::json> tools;
-
-            try {
-                // Create HTTP client
-                http_client client(U(server_url));
+        pplx::task<std::vector<nlohmann::json>> Service::discover_tools_from_server_async(const std::string& server_url) {
+            auto slots = _discovery_slots;
+            auto timeout = _discovery_timeout;
 
+            return slots->acquire().then([this, server_url, timeout]() {
                 // Prepare MCP tools/list request
                 json::value request;
                 request[U("jsonrpc")] = json::value::string(U("2.0"));
                 request[U("method")] = json::value::string(U("tools/list"));
                 request[U("id")] = json::value::number(1);
 
-                // Send request
-                auto response = client.request(methods::POST, U(""), request).get();
-
-                if (response.status_code() == status_codes::OK) {
-                    auto response_json = response.extract_json().get();
-
-                    if (response_json.has_field(U("result")) &&
-                        response_json[U("result")].has_field(U("tools"))) {
-
-                        const auto& tools_array = response_json[U("result")][U("tools")].as_array();
-
-                        for (const auto& tool : tools_array) {
-                            // Directly parse cpprest JSON to nlohmann JSON
-                            tools.push_back(nlohmann::json::parse(utility::conversions::to_utf8string(tool.serialize())));
+                // Send on the server's pooled client, with the discovery deadline so one slow
+                // server cannot stall the pass
+                return _mcp_pool.post(server_url, request, timeout)
+                    .then([server_url](http_response response) {
+                        if (response.status_code() != status_codes::OK) {
+                            std::cerr << "Error discovering tools from " << server_url << ": HTTP " << response.status_code() << std::endl;
+                            return pplx::task_from_result(json::value::null());
                         }
-                    }
-                }
-            } catch (const std::exception& e) {
-                std::cerr << "Error discovering tools from " << server_url << ": " << e.what() << std::endl;
-                throw;
-            }
-
-            return tools;
+                        return response.extract_json();
+                    })
+                    .then([](json::value response_json) {
+                        std::vector<nlohmann::json> tools;
+                        if (response_json.has_field(U("result")) &&
+                            response_json[U("result")].has_field(U("tools"))) {
+
+                            const auto& tools_array = response_json[U("result")][U("tools")].as_array();
+
+                            for (const auto& tool : tools_array) {
+                                // Directly parse cpprest JSON to nlohmann JSON
+                                tools.push_back(nlohmann::json::parse(utility::conversions::to_utf8string(tool.serialize())));
+                            }
+                        }
+                        return tools;
+                    });
+            }).then([slots](pplx::task<std::vector<nlohmann::json>> tools_task) {
+                slots->release();
+                return tools_task.get();
+            });
         }
 
-        void Service::start_periodic_discovery() {
-            if (_discovery_running) {
-                return;
-            }
+        struct Service::ToolAttempt {
+            std::string tool_name;
+            nlohmann::json parameters;
+            std::shared_ptr<const ToolCatalog> catalog; // pins the server list for this call
+            const std::vector<std::string>* servers = nullptr; // owners of the tool inside catalog
+            size_t next_index = 0;
+            std::vector<std::string> error_details;
+        };
 
-            _discovery_running = true;
-            _discovery_future = std::async(std::launch::async, [this]() {
-                while (_discovery_running) {
-                    try {
-                        discover_services_from_consul(); 
-                        discover_tools();
-                        std::this_thread::sleep_for(std::chrono::seconds(30)); // Discover every 30 seconds
-                    } catch (const std::exception& e) {
-                        std::cerr << "Error during periodic discovery: " << e.what() << std::endl;
-                        std::this_thread::sleep_for(std::chrono::seconds(5)); // Wait 5 seconds before retrying
-                    }
-                }
-            });
+        nlohmann::json Service::execute_tool(const std::string& tool_name, const nlohmann::json& parameters) {
+            return execute_tool_async(tool_name, parameters).get();
         }
 
-        void Service::stop_periodic_discovery() {
-            _discovery_running = false;
-            if (_discovery_future.valid()) {
-                _discovery_future.wait();
+        pplx::task<nlohmann::json> Service::execute_tool_async(const std::string& tool_name, const nlohmann::json& parameters) {
+            auto attempt = std::make_shared<ToolAttempt>();
+            attempt->tool_name = tool_name;
+            attempt->parameters = parameters;
+            attempt->catalog = get_tool_catalog();
+
+            // Route straight to the server(s) that advertised the tool at discovery time
+            auto owners = attempt->catalog->tool_servers.find(tool_name);
+            if (owners == attempt->catalog->tool_servers.end()) {
+                _routing_misses.fetch_add(1, std::memory_order_relaxed);
+                std::cerr << "[HTTP CLIENT] Unknown tool " << tool_name << " (catalog generation " << attempt->catalog->generation << ")" << std::endl;
+                return pplx::task_from_result(nlohmann::json{
+                    {"status", "error"},
+                    {"message", "Tool not found: " + tool_name + ". No discovered server advertises it."},
+                    {"error_type", "unknown_tool"},
+                    {"tool_name", tool_name}
+                });
             }
+            _routing_hits.fetch_add(1, std::memory_order_relaxed);
+            attempt->servers = &owners->second;
+            return try_next_server_async(attempt);
         }
 
-        nlohmann::json Service::execute_tool(const std::string& tool_name, const nlohmann::json& parameters) {
-            std::vector<std::string> error_details;
-            
-            // Try to find the tool in our discovered tools
-            for (const auto& server_url : _discovered_servers) {
-                try {
-                    auto result = execute_tool_on_server(server_url, tool_name, parameters);
-                    if (result.value("status", "") == "success" || result.contains("result") || result.contains("content")) {
-                        return result;
-                    } else {
+        pplx::task<nlohmann::json> Service::try_next_server_async(std::shared_ptr<ToolAttempt> attempt) {
+            // Try the owning server first, then any replica advertising the same tool
+            const auto& servers = *attempt->servers;
+            if (attempt->next_index < servers.size()) {
+                std::string server_url = servers[attempt->next_index++];
+                return execute_tool_on_server_async(server_url, attempt->tool_name, attempt->parameters)
+                    .then([this, attempt, server_url](pplx::task<nlohmann::json> result_task) -> pplx::task<nlohmann::json> {
+                    try {
+                        auto result = result_task.get();
+                        if (result.value("status", "") == "success" || result.contains("result") || result.contains("content")) {
+                            return pplx::task_from_result(result);
+                        }
                         // Capture error details from the result
                         std::string error_msg = "Server: " + server_url + " - ";
                         if (result.contains("message")) {
@@ -329,15 +363,18 @@ namespace lily {
                         } else {
                             error_msg += "Unknown error";
                         }
-                        error_details.push_back(error_msg);
+                        attempt->error_details.push_back(error_msg);
+                    } catch (const std::exception& e) {
+                        std::string error_msg = "Server: " + server_url + " - Exception: " + std::string(e.what());
+                        std::cerr << "Failed to execute tool " << attempt->tool_name << " on " << server_url << ": " << e.what() << std::endl;
+                        attempt->error_details.push_back(error_msg);
                     }
-                } catch (const std::exception& e) {
-                    std::string error_msg = "Server: " + server_url + " - Exception: " + std::string(e.what());
-                    std::cerr << "Failed to execute tool " << tool_name << " on " << server_url << ": " << e.what() << std::endl;
-                    error_details.push_back(error_msg);
-                }
+                    return try_next_server_async(attempt);
+                });
             }
 
+            const auto& error_details = attempt->error_details;
+
             // Build detailed error message
             std::string detailed_message = "Tool not found or failed to execute. Details: ";
             if (!error_details.empty()) {
@@ -348,20 +385,49 @@ namespace lily {
                 detailed_message += "No servers available or discovered.";
             }
 
-            return {
+            return pplx::task_from_result(nlohmann::json{
                 {"status", "error"},
                 {"message", detailed_message},
                 {"error_details", error_details}
-            };
+            });
         }
 
-        nlohmann::json Service::execute_tool_on_server(const std::string& server_url, const std::string& tool_name, const nlohmann::json& parameters) {
+        // Convert a failed tools/call exchange into the error object returned to the agent loop
+        static nlohmann::json tool_exception_result(const std::string& server_url, const std::string& tool_name) {
             try {
-                // Create HTTP client with timeout configuration
-                http_client_config config;
-                config.set_timeout(std::chrono::seconds(120));
-                http_client client(U(server_url), config);
+                throw;
+            } catch (const web::http::http_exception& e) {
+                std::cerr << "[HTTP CLIENT] HTTP exception executing tool " << tool_name << " on " << server_url << ": " << e.what() << std::endl;
+                return {
+                    {"status", "error"},
+                    {"message", std::string("HTTP Exception: ") + e.what()},
+                    {"error_type", "http_exception"},
+                    {"server_url", server_url},
+                    {"tool_name", tool_name}
+                };
+            } catch (const web::uri_exception& e) {
+                std::cerr << "[HTTP CLIENT] URI exception executing tool " << tool_name << " on " << server_url << ": " << e.what() << std::endl;
+                return {
+                    {"status", "error"},
+                    {"message", std::string("URI Exception: ") + e.what()},
+                    {"error_type", "uri_exception"},
+                    {"server_url", server_url},
+                    {"tool_name", tool_name}
+                };
+            } catch (const std::exception& e) {
+                std::cerr << "[HTTP CLIENT] General exception executing tool " << tool_name << " on " << server_url << ": " << e.what() << std::endl;
+                return {
+                    {"status", "error"},
+                    {"message", std::string("Exception: ") + e.what()},
+                    {"error_type", "general_exception"},
+                    {"server_url", server_url},
+                    {"tool_name", tool_name}
+                };
+            }
+        }
 
+        pplx::task<nlohmann::json> Service::execute_tool_on_server_async(const std::string& server_url, const std::string& tool_name, const nlohmann::json& parameters) {
+            try {
                 // Prepare MCP tools/call request
                 json::value request;
                 request[U("jsonrpc")] = json::value::string(U("2.0"));
@@ -380,103 +446,112 @@ namespace lily {
 
                 // Send request with detailed logging
                 std::cout << "[HTTP CLIENT] Sending request to " << server_url << std::endl;
-                auto response = client.request(methods::POST, U(""), request).get();
-                std::cout << "[HTTP CLIENT] Received response with status: " << response.status_code() << std::endl;
-
-                if (response.status_code() == status_codes::OK) {
+                return _mcp_pool.post(server_url, request, std::chrono::seconds(120))
+                    .then([server_url, tool_name](pplx::task<http_response> response_task) -> pplx::task<nlohmann::json> {
+                    http_response response;
                     try {
-                        auto response_json = response.extract_json().get();
-                        std::cout << "[HTTP CLIENT] Successfully extracted JSON response" << std::endl;
+                        response = response_task.get();
+                    } catch (...) {
+                        return pplx::task_from_result(tool_exception_result(server_url, tool_name));
+                    }
+                    std::cout << "[HTTP CLIENT] Received response with status: " << response.status_code() << std::endl;
+
+                    if (response.status_code() == status_codes::OK) {
+                        return response.extract_json().then([response, server_url, tool_name](pplx::task<json::value> json_task) -> pplx::task<nlohmann::json> {
+                            try {
+                                auto response_json = json_task.get();
+                                std::cout << "[HTTP CLIENT] Successfully extracted JSON response" << std::endl;
+
+                                // Convert cpprest JSON to nlohmann JSON
+                                std::string response_str = utility::conversions::to_utf8string(response_json.serialize());
+                                return pplx::task_from_result(nlohmann::json::parse(response_str));
+                            } catch (const std::exception& e) {
+                                std::cerr << "[HTTP CLIENT] Error extracting JSON from response: " << e.what() << std::endl;
+                                std::string error_message = std::string("JSON extraction error: ") + e.what();
+                                // Try to get the raw response body for debugging
+                                return response.extract_string().then([error_message, server_url, tool_name](pplx::task<utility::string_t> body_task) {
+                                    std::string raw_response;
+                                    try {
+                                        raw_response = utility::conversions::to_utf8string(body_task.get());
+                                        std::cerr << "[HTTP CLIENT] Raw response body: " << raw_response << std::endl;
+                                    } catch (const std::exception& ex) {
+                                        std::cerr << "[HTTP CLIENT] Failed to extract raw response: " << ex.what() << std::endl;
+                                        raw_response = "Unable to extract response body";
+                                    }
+                                    
+                                    return nlohmann::json{
+                                        {"status", "error"},
+                                        {"message", error_message},
+                                        {"error_type", "json_extraction_error"},
+                                        {"raw_response", raw_response},
+                                        {"server_url", server_url},
+                                        {"tool_name", tool_name}
+                                    };
+                                });
+                            }
+                        });
+                    }
 
-                        // Convert cpprest JSON to nlohmann JSON
-                        std::string response_str = utility::conversions::to_utf8string(response_json.serialize());
-                        return nlohmann::json::parse(response_str);
-                    } catch (const std::exception& e) {
-                        std::cerr << "[HTTP CLIENT] Error extracting JSON from response: " << e.what() << std::endl;
-                        // Try to get the raw response body for debugging
-                        std::string raw_response;
+                    auto status = response.status_code();
+                    return response.extract_string().then([status, server_url, tool_name](pplx::task<utility::string_t> body_task) {
+                        std::string error_body;
                         try {
-                            raw_response = utility::conversions::to_utf8string(response.extract_string().get());
-                            std::cerr << "[HTTP CLIENT] Raw response body: " << raw_response << std::endl;
-                        } catch (const std::exception& ex) {
-                            std::cerr << "[HTTP CLIENT] Failed to extract raw response: " << ex.what() << std::endl;
-                            raw_response = "Unable to extract response body";
+                            error_body = utility::conversions::to_utf8string(body_task.get());
+                            std::cerr << "[HTTP CLIENT] HTTP error body: " << error_body << std::endl;
+                        } catch (...) {
+                            error_body = "Unable to extract error body";
                         }
                         
-                        return {
+                        return nlohmann::json{
                             {"status", "error"},
-                            {"message", std::string("JSON extraction error: ") + e.what()},
-                            {"error_type", "json_extraction_error"},
-                            {"raw_response", raw_response},
+                            {"message", "HTTP error: " + std::to_string(status)},
+                            {"http_status", status},
+                            {"error_body", error_body},
                             {"server_url", server_url},
                             {"tool_name", tool_name}
                         };
-                    }
-                } else {
-                    std::string error_body;
-                    try {
-                        error_body = utility::conversions::to_utf8string(response.extract_string().get());
-                        std::cerr << "[HTTP CLIENT] HTTP error body: " << error_body << std::endl;
-                    } catch (...) {
-                        error_body = "Unable to extract error body";
-                    }
-                    
-                    return {
-                        {"status", "error"},
-                        {"message", "HTTP error: " + std::to_string(response.status_code())},
-                        {"http_status", response.status_code()},
-                        {"error_body", error_body},
-                        {"server_url", server_url},
-                        {"tool_name", tool_name}
-                    };
-                }
-            } catch (const web::http::http_exception& e) {
-                std::cerr << "[HTTP CLIENT] HTTP exception executing tool " << tool_name << " on " << server_url << ": " << e.what() << std::endl;
-                return {
-                    {"status", "error"},
-                    {"message", std::string("HTTP Exception: ") + e.what()},
-                    {"error_type", "http_exception"},
-                    {"server_url", server_url},
-                    {"tool_name", tool_name}
-                };
-            } catch (const web::uri_exception& e) {
-                std::cerr << "[HTTP CLIENT] URI exception executing tool " << tool_name << " on " << server_url << ": " << e.what() << std::endl;
-                return {
-                    {"status", "error"},
-                    {"message", std::string("URI Exception: ") + e.what()},
-                    {"error_type", "uri_exception"},
-                    {"server_url", server_url},
-                    {"tool_name", tool_name}
-                };
-            } catch (const std::exception& e) {
-                std::cerr << "[HTTP CLIENT] General exception executing tool " << tool_name << " on " << server_url << ": " << e.what() << std::endl;
-                return {
-                    {"status", "error"},
-                    {"message", std::string("Exception: ") + e.what()},
-                    {"error_type", "general_exception"},
-                    {"server_url", server_url},
-                    {"tool_name", tool_name}
-                };
+                    });
+                });
+            } catch (...) {
+                return pplx::task_from_result(tool_exception_result(server_url, tool_name));
             }
         }
 
+        std::vector<ServiceInfo> Service::get_services_info() const {
+            std::lock_guard<std::mutex> lock(_services_mutex);
+            return _services;
+        }
+
+        std::shared_ptr<const ToolCatalog> Service::get_tool_catalog() const {
+            return std::atomic_load(&_catalog);
+        }
+
         std::vector<nlohmann::json> Service::get_available_tools() const {
-            return _tools;
+            return get_tool_catalog()->tools;
         }
 
         std::vector<std::string> Service::get_discovered_servers() const {
-            return _discovered_servers;
+            return get_tool_catalog()->servers;
         }
 
         size_t Service::get_tool_count() const {
-            return _tools.size();
+            return get_tool_catalog()->tools.size();
         }
 
         std::map<std::string, std::vector<nlohmann::json>> Service::get_tools_per_server() const {
-            return _tools_per_server;
+            return get_tool_catalog()->tools_per_server;
+        }
+
+        nlohmann::json Service::get_routing_stats() const {
+            return {
+                {"hits", _routing_hits.load(std::memory_order_relaxed)},
+                {"misses", _routing_misses.load(std::memory_order_relaxed)},
+                {"indexed_tools", get_tool_catalog()->tool_servers.size()}
+            };
         }
 
         std::string Service::getServiceUrl(const std::string& service_name, const std::string& protocol) const {
+            std::lock_guard<std::mutex> lock(_services_mutex);
             for (const auto& service : _services) {
                 if (service.name == service_name || service.id == service_name) {
                     if (protocol == "ws" || protocol == "websocket") {
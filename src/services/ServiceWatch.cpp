@@ -0,0 +1,387 @@
+#include <lily/services/Service.hpp>
+#include <iostream>
+#include <set>
+#include <stdexcept>
+#include <cpprest/http_client.h>
+#include <pplx/threadpool.h>
+#include <boost/asio/steady_timer.hpp>
+
+using namespace web;
+using namespace web::http;
+using namespace web::http::client;
+
+// Watch-based service discovery: Consul blocking queries (index/wait) on the
+// catalog and on each service's health, so changes show up as soon as Consul
+// reports them and only the services that changed are re-fetched.
+
+namespace lily {
+    namespace services {
+        // Longest pause before a failed health watch is retried
+        static constexpr std::chrono::seconds kMaxWatchBackoff(30);
+
+        struct Service::ServiceWatch {
+            std::string name;
+            uint64_t index = 0;              // X-Consul-Index of the last health answer; 0 = fetch now
+            std::atomic<bool> active{true};  // cleared once the service leaves the Consul catalog
+            std::chrono::seconds backoff{0}; // grows while the watch keeps failing; only touched by its own chain
+            bool unindexed = false;          // the last answer had no X-Consul-Index, so it could not block
+
+            std::mutex retry_mutex;
+            std::unique_ptr<boost::asio::steady_timer> retry_timer; // pending re-arm after a failure
+
+            void cancel_retry() {
+                std::lock_guard<std::mutex> lock(retry_mutex);
+                if (retry_timer) {
+                    retry_timer->cancel();
+                }
+            }
+        };
+
+        // X-Consul-Index of a blocking query response, or 0 when missing
+        static uint64_t consul_index(const http_response& response) {
+            utility::string_t value;
+            if (!response.headers().match(U("X-Consul-Index"), value)) {
+                return 0;
+            }
+            try {
+                return std::stoull(utility::conversions::to_utf8string(value));
+            } catch (const std::exception&) {
+                return 0;
+            }
+        }
+
+        // Index to send with the next blocking query, following Consul's rules: an index
+        // that went backwards means a reset (fetch again right away), and the index must
+        // stay above zero or the query would return immediately forever. A missing index
+        // (returned == 0) never blocks, so callers pause before asking again.
+        static uint64_t next_watch_index(uint64_t previous, uint64_t returned) {
+            if (returned == 0) return 1;
+            if (returned < previous) return 0;
+            return returned;
+        }
+
+        // Build a ServiceInfo from the first healthy node of a /v1/health/service response.
+        // Returns false when the service has no usable node or no hostname tag.
+        static bool service_info_from_health(const std::string& service_name, const json::value& nodes_json, ServiceInfo& info) {
+            if (!nodes_json.is_array() || nodes_json.as_array().size() == 0) {
+                return false;
+            }
+            auto node = nodes_json.as_array().at(0); // Pick first healthy node
+            auto service_obj = node[U("Service")];
+
+            info.id = service_name;
+            info.name = service_name;
+
+            std::string hostname_tag;
+            info.mcp = false;
+            if (service_obj.has_field(U("Tags"))) {
+                auto tags = service_obj[U("Tags")].as_array();
+                for (const auto& tag : tags) {
+                    std::string tag_str = utility::conversions::to_utf8string(tag.as_string());
+                    if (tag_str == "mcp") {
+                        info.mcp = true;
+                    }
+                    if (tag_str.rfind("hostname=", 0) == 0) {
+                        hostname_tag = tag_str.substr(9);
+                    }
+                }
+            }
+
+            if (hostname_tag.empty()) {
+                return false;
+            }
+            info.http_url = "https://" + hostname_tag + "/api";
+            info.websocket_url = "wss://" + hostname_tag + "/ws";
+            info.mcp_url = "https://" + hostname_tag + "/mcp";
+            return true;
+        }
+
+        void Service::start_periodic_discovery() {
+            if (_discovery_running) {
+                return;
+            }
+
+            _discovery_running = true;
+            _watch_cancellation = pplx::cancellation_token_source();
+
+            // Consul may hold a blocking query for the whole wait plus up to wait/16 of jitter
+            http_client_config client_config;
+            client_config.set_timeout(_watch_wait + _watch_wait / 16 + _discovery_timeout);
+            _consul_client = std::make_shared<http_client>(utility::conversions::to_string_t(consul_address()), client_config);
+
+            _discovery_future = std::async(std::launch::async, [this]() {
+                run_discovery_watch();
+            });
+        }
+
+        void Service::stop_periodic_discovery() {
+            _discovery_running = false;
+            _watch_cancellation.cancel();
+            if (_discovery_future.valid()) {
+                _discovery_future.wait();
+            }
+            for (auto& entry : _service_watches) {
+                entry.second->cancel_retry();
+            }
+
+            // Cancelled health queries and timers still run their continuations, which use this;
+            // cancellation makes them finish quickly, so wait for every one of them
+            {
+                std::unique_lock<std::mutex> lock(_active_watches_mutex);
+                _active_watches_done.wait(lock, [this]() { return _active_watches == 0; });
+            }
+            for (auto& entry : _service_watches) {
+                entry.second->active = false;
+            }
+            _service_watches.clear();
+        }
+
+        void Service::run_discovery_watch() {
+            uint64_t catalog_index = 0;
+            std::chrono::seconds unindexed_backoff(0); // grows while answers come back without an index
+            auto last_tools_refresh = std::chrono::steady_clock::now();
+            auto token = _watch_cancellation.get_token();
+            std::string wait = std::to_string(_watch_wait.count()) + "s";
+
+            while (_discovery_running) {
+                try {
+                    // Blocks in Consul until the service list changes or the wait expires
+                    uri_builder builder(U("/v1/catalog/services"));
+                    builder.append_query(U("index"), utility::conversions::to_string_t(std::to_string(catalog_index)));
+                    builder.append_query(U("wait"), utility::conversions::to_string_t(wait));
+
+                    auto response = _consul_client->request(methods::GET, builder.to_string(), token).get();
+                    if (response.status_code() != status_codes::OK) {
+                        throw std::runtime_error("HTTP " + std::to_string(response.status_code()));
+                    }
+
+                    uint64_t returned = consul_index(response);
+                    // Without an index nothing can be told apart, so only the first answer counts
+                    bool changed = catalog_index == 0 || (returned != 0 && returned != catalog_index);
+                    auto services_json = response.extract_json().get();
+                    catalog_index = next_watch_index(catalog_index, returned);
+
+                    if (changed) {
+                        std::vector<std::string> service_names;
+                        for (const auto& entry : services_json.as_object()) {
+                            std::string service_name = utility::conversions::to_utf8string(entry.first);
+                            if (service_name != "consul") {
+                                service_names.push_back(service_name);
+                            }
+                        }
+                        reconcile_service_watches(service_names);
+                    }
+
+                    if (returned == 0) {
+                        // The query returned at once instead of blocking; don't spin on it
+                        unindexed_backoff = std::min(kMaxWatchBackoff, std::max(std::chrono::seconds(1), unindexed_backoff * 2));
+                        std::cerr << "[ServiceDiscovery] Consul catalog answer had no X-Consul-Index; next query in "
+                                  << unindexed_backoff.count() << "s" << std::endl;
+                        for (int i = 0; i < unindexed_backoff.count() * 10 && _discovery_running; ++i) {
+                            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                        }
+                    } else {
+                        unindexed_backoff = std::chrono::seconds(0);
+                    }
+                } catch (const std::exception& e) {
+                    if (!_discovery_running) break;
+                    std::cerr << "[ServiceDiscovery] Consul catalog watch failed: " << e.what() << std::endl;
+                    catalog_index = 0;
+                    // Wait 5 seconds before retrying, but stay responsive to shutdown
+                    for (int i = 0; i < 50 && _discovery_running; ++i) {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                    }
+                }
+
+                _mcp_pool.evict_idle();
+
+                // Health changes already refresh the affected server's tools; this catches servers
+                // whose tool list changed while they stayed healthy
+                auto now = std::chrono::steady_clock::now();
+                if (_discovery_running && now - last_tools_refresh >= _tools_refresh_interval) {
+                    discover_tools();
+                    last_tools_refresh = now;
+                }
+            }
+        }
+
+        void Service::reconcile_service_watches(const std::vector<std::string>& service_names) {
+            std::set<std::string> current(service_names.begin(), service_names.end());
+
+            for (auto it = _service_watches.begin(); it != _service_watches.end();) {
+                if (current.count(it->first)) {
+                    ++it;
+                    continue;
+                }
+                // Left the catalog: stop watching it and drop what it contributed
+                it->second->active = false;
+                it->second->cancel_retry();
+                ServiceInfo removed;
+                if (remove_service(it->first, removed)) {
+                    std::cout << "[ServiceDiscovery] Removed: " << it->first << std::endl;
+                    if (removed.mcp) {
+                        remove_server_tools(removed.mcp_url);
+                    }
+                }
+                it = _service_watches.erase(it);
+            }
+
+            for (const auto& service_name : service_names) {
+                if (_service_watches.count(service_name)) continue;
+                auto watch = std::make_shared<ServiceWatch>();
+                watch->name = service_name;
+                _service_watches[service_name] = watch;
+                arm_service_watch(watch);
+            }
+        }
+
+        void Service::arm_service_watch(std::shared_ptr<ServiceWatch> watch) {
+            if (!_discovery_running || !watch->active) {
+                return;
+            }
+            watch_started();
+
+            uri_builder builder(U("/v1/health/service/" + utility::conversions::to_string_t(watch->name)));
+            builder.append_query(U("passing"), U("true"));
+            builder.append_query(U("index"), utility::conversions::to_string_t(std::to_string(watch->index)));
+            builder.append_query(U("wait"), utility::conversions::to_string_t(std::to_string(_watch_wait.count()) + "s"));
+
+            _consul_client->request(methods::GET, builder.to_string(), _watch_cancellation.get_token())
+                .then([this, watch](http_response response) -> pplx::task<void> {
+                    if (response.status_code() != status_codes::OK) {
+                        throw std::runtime_error("HTTP " + std::to_string(response.status_code()));
+                    }
+
+                    uint64_t returned = consul_index(response);
+                    bool changed = watch->index == 0 || (returned != 0 && returned != watch->index);
+                    watch->index = next_watch_index(watch->index, returned);
+                    watch->unindexed = returned == 0;
+
+                    if (!changed) {
+                        // The wait expired with nothing new; drain the body so the connection is reused
+                        return response.extract_json().then([](json::value) {});
+                    }
+                    return response.extract_json().then([this, watch](json::value nodes) {
+                        return apply_service_health(watch, nodes);
+                    });
+                })
+                .then([this, watch](pplx::task<void> done) {
+                    try {
+                        done.get();
+                        if (watch->unindexed) {
+                            // Answered without blocking; ask again only after a pause
+                            retry_service_watch(watch);
+                        } else {
+                            watch->backoff = std::chrono::seconds(0);
+                            arm_service_watch(watch);
+                        }
+                    } catch (const std::exception& e) {
+                        if (_discovery_running && watch->active) {
+                            std::cerr << "[ServiceDiscovery] Health watch for " << watch->name << " failed: " << e.what() << std::endl;
+                            watch->index = 0;
+                            retry_service_watch(watch);
+                        }
+                    }
+                    watch_finished();
+                });
+        }
+
+        // Re-arms a failed (or unindexed) health watch after a growing pause, without holding a thread meanwhile
+        void Service::retry_service_watch(std::shared_ptr<ServiceWatch> watch) {
+            watch->backoff = std::min(kMaxWatchBackoff, std::max(std::chrono::seconds(1), watch->backoff * 2));
+
+            std::lock_guard<std::mutex> lock(watch->retry_mutex);
+            // Checked under the lock so stop_periodic_discovery() cannot miss a timer armed concurrently
+            if (!_discovery_running || !watch->active) {
+                return;
+            }
+            watch_started();
+            watch->retry_timer.reset(new boost::asio::steady_timer(crossplat::threadpool::shared_instance().service(), watch->backoff));
+            watch->retry_timer->async_wait([this, watch](const boost::system::error_code& error) {
+                if (!error) {
+                    arm_service_watch(watch);
+                }
+                watch_finished();
+            });
+        }
+
+        void Service::watch_started() {
+            std::lock_guard<std::mutex> lock(_active_watches_mutex);
+            _active_watches++;
+        }
+
+        // Last use of this by a watch callback: once the count reaches zero the Service may be destroyed
+        void Service::watch_finished() {
+            std::lock_guard<std::mutex> lock(_active_watches_mutex);
+            if (--_active_watches == 0) {
+                _active_watches_done.notify_all();
+            }
+        }
+
+        pplx::task<void> Service::apply_service_health(std::shared_ptr<ServiceWatch> watch, const json::value& nodes) {
+            ServiceInfo info;
+            if (!service_info_from_health(watch->name, nodes, info)) {
+                // No passing node (or no hostname tag): unavailable until it recovers
+                ServiceInfo removed;
+                if (remove_service(watch->name, removed)) {
+                    std::cout << "[ServiceDiscovery] Lost: " << watch->name << std::endl;
+                    if (removed.mcp) {
+                        remove_server_tools(removed.mcp_url);
+                    }
+                }
+                return pplx::task_from_result();
+            }
+
+            ServiceInfo previous;
+            bool existed = false;
+            if (!upsert_watched_service(info, *watch, previous, existed)) {
+                return pplx::task_from_result(); // left the catalog in the meantime
+            }
+            if (existed && previous.mcp && (!info.mcp || previous.mcp_url != info.mcp_url)) {
+                remove_server_tools(previous.mcp_url);
+            }
+            std::cout << "[ServiceDiscovery] " << (existed ? "Updated: " : "Discovered: ") << info.name << " at " << info.http_url << std::endl;
+
+            if (!info.mcp) {
+                return pplx::task_from_result();
+            }
+
+            // Only this server's tools are re-fetched
+            std::string server_url = info.mcp_url;
+            return discover_tools_from_server_async(server_url).then([this, server_url](std::vector<nlohmann::json> tools) {
+                set_server_tools(server_url, std::move(tools));
+            });
+        }
+
+        bool Service::upsert_watched_service(const ServiceInfo& info, const ServiceWatch& watch, ServiceInfo& previous, bool& existed) {
+            std::lock_guard<std::mutex> lock(_services_mutex);
+            // Checked under the lock so a service that just left the catalog is not re-added
+            if (!watch.active) {
+                return false;
+            }
+            for (auto& existing : _services) {
+                if (existing.name == info.name) {
+                    previous = existing;
+                    existed = true;
+                    existing = info;
+                    return true;
+                }
+            }
+            existed = false;
+            _services.push_back(info);
+            return true;
+        }
+
+        bool Service::remove_service(const std::string& service_name, ServiceInfo& removed) {
+            std::lock_guard<std::mutex> lock(_services_mutex);
+            for (auto it = _services.begin(); it != _services.end(); ++it) {
+                if (it->name == service_name) {
+                    removed = *it;
+                    _services.erase(it);
+                    return true;
+                }
+            }
+            return false;
+        }
+    }
+}
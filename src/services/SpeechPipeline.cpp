@@ -0,0 +1,327 @@
+#include <lily/services/SpeechPipeline.hpp>
+#include <iostream>
+#include <cctype>
+
+namespace lily {
+    namespace services {
+        static bool is_space(char c) {
+            return std::isspace(static_cast<unsigned char>(c)) != 0;
+        }
+
+        static bool is_terminator(char c) {
+            return c == '.' || c == '!' || c == '?';
+        }
+
+        static bool is_closing(char c) {
+            return c == '"' || c == '\'' || c == ')' || c == ']' || c == '*';
+        }
+
+        // Length of a CJK sentence terminator (。！？) starting at pos, or 0
+        static size_t cjk_terminator_length(const std::string& text, size_t pos) {
+            if (pos + 3 > text.size()) return 0;
+            const unsigned char* p = reinterpret_cast<const unsigned char*>(text.data() + pos);
+            if (p[0] == 0xE3 && p[1] == 0x80 && p[2] == 0x82) return 3; // 。
+            if (p[0] == 0xEF && p[1] == 0xBC && (p[2] == 0x81 || p[2] == 0x9F)) return 3; // ！？
+            return 0;
+        }
+
+        // Trimmed sentence, or empty when it has nothing to speak (whitespace, markdown rules)
+        static std::string speakable(const std::string& text, size_t begin, size_t end) {
+            while (begin < end && is_space(text[begin])) begin++;
+            while (end > begin && is_space(text[end - 1])) end--;
+            for (size_t i = begin; i < end; ++i) {
+                unsigned char c = static_cast<unsigned char>(text[i]);
+                if (std::isalnum(c) || c >= 0x80) {
+                    return text.substr(begin, end - begin);
+                }
+            }
+            return "";
+        }
+
+        std::vector<std::string> SentenceSplitter::feed(const std::string& text) {
+            std::vector<std::string> sentences;
+            _pending += text;
+
+            size_t start = 0; // start of the current sentence
+            size_t i = _scan;
+            while (i < _pending.size()) {
+                size_t end = std::string::npos; // one past the sentence
+                char c = _pending[i];
+
+                if (c == '\n') {
+                    end = i + 1;
+                } else if (is_terminator(c)) {
+                    size_t j = i + 1;
+                    while (j < _pending.size() && (is_terminator(_pending[j]) || is_closing(_pending[j]))) j++;
+                    if (j == _pending.size()) {
+                        break; // what follows decides; look again when more text arrives
+                    }
+                    if (!is_space(_pending[j]) || (c == '.' && is_abbreviation(start, i))) {
+                        i = j;
+                        continue;
+                    }
+                    end = j;
+                } else if (i + 3 > _pending.size() && (static_cast<unsigned char>(c) == 0xE3 || static_cast<unsigned char>(c) == 0xEF)) {
+                    break; // possibly a CJK terminator split across deltas
+                } else if (size_t length = cjk_terminator_length(_pending, i)) {
+                    end = i + length;
+                }
+
+                if (end == std::string::npos) {
+                    i++;
+                    continue;
+                }
+                std::string sentence = speakable(_pending, start, end);
+                if (!sentence.empty()) {
+                    sentences.push_back(std::move(sentence));
+                }
+                start = end;
+                i = end;
+            }
+
+            _pending.erase(0, start);
+            _scan = i - start;
+            return sentences;
+        }
+
+        std::string SentenceSplitter::flush() {
+            std::string rest = speakable(_pending, 0, _pending.size());
+            _pending.clear();
+            _scan = 0;
+            return rest;
+        }
+
+        // Whether the '.' at dot ends an abbreviation, an initial or a list number rather than a sentence
+        bool SentenceSplitter::is_abbreviation(size_t start, size_t dot) const {
+            size_t word_start = dot;
+            while (word_start > start && !is_space(_pending[word_start - 1])) word_start--;
+            while (word_start < dot && (_pending[word_start] == '(' || _pending[word_start] == '"')) word_start++;
+
+            std::string word;
+            for (size_t k = word_start; k < dot; ++k) {
+                word.push_back(static_cast<char>(std::tolower(static_cast<unsigned char>(_pending[k]))));
+            }
+            if (word.empty()) {
+                return false;
+            }
+            if (word.size() == 1 && std::isalpha(static_cast<unsigned char>(word[0]))) {
+                return true; // "J. Smith"
+            }
+
+            bool digits = word.find_first_not_of("0123456789") == std::string::npos;
+            if (digits) {
+                // "1." opening a list item, but not "...costs 3."
+                size_t k = start;
+                while (k < word_start && is_space(_pending[k])) k++;
+                return k == word_start;
+            }
+
+            static const char* const abbreviations[] = {
+                "mr", "mrs", "ms", "dr", "prof", "sr", "jr", "st", "vs", "e.g", "i.e", "approx", "no"
+            };
+            for (const char* abbreviation : abbreviations) {
+                if (word == abbreviation) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        SpeechPipeline::SpeechPipeline(TTSService& ttsService,
+                                       GatewayService& webSocketManager,
+                                       const std::string& user_id,
+                                       const TTSParameters& params)
+            : _ttsService(ttsService),
+              _webSocketManager(webSocketManager),
+              _user_id(user_id),
+              _params(params),
+              _start(std::chrono::steady_clock::now()) {}
+
+        void SpeechPipeline::add_text(const std::string& text) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _streamed_text += text;
+            for (auto& sentence : _splitter.feed(text)) {
+                _queue.push_back(std::move(sentence));
+            }
+            submit_ready_locked();
+        }
+
+        void SpeechPipeline::finish(const std::string& full_text, DoneCallback on_done) {
+            DoneCallback done_now;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                bool streamed_last = _streamed_text.size() >= full_text.size() &&
+                                     _streamed_text.compare(_streamed_text.size() - full_text.size(), full_text.size(), full_text) == 0;
+                if (!streamed_last) {
+                    // Nothing was streamed (streaming off or unavailable), or the reply is not the text that
+                    // was (e.g. the step-limit message after interim tool-step text): speak the whole reply
+                    _queue.clear();
+                    _splitter.flush();
+                    for (auto& sentence : _splitter.feed(full_text)) {
+                        _queue.push_back(std::move(sentence));
+                    }
+                }
+                std::string rest = _splitter.flush();
+                if (!rest.empty()) {
+                    _queue.push_back(std::move(rest));
+                }
+                _finished = true;
+                _on_done = std::move(on_done);
+
+                submit_ready_locked();
+                done_now = take_done_locked();
+            }
+            if (done_now) {
+                done_now();
+            }
+        }
+
+        void SpeechPipeline::abort() {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _queue.clear();
+            _splitter.flush();
+            _finished = true;
+            _on_done = nullptr;
+        }
+
+        // Caller holds _mutex
+        void SpeechPipeline::submit_ready_locked() {
+            if (_queue.empty() || _outstanding >= kLookahead) {
+                return;
+            }
+
+            auto self = shared_from_this();
+            if (!_started) {
+                _started = true;
+                // Waits (off the caller's thread) for the client's socket; frames are held until then
+                pplx::create_task([self]() {
+                    self->on_connection(self->_webSocketManager.wait_for_connection_registration(self->_user_id, 10));
+                });
+            }
+
+            while (_outstanding < kLookahead && !_queue.empty()) {
+                std::string sentence = std::move(_queue.front());
+                _queue.pop_front();
+                _outstanding++;
+
+                uint64_t sequence = _next_sequence++;
+                _slots[sequence];
+                _ttsService.submit(sentence, _params, std::chrono::milliseconds(0),
+                                   [self, sequence](const utils::SharedBuffer& chunk) {
+                                       self->on_chunk(sequence, chunk);
+                                   })
+                    .then([self, sequence](TTSResult result) {
+                        self->on_sentence_done(sequence, result);
+                    });
+            }
+        }
+
+        void SpeechPipeline::on_chunk(uint64_t sequence, const utils::SharedBuffer& chunk) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_connection == Connection::unavailable) {
+                return;
+            }
+            if (_connection == Connection::ready && sequence == _head) {
+                send_locked(chunk);
+                return;
+            }
+            _slots[sequence].held.push_back(chunk);
+        }
+
+        void SpeechPipeline::on_sentence_done(uint64_t sequence, const TTSResult& result) {
+            if (result.status == TTSStatus::rejected) {
+                std::cerr << "[TTS PIPELINE] TTS queue is full, skipping a sentence for user " << _user_id << std::endl;
+            } else if (result.status == TTSStatus::deadline_exceeded) {
+                std::cerr << "[TTS PIPELINE] Sentence missed its TTS deadline for user " << _user_id << std::endl;
+            } else if (result.status == TTSStatus::partial) {
+                std::cerr << "[TTS PIPELINE] TTS connection dropped mid-sentence for user " << _user_id << std::endl;
+            } else if (result.status != TTSStatus::ok) {
+                std::cerr << "Audio synthesis failed." << std::endl;
+            }
+
+            DoneCallback done;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _outstanding--;
+                if (result.status == TTSStatus::ok) {
+                    _sentences_spoken++;
+                }
+                auto it = _slots.find(sequence);
+                if (it != _slots.end()) {
+                    it->second.done = true;
+                }
+                flush_locked();
+                submit_ready_locked();
+                done = take_done_locked();
+            }
+            if (done) {
+                done();
+            }
+        }
+
+        void SpeechPipeline::on_connection(bool registered) {
+            if (!registered) {
+                std::cerr << "Connection for user_id " << _user_id << " is not registered, unable to send audio data." << std::endl;
+            }
+
+            DoneCallback done;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _connection = registered ? Connection::ready : Connection::unavailable;
+                flush_locked();
+                done = take_done_locked();
+            }
+            if (done) {
+                done();
+            }
+        }
+
+        // Caller holds _mutex, which keeps frames in order across sentences
+        void SpeechPipeline::send_locked(const utils::SharedBuffer& chunk) {
+            try {
+                if (_chunks_sent++ == 0) {
+                    double first_audio = std::chrono::duration<double>(std::chrono::steady_clock::now() - _start).count();
+                    std::cout << "[TTS PIPELINE] Time to first audio for user " << _user_id << ": " << first_audio << " seconds" << std::endl;
+                }
+                _webSocketManager.send_binary_to_client_by_id(_user_id, chunk);
+            } catch (const std::exception& e) {
+                std::cerr << "[TTS PIPELINE] Error sending audio: " << e.what() << std::endl;
+            }
+        }
+
+        // Sends held frames from the head sentence onwards, moving past finished sentences.
+        // Once the connection is known to be unavailable, frames are dropped instead. Caller holds _mutex.
+        void SpeechPipeline::flush_locked() {
+            if (_connection == Connection::waiting) {
+                return;
+            }
+            for (auto it = _slots.find(_head); it != _slots.end(); it = _slots.find(_head)) {
+                if (_connection == Connection::ready) {
+                    for (const auto& chunk : it->second.held) {
+                        send_locked(chunk);
+                    }
+                }
+                it->second.held.clear();
+                if (!it->second.done) {
+                    return;
+                }
+                _slots.erase(it);
+                _head++;
+            }
+        }
+
+        // The completion callback once every sentence is synthesized and sent, else empty. Caller holds _mutex.
+        SpeechPipeline::DoneCallback SpeechPipeline::take_done_locked() {
+            if (!_on_done || !_finished || !_queue.empty() || _outstanding > 0) {
+                return nullptr;
+            }
+            if (_started && _connection == Connection::waiting) {
+                return nullptr; // audio is still held for the connection
+            }
+            std::cout << "[TTS PIPELINE] Spoke " << _sentences_spoken << " sentence(s) for user " << _user_id << std::endl;
+            DoneCallback done = std::move(_on_done);
+            _on_done = nullptr;
+            return done;
+        }
+    }
+}
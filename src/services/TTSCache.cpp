@@ -0,0 +1,323 @@
+#include <lily/services/TTSCache.hpp>
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <utime.h>
+#include <sys/stat.h>
+
+namespace lily {
+    namespace services {
+        namespace {
+            const char kMagic[8] = {'L', 'I', 'L', 'Y', 'T', 'T', 'S', '1'};
+            const char* const kSuffix = ".tts";
+
+            // Disk entry: magic, key length, audio length, key, audio
+            struct DiskHeader {
+                char magic[8];
+                uint64_t key_length;
+                uint64_t audio_length;
+            };
+
+            uint64_t fnv1a(const std::string& data) {
+                uint64_t hash = 14695981039346656037ULL;
+                for (unsigned char c : data) {
+                    hash ^= c;
+                    hash *= 1099511628211ULL;
+                }
+                return hash;
+            }
+
+            bool read_fully(int fd, void* buffer, size_t size, uint64_t offset) {
+                char* out = static_cast<char*>(buffer);
+                while (size > 0) {
+                    ssize_t got = ::pread(fd, out, size, static_cast<off_t>(offset));
+                    if (got < 0 && errno == EINTR) {
+                        continue;
+                    }
+                    if (got <= 0) {
+                        return false;
+                    }
+                    out += got;
+                    size -= static_cast<size_t>(got);
+                    offset += static_cast<uint64_t>(got);
+                }
+                return true;
+            }
+
+            bool has_suffix(const std::string& name) {
+                size_t length = std::strlen(kSuffix);
+                return name.size() > length && name.compare(name.size() - length, length, kSuffix) == 0;
+            }
+        }
+
+        TTSCache::TTSCache(size_t max_bytes, const std::string& disk_directory, size_t disk_max_bytes)
+            : _max_bytes(max_bytes), _disk_directory(disk_directory), _disk_max_bytes(disk_max_bytes) {
+            while (_disk_directory.size() > 1 && _disk_directory.back() == '/') {
+                _disk_directory.pop_back();
+            }
+            if (!_disk_directory.empty() && _disk_max_bytes > 0) {
+                if (::mkdir(_disk_directory.c_str(), 0755) == 0 || errno == EEXIST) {
+                    _disk_enabled = true;
+                    scan_disk();
+                    std::cout << "[TTS CACHE] Disk tier at " << _disk_directory << ": " << _disk_entries
+                              << " entries, " << _disk_bytes << " bytes" << std::endl;
+                } else {
+                    std::cerr << "[TTS CACHE] Cannot create " << _disk_directory << ": " << std::strerror(errno)
+                              << ", disk tier disabled" << std::endl;
+                }
+            }
+        }
+
+        std::string TTSCache::make_key(const std::string& text, const TTSParameters& params) {
+            std::string key = std::to_string(params.speaker) + '\x1f' + std::to_string(params.sample_rate) + '\x1f' +
+                              params.model + '\x1f' + params.lang + '\x1f';
+            bool space = false;
+            for (char c : text) {
+                if (std::isspace(static_cast<unsigned char>(c))) {
+                    space = true;
+                    continue;
+                }
+                if (space && key.back() != '\x1f') {
+                    key.push_back(' ');
+                }
+                space = false;
+                key.push_back(c);
+            }
+            return key;
+        }
+
+        bool TTSCache::lookup(const std::string& key, std::vector<utils::SharedBuffer>& chunks) {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                auto it = _index.find(key);
+                if (it != _index.end()) {
+                    _lru.splice(_lru.begin(), _lru, it->second);
+                    chunks = it->second->chunks;
+                    _memory_hits++;
+                    _bytes_saved += it->second->bytes;
+                    return true;
+                }
+            }
+
+            utils::SharedBuffer audio;
+            if (read_disk(key, audio)) {
+                chunks.assign(1, audio);
+                _disk_hits++;
+                _bytes_saved += audio->size();
+                std::lock_guard<std::mutex> lock(_mutex);
+                insert_locked(key, chunks, audio->size());
+                return true;
+            }
+
+            _misses++;
+            return false;
+        }
+
+        void TTSCache::store(const std::string& key, const std::vector<utils::SharedBuffer>& chunks, size_t bytes) {
+            if (bytes == 0 || bytes > _max_bytes / 4) {
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if (_index.count(key)) {
+                    return; // synthesized twice concurrently; the first copy stays
+                }
+                insert_locked(key, chunks, bytes);
+            }
+            write_disk(key, chunks, bytes);
+        }
+
+        // Caller holds _mutex
+        void TTSCache::insert_locked(const std::string& key, const std::vector<utils::SharedBuffer>& chunks, size_t bytes) {
+            if (bytes > _max_bytes / 4 || _index.count(key)) {
+                return;
+            }
+            while (!_lru.empty() && _bytes + bytes > _max_bytes) {
+                _bytes -= _lru.back().bytes;
+                _index.erase(_lru.back().key);
+                _lru.pop_back();
+                _evictions++;
+            }
+            _lru.push_front(Entry{key, chunks, bytes});
+            _index[key] = _lru.begin();
+            _bytes += bytes;
+        }
+
+        std::string TTSCache::disk_path(const std::string& key) const {
+            char name[17];
+            std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(fnv1a(key)));
+            return _disk_directory + "/" + name + kSuffix;
+        }
+
+        void TTSCache::scan_disk() {
+            DIR* dir = ::opendir(_disk_directory.c_str());
+            if (!dir) {
+                return;
+            }
+            while (dirent* item = ::readdir(dir)) {
+                std::string name = item->d_name;
+                struct stat info;
+                if (has_suffix(name) && ::stat((_disk_directory + "/" + name).c_str(), &info) == 0) {
+                    _disk_bytes += static_cast<size_t>(info.st_size);
+                    _disk_entries++;
+                }
+            }
+            ::closedir(dir);
+        }
+
+        bool TTSCache::read_disk(const std::string& key, utils::SharedBuffer& audio) {
+            if (!_disk_enabled) {
+                return false;
+            }
+            std::string path = disk_path(key);
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0) {
+                return false;
+            }
+            struct stat info;
+            DiskHeader header;
+            std::string stored_key(key.size(), '\0');
+            bool valid = ::fstat(fd, &info) == 0 &&
+                         read_fully(fd, &header, sizeof(header), 0) &&
+                         std::memcmp(header.magic, kMagic, sizeof(kMagic)) == 0 &&
+                         header.key_length == key.size() && header.audio_length > 0 &&
+                         sizeof(header) + header.key_length + header.audio_length == static_cast<uint64_t>(info.st_size) &&
+                         read_fully(fd, &stored_key[0], stored_key.size(), sizeof(header)) &&
+                         stored_key == key; // hash collisions
+            // The audio is read straight into the buffer the memory tier keeps
+            std::vector<uint8_t> bytes;
+            if (valid) {
+                bytes.resize(header.audio_length);
+                valid = read_fully(fd, bytes.data(), bytes.size(), sizeof(header) + header.key_length);
+            }
+            ::close(fd);
+
+            if (!valid) {
+                return false;
+            }
+            audio = utils::make_shared_buffer(std::move(bytes));
+            ::utime(path.c_str(), nullptr); // recently used files are trimmed last
+            return true;
+        }
+
+        void TTSCache::write_disk(const std::string& key, const std::vector<utils::SharedBuffer>& chunks, size_t bytes) {
+            if (!_disk_enabled) {
+                return;
+            }
+            std::string path = disk_path(key);
+            std::string temporary = path + ".tmp";
+
+            DiskHeader header;
+            std::memcpy(header.magic, kMagic, sizeof(kMagic));
+            header.key_length = key.size();
+            header.audio_length = bytes;
+
+            std::lock_guard<std::mutex> lock(_disk_mutex);
+            struct stat existing;
+            bool replaced = ::stat(path.c_str(), &existing) == 0;
+
+            std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(key.data(), static_cast<std::streamsize>(key.size()));
+            for (const auto& chunk : chunks) {
+                file.write(reinterpret_cast<const char*>(chunk->data()), static_cast<std::streamsize>(chunk->size()));
+            }
+            file.close();
+            // Readers see either the old file or the complete new one
+            if (!file || std::rename(temporary.c_str(), path.c_str()) != 0) {
+                std::cerr << "[TTS CACHE] Failed to write " << path << std::endl;
+                std::remove(temporary.c_str());
+                return;
+            }
+
+            if (replaced) {
+                _disk_bytes -= std::min(_disk_bytes, static_cast<size_t>(existing.st_size));
+                _disk_entries--;
+            }
+            _disk_bytes += sizeof(header) + key.size() + bytes;
+            _disk_entries++;
+            if (_disk_bytes > _disk_max_bytes) {
+                trim_disk_locked();
+            }
+        }
+
+        // Deletes the least recently used files until the directory is at 90% of its budget. Caller holds _disk_mutex.
+        void TTSCache::trim_disk_locked() {
+            struct File {
+                std::string path;
+                time_t used;
+                size_t size;
+            };
+            std::vector<File> files;
+            DIR* dir = ::opendir(_disk_directory.c_str());
+            if (!dir) {
+                return;
+            }
+            while (dirent* item = ::readdir(dir)) {
+                std::string name = item->d_name;
+                std::string path = _disk_directory + "/" + name;
+                struct stat info;
+                if (has_suffix(name) && ::stat(path.c_str(), &info) == 0) {
+                    files.push_back(File{path, info.st_mtime, static_cast<size_t>(info.st_size)});
+                }
+            }
+            ::closedir(dir);
+
+            std::sort(files.begin(), files.end(), [](const File& a, const File& b) { return a.used < b.used; });
+            _disk_bytes = 0;
+            for (const auto& file : files) {
+                _disk_bytes += file.size;
+            }
+            _disk_entries = files.size();
+
+            size_t target = _disk_max_bytes / 10 * 9;
+            for (const auto& file : files) {
+                if (_disk_bytes <= target) {
+                    break;
+                }
+                if (std::remove(file.path.c_str()) == 0) {
+                    _disk_bytes -= file.size;
+                    _disk_entries--;
+                    _disk_evictions++;
+                }
+            }
+        }
+
+        nlohmann::json TTSCache::get_metrics() const {
+            uint64_t hits = _memory_hits.load() + _disk_hits.load();
+            uint64_t lookups = hits + _misses.load();
+
+            nlohmann::json metrics;
+            metrics["hits"] = hits;
+            metrics["memory_hits"] = _memory_hits.load();
+            metrics["disk_hits"] = _disk_hits.load();
+            metrics["misses"] = _misses.load();
+            metrics["hit_rate"] = lookups > 0 ? static_cast<double>(hits) / lookups : 0.0;
+            metrics["bytes_saved"] = _bytes_saved.load();
+            metrics["evictions"] = _evictions.load();
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                metrics["entries"] = _lru.size();
+                metrics["bytes"] = _bytes;
+            }
+            metrics["max_bytes"] = _max_bytes;
+
+            std::lock_guard<std::mutex> lock(_disk_mutex);
+            metrics["disk_enabled"] = _disk_enabled;
+            if (_disk_enabled) {
+                metrics["disk_entries"] = _disk_entries;
+                metrics["disk_bytes"] = _disk_bytes;
+                metrics["disk_max_bytes"] = _disk_max_bytes;
+                metrics["disk_evictions"] = _disk_evictions.load();
+            }
+            return metrics;
+        }
+    }
+}
@@ -1,342 +1,287 @@
 #include "lily/services/TTSService.hpp"
 #include <iostream>
 #include <nlohmann/json.hpp>
-#include <cpprest/ws_client.h>
 #include <cpprest/json.h>
 #include <cpprest/uri_builder.h>
-#include <cpprest/containerstream.h>
-#include <chrono>
-#include <thread>
 
 using namespace web;
-using namespace web::websockets::client;
 
 namespace lily {
     namespace services {
-        TTSService::TTSService() : _is_connected(false) {
+        TTSService::TTSService()
+            : _pool_size(2), _max_queue(64), _request_timeout(std::chrono::seconds(30)) {
         }
 
         TTSService::~TTSService() {
-            if (_is_connected) {
-                close();
-            }
+            close();
+        }
+
+        void TTSService::set_pool_limits(size_t pool_size, size_t max_queue, std::chrono::seconds request_timeout) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _pool_size = pool_size == 0 ? 1 : pool_size;
+            _max_queue = max_queue;
+            _request_timeout = request_timeout;
+        }
+
+        void TTSService::set_close_ends_utterance(bool close_ends_utterance) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _close_ends_utterance = close_ends_utterance;
+        }
+
+        void TTSService::set_cache(std::shared_ptr<TTSCache> cache) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _cache = std::move(cache);
+        }
+
+        std::shared_ptr<TTSCache> TTSService::cache() const {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return _cache;
         }
 
         bool TTSService::connect(const std::string& provider_url, const std::string& websocket_url) {
-            _provider_url = provider_url; // Set the provider URL first
-            _websocket_url = websocket_url; // Set the websocket URL
-            const int max_retries = 5;
-            const int retry_delay_ms = 2000;
+            size_t pool_size;
+            bool close_ends_utterance;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if (!_sessions.empty() && provider_url == _provider_url && websocket_url == _websocket_url) {
+                    return true;
+                }
+                _provider_url = provider_url; // Set the provider URL first
+                _websocket_url = websocket_url; // Set the websocket URL
+                pool_size = _pool_size;
+                close_ends_utterance = _close_ends_utterance;
+            }
 
-            // Check readiness before attempting to connect
+            // Check readiness once per connect; requests on the sessions skip it
             if (!is_ready()) {
                 std::cerr << "TTS provider is not ready." << std::endl;
                 return false;
             }
 
-            for (int i = 0; i < max_retries; ++i) {
-                if (initialize_websocket()) {
-                    _is_connected = true;
-                    return true;
+            // Sessions that miss the first attempt keep reconnecting in the background;
+            // one live connection is enough to start serving
+            std::string url = resolve_websocket_url();
+            std::vector<std::shared_ptr<TTSSession>> sessions;
+            size_t connected = 0;
+            for (size_t i = 0; i < pool_size; ++i) {
+                auto session = std::make_shared<TTSSession>(url, close_ends_utterance);
+                if (session->open()) {
+                    connected++;
                 }
-                std::this_thread::sleep_for(std::chrono::milliseconds(retry_delay_ms));
+                sessions.push_back(session);
             }
+            if (connected == 0) {
+                std::cerr << "Failed to connect to TTS provider." << std::endl;
+                for (auto& session : sessions) {
+                    session->close();
+                }
+                return false;
+            }
+            std::cout << "[TTS] Session pool ready: " << connected << "/" << pool_size << " connection(s) to " << url << std::endl;
 
-            std::cerr << "Failed to connect to TTS provider after " << max_retries << " attempts." << std::endl;
-            _is_connected = false;
-            return false;
+            std::vector<std::shared_ptr<TTSSession>> previous;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                previous.swap(_sessions);
+                _sessions = sessions;
+            }
+            for (auto& session : previous) {
+                session->close();
+            }
+            return true;
         }
 
-        bool TTSService::initialize_websocket() {
-            try {
-                // Create WebSocket client with configuration
-                websocket_client_config config;
-                config.set_validate_certificates(false); // Disable certificate validation for internal communication
-                
-                // Set timeout values to prevent premature connection closure
-                // These values are in milliseconds
-                // Timeout configuration is not available in this version of cpprest
-                
-                _websocket_client = std::make_unique<websocket_client>(config);
-                
-                // Use the websocket_url directly if provided, otherwise transform the provider_url
-                std::string url_to_use = _websocket_url.empty() ? _provider_url : _websocket_url;
-                
-                if (!_websocket_url.empty()) {
-                    // Use the websocket_url directly
-                    web::uri websocket_uri(utility::conversions::to_string_t(url_to_use));
-                    auto task = _websocket_client->connect(websocket_uri);
-                    task.wait();
-                } else {
-                    // Transform the provider URL to extract host and port (fallback for backward compatibility)
-                    web::uri provider_uri(utility::conversions::to_string_t(_provider_url));
-                    web::uri_builder builder(provider_uri);
-                    
-                    // Convert HTTP/HTTPS schemes to WebSocket schemes
-                    std::string scheme = utility::conversions::to_utf8string(provider_uri.scheme());
-                    if (scheme == "http") {
-                        builder.set_scheme(U("ws"));
-                    } else if (scheme == "https") {
-                        builder.set_scheme(U("wss"));
-                    }
-                    
-                    // Set default port if not specified
-                    if (provider_uri.port() == 0) {
-                        builder.set_port(9000);
-                    }
-                    auto task = _websocket_client->connect(builder.to_uri());
-                    task.wait();
-                }
-                
-                return true;
-            } catch (const std::exception& e) {
-                std::cerr << "Error initializing WebSocket: " << e.what() << std::endl;
-                return false;
+        std::vector<std::shared_ptr<TTSSession>> TTSService::sessions() const {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return _sessions;
+        }
+
+        size_t TTSService::capacity() const {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return _sessions.size() + _max_queue;
+        }
+
+        std::string TTSService::resolve_websocket_url() const {
+            // Use the websocket_url directly if provided
+            if (!_websocket_url.empty()) {
+                return _websocket_url;
+            }
+
+            // Transform the provider URL to extract host and port (fallback for backward compatibility)
+            web::uri provider_uri(utility::conversions::to_string_t(_provider_url));
+            web::uri_builder builder(provider_uri);
+
+            // Convert HTTP/HTTPS schemes to WebSocket schemes
+            std::string scheme = utility::conversions::to_utf8string(provider_uri.scheme());
+            if (scheme == "http") {
+                builder.set_scheme(U("ws"));
+            } else if (scheme == "https") {
+                builder.set_scheme(U("wss"));
             }
+
+            // Set default port if not specified
+            if (provider_uri.port() == 0) {
+                builder.set_port(9000);
+            }
+            return utility::conversions::to_utf8string(builder.to_string());
         }
 
         std::vector<uint8_t> TTSService::synthesize_speech(const std::string& text, const TTSParameters& params) {
-            const int max_retries = 3;
-            for (int attempt = 0; attempt < max_retries; ++attempt) {
-                // Always ensure we have a fresh connection for each request since the server closes it after sending audio
-                if (_is_connected && _websocket_client) {
-                    // Close existing connection if it's still open
-                    try {
-                        close();
-                    } catch (const std::exception& e) {
-                        std::cerr << "Error closing existing connection: " << e.what() << std::endl;
-                    }
+            return synthesize_speech_async(text, params).get();
+        }
+
+        pplx::task<std::vector<uint8_t>> TTSService::synthesize_speech_async(const std::string& text, const TTSParameters& params) {
+            return submit(text, params).then([this](TTSResult result) {
+                std::vector<uint8_t> audio;
+                if (result.status != TTSStatus::ok) {
+                    return audio;
                 }
-                
-                // Establish a new connection for this request
-                if (!connect(_provider_url, _websocket_url)) {
-                    std::cerr << "Failed to connect to TTS service." << std::endl;
-                    if (attempt < max_retries - 1) {
-                        std::this_thread::sleep_for(std::chrono::seconds(1));
-                        continue;
-                    }
-                    return {};
+                audio.reserve(result.bytes);
+                for (const auto& chunk : result.chunks) {
+                    audio.insert(audio.end(), chunk->begin(), chunk->end());
                 }
-                
-                try {
-                    // Create JSON request
-                    nlohmann::json request;
-                    request["text"] = text;
-                    request["speaker"] = params.speaker;
-                    request["sample_rate"] = params.sample_rate;
-                    request["model"] = params.model;
-                    request["lang"] = params.lang;
-            
-                    // Send request
-                    std::string request_str = request.dump();
-                    websocket_outgoing_message msg;
-                    msg.set_utf8_message(request_str);
-                    
-                    // Add a small delay to help with timing issues
-                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
-                    auto send_task = _websocket_client->send(msg);
-                    send_task.wait();
-            
-                    // Wait for response
-                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
-                    auto receive_task = _websocket_client->receive();
-                    try {
-                        receive_task.wait();
-                    } catch (const std::exception& e) {
-                        std::cerr << "Error waiting for first response: " << e.what() << std::endl;
-                        if (attempt < max_retries - 1) {
-                            std::this_thread::sleep_for(std::chrono::seconds(1));
-                            continue; // Retry the entire process
-                        }
-                        throw;
+                _bytes_copied += audio.size();
+                return audio;
+            });
+        }
+
+        pplx::task<TTSResult> TTSService::submit(const std::string& text,
+                                                 const TTSParameters& params,
+                                                 std::chrono::milliseconds timeout,
+                                                 AudioChunkCallback on_chunk) {
+            auto cache = this->cache();
+            std::string cache_key;
+            if (cache) {
+                cache_key = TTSCache::make_key(text, params);
+                TTSResult cached;
+                if (cache->lookup(cache_key, cached.chunks)) {
+                    cached.status = TTSStatus::ok;
+                    cached.ended = true;
+                    for (const auto& chunk : cached.chunks) {
+                        cached.bytes += chunk->size();
                     }
-                    
-                    auto response_msg = receive_task.get();
-                    
-                    // Handle ping/pong messages by waiting for the actual response
-                    // The TTS provider may send ping messages while generating audio
-                    bool got_actual_response = false;
-                    int ping_pong_count = 0;
-                    const int max_ping_pong_wait = 10; // Maximum number of ping/pong messages to wait through
-                    
-                    while (!got_actual_response && ping_pong_count < max_ping_pong_wait) {
-                        switch (response_msg.message_type()) {
-                            case websocket_message_type::text_message: {
-                                std::string metadata_str = response_msg.extract_string().get();
-                                nlohmann::json metadata = nlohmann::json::parse(metadata_str);
-                                
-                                if (metadata.value("status", "") == "success") {
-                                    std::vector<uint8_t> all_audio_data;
-                                    
-                                    // Continue receiving messages until we get a close message
-                                    bool receiving_audio = true;
-                                    int audio_chunk_count = 0;
-                                    while (receiving_audio) {
-                                        try {
-                                            // Add a small delay to help with timing issues
-                                            std::this_thread::sleep_for(std::chrono::milliseconds(50));
-                                            auto audio_task = _websocket_client->receive();
-                                            audio_task.wait();
-                                            auto audio_msg = audio_task.get();
-                                            
-                                            switch (audio_msg.message_type()) {
-                                                case websocket_message_type::binary_message: {
-                                                    auto chunk_buffer = audio_msg.body();
-                                                    concurrency::streams::container_buffer<std::vector<uint8_t>> container_buffer;
-                                                    chunk_buffer.read_to_end(container_buffer).get();
-                                                    std::vector<uint8_t> chunk_data = container_buffer.collection();
-                                                    all_audio_data.insert(all_audio_data.end(), chunk_data.begin(), chunk_data.end());
-                                                    audio_chunk_count++;
-                                                    break;
-                                                }
-                                                case websocket_message_type::close: {
-                                                    // Connection closure after receiving audio is normal, break out of loop
-                                                    receiving_audio = false;
-                                                    break;
-                                                }
-                                                case websocket_message_type::text_message: {
-                                                    // Handle any text messages during audio streaming
-                                                    break;
-                                                }
-                                                case websocket_message_type::ping: {
-                                                    break;
-                                                }
-                                                case websocket_message_type::pong: {
-                                                    break;
-                                                }
-                                                default: {
-                                                    receiving_audio = false;
-                                                    break;
-                                                }
-                                            }
-                                        } catch (const std::exception& e) {
-                                            std::string error_msg = e.what();
-                                            // If we have received audio data and the error is about the connection closing, then it's expected.
-                                            if (audio_chunk_count > 0 && (error_msg.find("closed") != std::string::npos || error_msg.find("close") != std::string::npos)) {
-                                                // This is expected: the server closes the connection after sending audio.
-                                                receiving_audio = false;
-                                                break;
-                                            } else {
-                                                std::cerr << "Error receiving audio data: " << error_msg << std::endl;
-                                            }
-
-                                            if (attempt < max_retries - 1) {
-                                                std::this_thread::sleep_for(std::chrono::seconds(1));
-                                                continue; // Retry the entire process
-                                            }
-                                            receiving_audio = false;
-                                        }
-                                    }
-                                    
-                                    // Check if we received audio data
-                                    if (!all_audio_data.empty()) {
-                                        return all_audio_data;
-                                    } else {
-                                        std::cerr << "No audio data received from TTS provider." << std::endl;
-                                        if (attempt < max_retries - 1) {
-                                            std::this_thread::sleep_for(std::chrono::seconds(1));
-                                            continue; // Retry the entire process
-                                        }
-                                    }
-                                }
-                                got_actual_response = true;
-                                break;
-                            }
-                            case websocket_message_type::close: {
-                                _is_connected = false;
-                                std::cerr << "TTS Request failed: Connection closed by server before audio data was received." << std::endl;
-                                if (attempt < max_retries - 1) {
-                                    std::this_thread::sleep_for(std::chrono::seconds(1));
-                                    continue; // Retry the entire process
-                                }
-                                got_actual_response = true;
-                                break;
-                            }
-                            case websocket_message_type::ping: {
-                                ping_pong_count++;
-                                // Wait for the next message
-                                try {
-                                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
-                                    auto receive_task2 = _websocket_client->receive();
-                                    receive_task2.wait();
-                                    response_msg = receive_task2.get();
-                                } catch (const std::exception& e) {
-                                    std::cerr << "Error waiting for response after ping: " << e.what() << std::endl;
-                                    if (attempt < max_retries - 1) {
-                                        std::this_thread::sleep_for(std::chrono::seconds(1));
-                                        continue; // Retry the entire process
-                                    }
-                                    got_actual_response = true;
-                                }
-                                break;
-                            }
-                            case websocket_message_type::pong: {
-                                ping_pong_count++;
-                                // Wait for the next message
-                                try {
-                                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
-                                    auto receive_task2 = _websocket_client->receive();
-                                    receive_task2.wait();
-                                    response_msg = receive_task2.get();
-                                } catch (const std::exception& e) {
-                                    std::cerr << "Error waiting for response after pong: " << e.what() << std::endl;
-                                    if (attempt < max_retries - 1) {
-                                        std::this_thread::sleep_for(std::chrono::seconds(1));
-                                        continue; // Retry the entire process
-                                    }
-                                    got_actual_response = true;
-                                }
-                                break;
-                            }
-                            default: {
-                                std::cerr << "Unexpected message type: " << static_cast<int>(response_msg.message_type()) << std::endl;
-                                if (attempt < max_retries - 1) {
-                                    std::this_thread::sleep_for(std::chrono::seconds(1));
-                                    continue; // Retry the entire process
-                                }
-                                got_actual_response = true;
-                                break;
-                            }
-                        }
+                    if (!on_chunk) {
+                        return pplx::task_from_result(cached);
                     }
-                    
-                    if (!got_actual_response) {
-                        std::cerr << "Exceeded maximum ping/pong wait count (" << max_ping_pong_wait << ")." << std::endl;
-                        if (attempt < max_retries - 1) {
-                            std::this_thread::sleep_for(std::chrono::seconds(1));
-                            continue; // Retry the entire process
+                    // Delivered off the caller's thread, like frames from the provider
+                    return pplx::create_task([cached, on_chunk]() mutable {
+                        for (const auto& chunk : cached.chunks) {
+                            on_chunk(chunk);
                         }
-                    }
-                } catch (const std::exception& e) {
-                    std::cerr << "Error synthesizing speech: " << e.what() << std::endl;
-                    if (attempt < max_retries - 1) {
-                        std::this_thread::sleep_for(std::chrono::seconds(1));
-                        continue; // Retry the entire process
-                    }
+                        cached.chunks.clear();
+                        return cached;
+                    });
                 }
-                
-                // If we reach here, this attempt failed, but we might retry
-                if (attempt < max_retries - 1) {
-                    std::this_thread::sleep_for(std::chrono::seconds(1));
-                    continue; // Retry the entire process
+            }
+
+            auto pool = sessions();
+            if (pool.empty()) {
+                std::cerr << "Failed to connect to TTS service." << std::endl;
+                return pplx::task_from_result(TTSResult());
+            }
+
+            // Reserve a slot first so concurrent callers cannot overshoot the bound
+            size_t limit = capacity();
+            if (_pending.fetch_add(1) >= limit) {
+                _pending--;
+                _rejected++;
+                std::cerr << "[TTS] Queue full (" << limit << " pending), rejecting request" << std::endl;
+                TTSResult rejected;
+                rejected.status = TTSStatus::rejected;
+                return pplx::task_from_result(rejected);
+            }
+
+            // Least busy connection, preferring ones that are currently up
+            std::shared_ptr<TTSSession> target;
+            size_t target_load = 0;
+            bool target_connected = false;
+            for (const auto& session : pool) {
+                size_t load = session->pending();
+                bool connected = session->is_connected();
+                if (!target || (connected && !target_connected) || (connected == target_connected && load < target_load)) {
+                    target = session;
+                    target_load = load;
+                    target_connected = connected;
                 }
             }
-            
-            // All attempts failed
-            return {};
+
+            if (timeout.count() <= 0) {
+                std::lock_guard<std::mutex> lock(_mutex);
+                timeout = std::chrono::duration_cast<std::chrono::milliseconds>(_request_timeout);
+            }
+            auto deadline = std::chrono::steady_clock::now() + timeout;
+
+            // Streamed frames are not kept in the result, so keep references for the cache
+            std::shared_ptr<std::vector<utils::SharedBuffer>> streamed;
+            if (cache && on_chunk) {
+                streamed = std::make_shared<std::vector<utils::SharedBuffer>>();
+                on_chunk = [streamed, forward = std::move(on_chunk)](const utils::SharedBuffer& chunk) {
+                    streamed->push_back(chunk);
+                    forward(chunk);
+                };
+            }
+
+            return target->synthesize(text, params, deadline, std::move(on_chunk)).then([this, cache, cache_key, streamed](TTSResult result) {
+                _pending--;
+                if (result.status == TTSStatus::ok) {
+                    _utterances++;
+                    _bytes_received += result.bytes;
+                    // A socket close may have cut the audio short, even from providers that close after every utterance
+                    if (cache && result.ended) {
+                        cache->store(cache_key, streamed ? *streamed : result.chunks, result.bytes);
+                    }
+                }
+                return result;
+            });
+        }
+
+        bool TTSService::is_saturated() const {
+            return _pending.load() * 4 >= capacity() * 3;
         }
 
         void TTSService::close() {
-            if (_websocket_client) {
-                try {
-                    auto task = _websocket_client->close();
-                    task.wait();
-                } catch (const std::exception& e) {
-                    std::cerr << "Error closing WebSocket connection: " << e.what() << std::endl;
+            std::vector<std::shared_ptr<TTSSession>> sessions;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                sessions.swap(_sessions);
+            }
+            for (auto& session : sessions) {
+                session->close();
+            }
+        }
+
+        bool TTSService::is_connected() const {
+            for (const auto& session : sessions()) {
+                if (session->is_connected()) {
+                    return true;
                 }
-                _websocket_client.reset();
             }
-            _is_connected = false;
+            return false;
+        }
+
+        nlohmann::json TTSService::get_metrics() const {
+            nlohmann::json metrics;
+            metrics["pending"] = _pending.load();
+            metrics["capacity"] = capacity();
+            metrics["rejected"] = _rejected.load();
+            metrics["saturated"] = is_saturated();
+
+            uint64_t utterances = _utterances.load();
+            metrics["utterances"] = utterances;
+            metrics["audio_bytes_received"] = _bytes_received.load();
+            metrics["audio_bytes_copied"] = _bytes_copied.load();
+            metrics["bytes_copied_per_utterance"] = utterances > 0 ? static_cast<double>(_bytes_copied.load()) / utterances : 0.0;
+
+            nlohmann::json connections = nlohmann::json::array();
+            for (const auto& session : sessions()) {
+                connections.push_back(session->get_metrics());
+            }
+            metrics["connections"] = connections;
+
+            if (auto cache = this->cache()) {
+                metrics["cache"] = cache->get_metrics();
+            }
+            return metrics;
         }
 
         bool TTSService::is_ready() {
@@ -0,0 +1,413 @@
+#include <lily/services/TTSSession.hpp>
+#include <cpprest/containerstream.h>
+#include <iostream>
+#include <algorithm>
+
+using namespace web;
+using namespace web::websockets::client;
+
+namespace lily {
+    namespace services {
+        // Drops a reference taken inside a client callback. Were it the last one, ~TTSSession would close
+        // that client from the client's own thread and wait on itself forever, so it is let go on the pplx pool.
+        static void release_outside_callback(std::shared_ptr<TTSSession> self) {
+            if (self.use_count() == 1) {
+                pplx::create_task([self]() mutable { self.reset(); });
+            }
+        }
+
+        TTSSession::TTSSession(const std::string& websocket_url, bool close_ends_utterance)
+            : _websocket_url(websocket_url), _close_ends_utterance(close_ends_utterance) {}
+
+        TTSSession::~TTSSession() {
+            close();
+        }
+
+        bool TTSSession::open() {
+            uint64_t generation;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if (_running) {
+                    return _connected;
+                }
+                generation = ++_generation;
+            }
+
+            auto client = connect_socket(generation);
+
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _running = true;
+                if (client) {
+                    _client = client;
+                    _connected = true;
+                }
+            }
+            _maintenance = std::thread(&TTSSession::maintenance_loop, this);
+            if (client) {
+                std::cout << "[TTS SESSION] Connected to " << _websocket_url << std::endl;
+            }
+            return client != nullptr;
+        }
+
+        void TTSSession::close() {
+            std::vector<std::shared_ptr<Request>> abandoned;
+            std::vector<std::shared_ptr<Client>> retired;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _running = false;
+                _connected = false;
+                _generation++;
+                if (_current) {
+                    abandoned.push_back(_current);
+                    _current.reset();
+                }
+                abandoned.insert(abandoned.end(), _queue.begin(), _queue.end());
+                _queue.clear();
+                if (_client) {
+                    _retired.push_back(_client);
+                    _client.reset();
+                }
+            }
+            _wake.notify_all();
+            if (_maintenance.joinable()) {
+                _maintenance.join();
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                retired.swap(_retired);
+            }
+            for (auto& client : retired) {
+                try {
+                    client->close().wait();
+                } catch (const std::exception&) {}
+            }
+            for (auto& request : abandoned) {
+                finish(request, TTSStatus::failed);
+            }
+        }
+
+        bool TTSSession::is_open() const {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return _running;
+        }
+
+        bool TTSSession::is_connected() const {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return _connected;
+        }
+
+        size_t TTSSession::pending() const {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return _queue.size() + (_current ? 1 : 0);
+        }
+
+        pplx::task<TTSResult> TTSSession::synthesize(const std::string& text,
+                                                     const TTSParameters& params,
+                                                     std::chrono::steady_clock::time_point deadline,
+                                                     AudioChunkCallback on_chunk) {
+            auto request = std::make_shared<Request>();
+            request->id = ++_next_id;
+            request->deadline = deadline;
+            request->on_chunk = std::move(on_chunk);
+
+            nlohmann::json request_json;
+            request_json["text"] = text;
+            request_json["speaker"] = params.speaker;
+            request_json["sample_rate"] = params.sample_rate;
+            request_json["model"] = params.model;
+            request_json["lang"] = params.lang;
+            request_json["request_id"] = request->id;
+            request->payload = request_json.dump();
+            _requests++;
+
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if (_running) {
+                    _queue.push_back(request);
+                    dispatch_locked();
+                    _wake.notify_all(); // the maintenance thread watches the new deadline
+                    return pplx::create_task(request->done);
+                }
+            }
+            std::cerr << "[TTS SESSION] Session is closed, dropping request " << request->id << std::endl;
+            finish(request, TTSStatus::failed);
+            return pplx::create_task(request->done);
+        }
+
+        std::shared_ptr<TTSSession::Client> TTSSession::connect_socket(uint64_t generation) {
+            websocket_client_config config;
+            config.set_validate_certificates(false); // Disable certificate validation for internal communication
+            auto client = std::make_shared<Client>(config);
+
+            std::weak_ptr<TTSSession> weak = shared_from_this();
+            client->set_message_handler([weak, generation](const websocket_incoming_message& msg) {
+                if (auto self = weak.lock()) {
+                    self->on_message(generation, msg);
+                    release_outside_callback(std::move(self));
+                }
+            });
+            client->set_close_handler([weak, generation](websocket_close_status, const utility::string_t&, const std::error_code&) {
+                if (auto self = weak.lock()) {
+                    self->on_closed(generation);
+                    release_outside_callback(std::move(self));
+                }
+            });
+
+            try {
+                client->connect(web::uri(utility::conversions::to_string_t(_websocket_url))).wait();
+                return client;
+            } catch (const std::exception& e) {
+                std::cerr << "[TTS SESSION] Error connecting to " << _websocket_url << ": " << e.what() << std::endl;
+                return nullptr;
+            }
+        }
+
+        // Sends the next queued request when the connection is up and idle. Caller holds _mutex.
+        void TTSSession::dispatch_locked() {
+            if (!_connected || _current || _queue.empty()) {
+                return;
+            }
+            _current = _queue.front();
+            _queue.pop_front();
+            _current->attempts++;
+
+            websocket_outgoing_message msg;
+            msg.set_utf8_message(_current->payload);
+
+            std::weak_ptr<TTSSession> weak = shared_from_this();
+            uint64_t id = _current->id;
+            uint64_t generation = _generation;
+            _client->send(msg).then([weak, id, generation](pplx::task<void> sent) {
+                try {
+                    sent.get();
+                } catch (const std::exception& e) {
+                    std::cerr << "[TTS SESSION] Error sending request " << id << ": " << e.what() << std::endl;
+                    if (auto self = weak.lock()) {
+                        self->on_closed(generation);
+                    }
+                }
+            });
+        }
+
+        void TTSSession::on_message(uint64_t generation, const websocket_incoming_message& msg) {
+            try {
+                if (msg.message_type() == websocket_message_type::binary_message) {
+                    concurrency::streams::container_buffer<std::vector<uint8_t>> buffer;
+                    msg.body().read_to_end(buffer).get();
+                    // The frame keeps the buffer's storage; it is not copied again on its way to clients
+                    auto chunk = utils::make_shared_buffer(std::move(buffer.collection()));
+
+                    AudioChunkCallback forward;
+                    {
+                        std::lock_guard<std::mutex> lock(_mutex);
+                        if (generation != _generation || !_current) {
+                            return;
+                        }
+                        _current->bytes += chunk->size();
+                        if (_current->on_chunk) {
+                            forward = _current->on_chunk;
+                        } else {
+                            _current->chunks.push_back(chunk);
+                        }
+                    }
+                    if (forward) {
+                        forward(chunk);
+                    }
+                    return;
+                }
+                if (msg.message_type() != websocket_message_type::text_message) {
+                    return; // ping/pong are answered by the client library
+                }
+
+                nlohmann::json message = nlohmann::json::parse(msg.extract_string().get());
+                std::string status = message.value("status", "");
+                std::string type = message.value("type", "");
+                bool done = status == "done" || status == "complete" || type == "end" || type == "done" ||
+                            (message.contains("done") && message["done"].is_boolean() && message["done"].get<bool>());
+                bool failed = status == "error";
+                if (!done && !failed) {
+                    return; // "success" metadata ahead of the audio
+                }
+
+                std::shared_ptr<Request> finished;
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    if (generation != _generation || !_current) {
+                        return;
+                    }
+                    // Frames for a request that already missed its deadline carry its old id
+                    if (message.contains("request_id") && message["request_id"].is_number_unsigned() &&
+                        message["request_id"].get<uint64_t>() != _current->id) {
+                        return;
+                    }
+                    finished = _current;
+                    finished->ended = done;
+                    _current.reset();
+                    dispatch_locked();
+                }
+                if (failed) {
+                    std::cerr << "[TTS SESSION] Provider error for request " << finished->id << ": " << message.dump() << std::endl;
+                }
+                finish(finished, done && finished->bytes > 0 ? TTSStatus::ok : TTSStatus::failed);
+            } catch (const std::exception& e) {
+                std::cerr << "[TTS SESSION] Error handling provider message: " << e.what() << std::endl;
+            }
+        }
+
+        void TTSSession::on_closed(uint64_t generation) {
+            std::shared_ptr<Request> finished;
+            TTSStatus status = TTSStatus::failed;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if (generation != _generation || !_connected) {
+                    return;
+                }
+                if (_current) {
+                    if (_current->bytes > 0) {
+                        // Without an end frame the audio may be cut short, unless the provider closes after each utterance
+                        finished = _current;
+                        status = _close_ends_utterance ? TTSStatus::ok : TTSStatus::partial;
+                    } else if (_current->attempts < 2) {
+                        _queue.push_front(_current); // lost before any audio: send it again after reconnecting
+                    } else {
+                        finished = _current;
+                    }
+                    _current.reset();
+                }
+                drop_connection_locked();
+            }
+            _wake.notify_all();
+            if (finished) {
+                if (status == TTSStatus::partial) {
+                    std::cerr << "[TTS SESSION] Connection lost mid-utterance for request " << finished->id << std::endl;
+                }
+                finish(finished, status);
+            }
+        }
+
+        // Caller holds _mutex and has already dealt with _current
+        void TTSSession::drop_connection_locked() {
+            _connected = false;
+            _generation++;
+            if (_client) {
+                _retired.push_back(_client);
+                _client.reset();
+            }
+        }
+
+        // Removes requests whose deadline has passed. Caller holds _mutex.
+        std::vector<std::shared_ptr<TTSSession::Request>> TTSSession::expire_locked(std::chrono::steady_clock::time_point now) {
+            std::vector<std::shared_ptr<Request>> expired;
+            if (_current && now >= _current->deadline) {
+                // Its remaining audio frames would be mistaken for the next request's
+                expired.push_back(_current);
+                _current.reset();
+                drop_connection_locked();
+            }
+            for (auto it = _queue.begin(); it != _queue.end();) {
+                if (now >= (*it)->deadline) {
+                    expired.push_back(*it);
+                    it = _queue.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            return expired;
+        }
+
+        void TTSSession::maintenance_loop() {
+            std::chrono::milliseconds backoff(0);
+            std::unique_lock<std::mutex> lock(_mutex);
+
+            while (_running) {
+                auto expired = expire_locked(std::chrono::steady_clock::now());
+                std::vector<std::shared_ptr<Client>> retired;
+                retired.swap(_retired);
+                bool reconnect = !_connected;
+                uint64_t generation = reconnect ? ++_generation : _generation;
+                lock.unlock();
+
+                for (auto& request : expired) {
+                    std::cerr << "[TTS SESSION] Request " << request->id << " missed its deadline" << std::endl;
+                    finish(request, TTSStatus::deadline_exceeded);
+                }
+                for (auto& client : retired) {
+                    try {
+                        client->close().wait();
+                    } catch (const std::exception&) {}
+                }
+
+                std::shared_ptr<Client> client;
+                if (reconnect) {
+                    client = connect_socket(generation);
+                }
+
+                lock.lock();
+                if (reconnect) {
+                    if (client && _running && generation == _generation) {
+                        _client = client;
+                        _connected = true;
+                        _reconnects++;
+                        backoff = std::chrono::milliseconds(0);
+                        dispatch_locked();
+                    } else {
+                        if (client) {
+                            _retired.push_back(client);
+                        }
+                        backoff = std::min(std::chrono::milliseconds(5000), std::max(std::chrono::milliseconds(100), backoff * 2));
+                    }
+                }
+
+                if (!_running) {
+                    break;
+                }
+                // Deadlines are checked at least every 250 ms while anything is pending
+                bool pending = _current || !_queue.empty();
+                if (!_connected) {
+                    _wake.wait_for(lock, pending ? std::min(backoff, std::chrono::milliseconds(250)) : backoff);
+                } else if (pending) {
+                    _wake.wait_for(lock, std::chrono::milliseconds(250));
+                } else {
+                    _wake.wait(lock);
+                }
+            }
+        }
+
+        void TTSSession::finish(std::shared_ptr<Request> request, TTSStatus status) {
+            TTSResult result;
+            result.status = status;
+            result.bytes = request->bytes;
+            result.ended = request->ended;
+            if (status == TTSStatus::ok) {
+                _completed++;
+                result.chunks = std::move(request->chunks);
+            } else if (status == TTSStatus::deadline_exceeded) {
+                _deadline_exceeded++;
+            } else if (status == TTSStatus::partial) {
+                _partial++;
+            } else {
+                _failed++;
+            }
+            request->done.set(std::move(result));
+        }
+
+        nlohmann::json TTSSession::get_metrics() const {
+            nlohmann::json metrics;
+            metrics["url"] = _websocket_url;
+            metrics["requests"] = _requests.load();
+            metrics["completed"] = _completed.load();
+            metrics["failed"] = _failed.load();
+            metrics["partial"] = _partial.load();
+            metrics["deadline_exceeded"] = _deadline_exceeded.load();
+            metrics["reconnects"] = _reconnects.load();
+
+            std::lock_guard<std::mutex> lock(_mutex);
+            metrics["connected"] = _connected;
+            metrics["queued"] = _queue.size();
+            metrics["in_flight"] = _current ? 1 : 0;
+            return metrics;
+        }
+    }
+}